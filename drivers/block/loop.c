@@ -631,6 +631,155 @@ static int lo_rw_aio(struct loop_device *lo, struct loop_cmd *cmd,
 	return 0;
 }
 
+/*
+ * Direct I/O commands queued back to back on a worker and contiguous in
+ * the backing file are submitted with a single kiocb.
+ */
+#define LOOP_MERGE_MAX_CMDS	16
+#define LOOP_MERGE_MAX_BYTES	(1U << 20)
+
+struct loop_merge {
+	struct kiocb iocb;
+	atomic_t ref;
+	long ret;
+	unsigned int nr;
+	struct bio_vec *bvec;
+	struct loop_cmd *cmds[LOOP_MERGE_MAX_CMDS];
+};
+
+static bool loop_cmd_mergeable(struct loop_device *lo, struct loop_cmd *cmd)
+{
+	struct request *rq = blk_mq_rq_from_pdu(cmd);
+
+	if (!cmd->use_aio || lo->transfer)
+		return false;
+
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+		return true;
+	case REQ_OP_WRITE:
+		return !(lo->lo_flags & LO_FLAGS_READ_ONLY);
+	default:
+		return false;
+	}
+}
+
+/* @next can be submitted along with @prev, @bytes being queued so far */
+static bool loop_cmds_contiguous(struct loop_device *lo, struct loop_cmd *prev,
+				 struct loop_cmd *next, unsigned int bytes)
+{
+	struct request *prq = blk_mq_rq_from_pdu(prev);
+	struct request *nrq = blk_mq_rq_from_pdu(next);
+
+	return loop_cmd_mergeable(lo, next) &&
+	       req_op(prq) == req_op(nrq) &&
+	       prev->blkcg_css == next->blkcg_css &&
+	       prev->memcg_css == next->memcg_css &&
+	       blk_rq_pos(prq) + blk_rq_sectors(prq) == blk_rq_pos(nrq) &&
+	       bytes + blk_rq_bytes(nrq) <= LOOP_MERGE_MAX_BYTES;
+}
+
+/* hand its share of the result to each command of the kiocb */
+static void lo_rw_aio_merge_put(struct loop_merge *merge)
+{
+	unsigned int i;
+	long ret;
+
+	if (!atomic_dec_and_test(&merge->ref))
+		return;
+
+	ret = merge->ret;
+	for (i = 0; i < merge->nr; i++) {
+		struct loop_cmd *cmd = merge->cmds[i];
+		struct request *rq = blk_mq_rq_from_pdu(cmd);
+
+		if (ret < 0) {
+			cmd->ret = ret;
+		} else {
+			cmd->ret = min_t(long, ret, blk_rq_bytes(rq));
+			ret -= cmd->ret;
+		}
+		if (likely(!blk_should_fake_timeout(rq->q)))
+			blk_mq_complete_request(rq);
+	}
+	kfree(merge->bvec);
+	kfree(merge);
+}
+
+static void lo_rw_aio_merge_complete(struct kiocb *iocb, long ret, long ret2)
+{
+	struct loop_merge *merge = container_of(iocb, struct loop_merge, iocb);
+
+	merge->ret = ret;
+	lo_rw_aio_merge_put(merge);
+}
+
+/*
+ * Returns false if the commands could not be merged, the caller then
+ * handles them one by one.
+ */
+static bool lo_rw_aio_merged(struct loop_device *lo, struct loop_cmd **cmds,
+			     unsigned int nr)
+{
+	struct request *rq = blk_mq_rq_from_pdu(cmds[0]);
+	struct file *file = lo->lo_backing_file;
+	int rw = req_op(rq) == REQ_OP_WRITE ? WRITE : READ;
+	struct req_iterator rq_iter;
+	struct loop_merge *merge;
+	struct iov_iter iter;
+	struct bio_vec tmp, *bvec;
+	unsigned int bytes = 0;
+	int nr_bvec = 0;
+	unsigned int i;
+	int ret;
+
+	merge = kmalloc(sizeof(*merge), GFP_NOIO);
+	if (!merge)
+		return false;
+
+	for (i = 0; i < nr; i++) {
+		rq_for_each_bvec(tmp, blk_mq_rq_from_pdu(cmds[i]), rq_iter)
+			nr_bvec++;
+	}
+	merge->bvec = kmalloc_array(nr_bvec, sizeof(struct bio_vec), GFP_NOIO);
+	if (!merge->bvec) {
+		kfree(merge);
+		return false;
+	}
+
+	bvec = merge->bvec;
+	for (i = 0; i < nr; i++) {
+		struct request *cur = blk_mq_rq_from_pdu(cmds[i]);
+
+		rq_for_each_bvec(tmp, cur, rq_iter)
+			*bvec++ = tmp;
+		bytes += blk_rq_bytes(cur);
+		merge->cmds[i] = cmds[i];
+	}
+	merge->nr = nr;
+	merge->ret = 0;
+	atomic_set(&merge->ref, 2);
+
+	iov_iter_bvec(&iter, rw, merge->bvec, nr_bvec, bytes);
+
+	merge->iocb.ki_pos = ((loff_t) blk_rq_pos(rq) << 9) + lo->lo_offset;
+	merge->iocb.ki_filp = file;
+	merge->iocb.ki_complete = lo_rw_aio_merge_complete;
+	merge->iocb.ki_flags = IOCB_DIRECT;
+	merge->iocb.ki_ioprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_NONE, 0);
+
+	if (rw == WRITE)
+		ret = call_write_iter(file, &merge->iocb, &iter);
+	else
+		ret = call_read_iter(file, &merge->iocb, &iter);
+
+	lo_rw_aio_merge_put(merge);
+
+	if (ret != -EIOCBQUEUED)
+		lo_rw_aio_merge_complete(&merge->iocb, ret, 0);
+	return true;
+}
+
 static int do_req_filebacked(struct loop_device *lo, struct request *rq)
 {
 	struct loop_cmd *cmd = blk_mq_rq_to_pdu(rq);
@@ -811,6 +960,17 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 	return error;
 }
 
+struct loop_worker {
+	struct rb_node rb_node;
+	struct work_struct work;
+	struct list_head cmd_list;
+	struct list_head idle_list;
+	struct loop_device *lo;
+	struct cgroup_subsys_state *blkcg_css;
+	unsigned long last_ran_at;
+	struct loop_worker_stats stats;
+};
+
 /* loop sysfs attributes */
 
 static ssize_t loop_attr_show(struct device *dev, char *page,
@@ -885,12 +1045,57 @@ static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", dio ? "1" : "0");
 }
 
+static ssize_t loop_worker_stats_show(struct loop_worker_stats *stats,
+				      char *buf, ssize_t len, u64 id,
+				      unsigned int idle_ms)
+{
+	return scnprintf(buf + len, PAGE_SIZE - len,
+			 "%llu %u %u %lu %lu %u\n", id, stats->depth,
+			 stats->max_depth, stats->cmds, stats->merged, idle_ms);
+}
+
+/*
+ * One line per worker: blkcg id (0 for the root one), commands queued,
+ * highest number of commands queued, commands handled, of which merged
+ * with the previous one, ms since the worker went idle (0 if busy).
+ * The last line counts the idle workers reaped.
+ */
+static ssize_t loop_attr_worker_stat_show(struct loop_device *lo, char *buf)
+{
+	struct loop_worker *worker;
+	struct rb_node *node;
+	ssize_t len;
+
+	spin_lock_irq(&lo->lo_work_lock);
+	len = loop_worker_stats_show(&lo->rootcg_stats, buf, 0, 0, 0);
+	for (node = rb_first(&lo->worker_tree); node; node = rb_next(node)) {
+		unsigned int idle_ms = 0;
+		u64 id = 0;
+
+		worker = rb_entry(node, struct loop_worker, rb_node);
+		if (!list_empty(&worker->idle_list))
+			idle_ms = jiffies_to_msecs(jiffies -
+						   worker->last_ran_at);
+#ifdef CONFIG_BLK_CGROUP
+		id = cgroup_id(worker->blkcg_css->cgroup);
+#endif
+		len += loop_worker_stats_show(&worker->stats, buf, len, id,
+					      idle_ms);
+	}
+	len += scnprintf(buf + len, PAGE_SIZE - len, "reaped %lu\n",
+			 lo->workers_reaped);
+	spin_unlock_irq(&lo->lo_work_lock);
+
+	return len;
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
 LOOP_ATTR_RO(dio);
+LOOP_ATTR_RO(worker_stat);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -899,6 +1104,7 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
 	&loop_attr_dio.attr,
+	&loop_attr_worker_stat.attr,
 	NULL,
 };
 
@@ -970,16 +1176,6 @@ static void loop_config_discard(struct loop_device *lo)
 	q->limits.discard_alignment = 0;
 }
 
-struct loop_worker {
-	struct rb_node rb_node;
-	struct work_struct work;
-	struct list_head cmd_list;
-	struct list_head idle_list;
-	struct loop_device *lo;
-	struct cgroup_subsys_state *blkcg_css;
-	unsigned long last_ran_at;
-};
-
 static void loop_workfn(struct work_struct *work);
 static void loop_rootcg_workfn(struct work_struct *work);
 static void loop_free_idle_workers(struct timer_list *timer);
@@ -1000,6 +1196,7 @@ static void loop_queue_work(struct loop_device *lo, struct loop_cmd *cmd)
 {
 	struct rb_node **node = &(lo->worker_tree.rb_node), *parent = NULL;
 	struct loop_worker *cur_worker, *worker = NULL;
+	struct loop_worker_stats *stats;
 	struct work_struct *work;
 	struct list_head *cmd_list;
 
@@ -1057,11 +1254,15 @@ static void loop_queue_work(struct loop_device *lo, struct loop_cmd *cmd)
 			list_del_init(&worker->idle_list);
 		work = &worker->work;
 		cmd_list = &worker->cmd_list;
+		stats = &worker->stats;
 	} else {
 		work = &lo->rootcg_work;
 		cmd_list = &lo->rootcg_cmd_list;
+		stats = &lo->rootcg_stats;
 	}
 	list_add_tail(&cmd->list_entry, cmd_list);
+	if (++stats->depth > stats->max_depth)
+		stats->max_depth = stats->depth;
 	queue_work(lo->workqueue, work);
 	spin_unlock_irq(&lo->lo_work_lock);
 }
@@ -1265,6 +1466,8 @@ static int loop_configure(struct loop_device *lo, fmode_t mode,
 	INIT_LIST_HEAD(&lo->rootcg_cmd_list);
 	INIT_LIST_HEAD(&lo->idle_worker_list);
 	lo->worker_tree = RB_ROOT;
+	memset(&lo->rootcg_stats, 0, sizeof(lo->rootcg_stats));
+	lo->workers_reaped = 0;
 	timer_setup(&lo->timer, loop_free_idle_workers,
 		TIMER_DEFERRABLE);
 	lo->use_dio = lo->lo_flags & LO_FLAGS_DIRECT_IO;
@@ -2224,11 +2427,49 @@ static void loop_set_timer(struct loop_device *lo)
 	timer_reduce(&lo->timer, jiffies + LOOP_IDLE_WORKER_TIMEOUT);
 }
 
+/* submit contiguous direct I/O commands with a single kiocb */
+static void loop_handle_merged(struct loop_device *lo, struct loop_cmd **cmds,
+			       unsigned int nr)
+{
+	struct loop_cmd *cmd = cmds[0];
+	struct mem_cgroup *old_memcg = NULL;
+	unsigned int i;
+	bool merged;
+
+	if (cmd->blkcg_css)
+		kthread_associate_blkcg(cmd->blkcg_css);
+	if (cmd->memcg_css)
+		old_memcg = set_active_memcg(
+			mem_cgroup_from_css(cmd->memcg_css));
+
+	merged = lo_rw_aio_merged(lo, cmds, nr);
+
+	if (cmd->blkcg_css)
+		kthread_associate_blkcg(NULL);
+	if (cmd->memcg_css)
+		set_active_memcg(old_memcg);
+
+	if (!merged) {
+		for (i = 0; i < nr; i++)
+			loop_handle_cmd(cmds[i]);
+		return;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (cmds[i]->memcg_css)
+			css_put(cmds[i]->memcg_css);
+	}
+}
+
 static void loop_process_work(struct loop_worker *worker,
 			struct list_head *cmd_list, struct loop_device *lo)
 {
+	struct loop_worker_stats *stats = worker ? &worker->stats :
+						   &lo->rootcg_stats;
+	struct loop_cmd *cmds[LOOP_MERGE_MAX_CMDS];
 	int orig_flags = current->flags;
 	struct loop_cmd *cmd;
+	unsigned int nr, bytes;
 
 	current->flags |= PF_LOCAL_THROTTLE | PF_MEMALLOC_NOIO;
 	spin_lock_irq(&lo->lo_work_lock);
@@ -2236,9 +2477,34 @@ static void loop_process_work(struct loop_worker *worker,
 		cmd = container_of(
 			cmd_list->next, struct loop_cmd, list_entry);
 		list_del(cmd_list->next);
+		cmds[0] = cmd;
+		nr = 1;
+
+		if (loop_cmd_mergeable(lo, cmd)) {
+			bytes = blk_rq_bytes(blk_mq_rq_from_pdu(cmd));
+			while (nr < LOOP_MERGE_MAX_CMDS &&
+			       !list_empty(cmd_list)) {
+				struct loop_cmd *next = container_of(
+					cmd_list->next, struct loop_cmd,
+					list_entry);
+
+				if (!loop_cmds_contiguous(lo, cmds[nr - 1],
+							  next, bytes))
+					break;
+				list_del(&next->list_entry);
+				bytes += blk_rq_bytes(blk_mq_rq_from_pdu(next));
+				cmds[nr++] = next;
+			}
+		}
+		stats->depth -= nr;
+		stats->cmds += nr;
+		stats->merged += nr - 1;
 		spin_unlock_irq(&lo->lo_work_lock);
 
-		loop_handle_cmd(cmd);
+		if (nr == 1)
+			loop_handle_cmd(cmd);
+		else
+			loop_handle_merged(lo, cmds, nr);
 		cond_resched();
 
 		spin_lock_irq(&lo->lo_work_lock);
@@ -2287,6 +2553,7 @@ static void loop_free_idle_workers(struct timer_list *timer)
 		rb_erase(&worker->rb_node, &lo->worker_tree);
 		css_put(worker->blkcg_css);
 		kfree(worker);
+		lo->workers_reaped++;
 	}
 	if (!list_empty(&lo->idle_worker_list))
 		loop_set_timer(lo);
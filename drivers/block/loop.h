@@ -26,6 +26,14 @@ enum {
 
 struct loop_func_table;
 
+/* per worker counters, protected by lo_work_lock */
+struct loop_worker_stats {
+	unsigned int	depth;		/* commands queued */
+	unsigned int	max_depth;
+	unsigned long	cmds;		/* commands handled */
+	unsigned long	merged;		/* of which merged with the previous one */
+};
+
 struct loop_device {
 	int		lo_number;
 	atomic_t	lo_refcnt;
@@ -61,6 +69,8 @@ struct loop_device {
 	struct list_head        idle_worker_list;
 	struct rb_root          worker_tree;
 	struct timer_list       timer;
+	struct loop_worker_stats rootcg_stats;
+	unsigned long		workers_reaped;
 	bool			use_dio;
 	bool			sysfs_inited;
 
@@ -60,6 +60,7 @@ struct nbd_sock {
 	bool dead;
 	int fallback_index;
 	int cookie;
+	atomic_t inflight;
 };
 
 struct recv_thread_args {
@@ -126,6 +127,7 @@ struct nbd_device {
 };
 
 #define NBD_CMD_REQUEUED	1
+#define NBD_CMD_INFLIGHT	2
 
 struct nbd_cmd {
 	struct nbd_device *nbd;
@@ -136,8 +138,17 @@ struct nbd_cmd {
 	blk_status_t status;
 	unsigned long flags;
 	u32 cmd_cookie;
+	/*
+	 * The request header lives in the pdu rather than on the stack, so
+	 * that it is page backed and can go out in the same bvec iterator
+	 * as the payload.
+	 */
+	struct nbd_request request;
 };
 
+/* bvecs handed to a single sendmsg, header included */
+#define NBD_SEND_BVECS		16
+
 #if IS_ENABLED(CONFIG_DEBUG_FS)
 static struct dentry *nbd_dbg_dir;
 #endif
@@ -173,6 +184,30 @@ static void nbd_requeue_cmd(struct nbd_cmd *cmd)
 		blk_mq_requeue_request(req, true);
 }
 
+static void nbd_cmd_set_inflight(struct nbd_sock *nsock, struct nbd_cmd *cmd)
+{
+	if (!test_and_set_bit(NBD_CMD_INFLIGHT, &cmd->flags))
+		atomic_inc(&nsock->inflight);
+}
+
+/*
+ * The counter of a socket is reset when it is reconnected, commands sent
+ * out before that (with an older cookie) must not be accounted anymore.
+ */
+static void nbd_cmd_clear_inflight(struct nbd_config *config,
+				   struct nbd_cmd *cmd)
+{
+	struct nbd_sock *nsock;
+
+	if (!test_and_clear_bit(NBD_CMD_INFLIGHT, &cmd->flags))
+		return;
+	if (cmd->index >= config->num_connections)
+		return;
+	nsock = config->socks[cmd->index];
+	if (cmd->cookie == READ_ONCE(nsock->cookie))
+		atomic_dec_if_positive(&nsock->inflight);
+}
+
 #define NBD_COOKIE_BITS 32
 
 static u64 nbd_cmd_handle(struct nbd_cmd *cmd)
@@ -434,6 +469,7 @@ static enum blk_eh_timer_return nbd_xmit_timeout(struct request *req,
 					nbd_mark_nsock_dead(nbd, nsock, 1);
 				mutex_unlock(&nsock->tx_lock);
 			}
+			nbd_cmd_clear_inflight(config, cmd);
 			mutex_unlock(&cmd->lock);
 			nbd_requeue_cmd(cmd);
 			nbd_config_put(nbd);
@@ -455,6 +491,7 @@ static enum blk_eh_timer_return nbd_xmit_timeout(struct request *req,
 
 		mutex_lock(&nsock->tx_lock);
 		if (cmd->cookie != nsock->cookie) {
+			nbd_cmd_clear_inflight(config, cmd);
 			nbd_requeue_cmd(cmd);
 			mutex_unlock(&nsock->tx_lock);
 			mutex_unlock(&cmd->lock);
@@ -470,6 +507,7 @@ static enum blk_eh_timer_return nbd_xmit_timeout(struct request *req,
 	dev_err_ratelimited(nbd_to_dev(nbd), "Connection timed out\n");
 	set_bit(NBD_RT_TIMEDOUT, &config->runtime_flags);
 	cmd->status = BLK_STS_IOERR;
+	nbd_cmd_clear_inflight(config, cmd);
 	mutex_unlock(&cmd->lock);
 	sock_shutdown(nbd);
 	nbd_config_put(nbd);
@@ -536,6 +574,70 @@ static inline int was_interrupted(int result)
 	return result == -ERESTARTSYS || result == -EINTR;
 }
 
+static int nbd_send_interrupted(struct nbd_sock *nsock, struct nbd_cmd *cmd,
+				int sent)
+{
+	/* If we haven't sent anything we can just return BUSY, however if we
+	 * have sent something we need to make sure we only allow this req to
+	 * be sent until we are completely done.
+	 */
+	if (sent) {
+		nsock->pending = blk_mq_rq_from_pdu(cmd);
+		nsock->sent = sent;
+	}
+	set_bit(NBD_CMD_REQUEUED, &cmd->flags);
+	return BLK_STS_RESOURCE;
+}
+
+/*
+ * Queue @bv_len bytes at @page + @offset for transmission, dropping whatever
+ * the previous partial send already put on the wire.  Returns true when
+ * the bvec array is full and has to be flushed.
+ */
+static bool nbd_add_bvec(struct bio_vec *bvecs, int *nr, unsigned int *len,
+			 int *skip, struct page *page, unsigned int bv_len,
+			 unsigned int offset)
+{
+	if (*skip >= bv_len) {
+		*skip -= bv_len;
+		return false;
+	}
+	offset += *skip;
+	bv_len -= *skip;
+	*skip = 0;
+
+	bvecs[*nr].bv_page = page;
+	bvecs[*nr].bv_offset = offset;
+	bvecs[*nr].bv_len = bv_len;
+	*len += bv_len;
+	return ++(*nr) == NBD_SEND_BVECS;
+}
+
+static int nbd_send_bvecs(struct nbd_device *nbd, struct nbd_cmd *cmd,
+			  int index, struct bio_vec *bvecs, int nr,
+			  unsigned int len, unsigned long total, int *sent)
+{
+	struct nbd_sock *nsock = nbd->config->socks[index];
+	struct request *req = blk_mq_rq_from_pdu(cmd);
+	struct iov_iter from;
+	int prev = *sent;
+	int result;
+
+	dev_dbg(nbd_to_dev(nbd), "request %p: sending %u bytes\n", req, len);
+	iov_iter_bvec(&from, WRITE, bvecs, nr, len);
+	result = sock_xmit(nbd, index, 1, &from,
+			   *sent + len < total ? MSG_MORE : 0, sent);
+	if (prev < sizeof(cmd->request) && *sent >= sizeof(cmd->request))
+		trace_nbd_header_sent(req, nbd_cmd_handle(cmd));
+	if (result > 0)
+		return 0;
+	if (was_interrupted(result))
+		return nbd_send_interrupted(nsock, cmd, *sent);
+	dev_err_ratelimited(disk_to_dev(nbd->disk),
+			    "Send failed (result %d)\n", result);
+	return -EAGAIN;
+}
+
 /* always call with the tx_lock held */
 static int nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd, int index)
 {
@@ -543,17 +645,19 @@ static int nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd, int index)
 	struct nbd_config *config = nbd->config;
 	struct nbd_sock *nsock = config->socks[index];
 	int result;
-	struct nbd_request request = {.magic = htonl(NBD_REQUEST_MAGIC)};
-	struct kvec iov = {.iov_base = &request, .iov_len = sizeof(request)};
-	struct iov_iter from;
+	struct nbd_request *request = &cmd->request;
+	struct bio_vec bvecs[NBD_SEND_BVECS];
 	unsigned long size = blk_rq_bytes(req);
-	struct bio *bio;
+	unsigned long total = sizeof(*request);
+	unsigned long queued = 0;
+	unsigned int len = 0;
+	struct req_iterator iter;
+	struct bio_vec bvec;
 	u64 handle;
 	u32 type;
 	u32 nbd_cmd_flags = 0;
 	int sent = nsock->sent, skip = 0;
-
-	iov_iter_kvec(&from, WRITE, &iov, 1, sizeof(request));
+	int nr = 0;
 
 	type = req_to_nbd_cmd_type(req);
 	if (type == U32_MAX)
@@ -569,112 +673,81 @@ static int nbd_send_cmd(struct nbd_device *nbd, struct nbd_cmd *cmd, int index)
 	if (req->cmd_flags & REQ_FUA)
 		nbd_cmd_flags |= NBD_CMD_FLAG_FUA;
 
-	/* We did a partial send previously, and we at least sent the whole
-	 * request struct, so just go and send the rest of the pages in the
-	 * request.
+	if (type == NBD_CMD_WRITE)
+		total += size;
+
+	/* We did a partial send previously, the header is still in the pdu,
+	 * so just go and send whatever is left of the request.
 	 */
 	if (sent) {
-		if (sent >= sizeof(request)) {
-			skip = sent - sizeof(request);
-
-			/* initialize handle for tracing purposes */
-			handle = nbd_cmd_handle(cmd);
-
-			goto send_pages;
-		}
-		iov_iter_advance(&from, sent);
-	} else {
-		cmd->cmd_cookie++;
+		skip = sent;
+		handle = nbd_cmd_handle(cmd);
+		goto send;
 	}
+
+	cmd->cmd_cookie++;
 	cmd->index = index;
 	cmd->cookie = nsock->cookie;
 	cmd->retries = 0;
-	request.type = htonl(type | nbd_cmd_flags);
+	memset(request, 0, sizeof(*request));
+	request->magic = htonl(NBD_REQUEST_MAGIC);
+	request->type = htonl(type | nbd_cmd_flags);
 	if (type != NBD_CMD_FLUSH) {
-		request.from = cpu_to_be64((u64)blk_rq_pos(req) << 9);
-		request.len = htonl(size);
+		request->from = cpu_to_be64((u64)blk_rq_pos(req) << 9);
+		request->len = htonl(size);
 	}
 	handle = nbd_cmd_handle(cmd);
-	memcpy(request.handle, &handle, sizeof(handle));
+	memcpy(request->handle, &handle, sizeof(handle));
 
-	trace_nbd_send_request(&request, nbd->index, blk_mq_rq_from_pdu(cmd));
+	trace_nbd_send_request(request, nbd->index, blk_mq_rq_from_pdu(cmd));
 
 	dev_dbg(nbd_to_dev(nbd), "request %p: sending control (%s@%llu,%uB)\n",
 		req, nbdcmd_to_ascii(type),
 		(unsigned long long)blk_rq_pos(req) << 9, blk_rq_bytes(req));
-	result = sock_xmit(nbd, index, 1, &from,
-			(type == NBD_CMD_WRITE) ? MSG_MORE : 0, &sent);
-	trace_nbd_header_sent(req, handle);
-	if (result <= 0) {
-		if (was_interrupted(result)) {
-			/* If we havne't sent anything we can just return BUSY,
-			 * however if we have sent something we need to make
-			 * sure we only allow this req to be sent until we are
-			 * completely done.
-			 */
-			if (sent) {
-				nsock->pending = req;
-				nsock->sent = sent;
-			}
-			set_bit(NBD_CMD_REQUEUED, &cmd->flags);
-			return BLK_STS_RESOURCE;
-		}
-		dev_err_ratelimited(disk_to_dev(nbd->disk),
-			"Send control failed (result %d)\n", result);
-		return -EAGAIN;
-	}
-send_pages:
-	if (type != NBD_CMD_WRITE)
-		goto out;
+send:
+	/*
+	 * The reply may come in as soon as the last byte is out, account
+	 * the command before that happens.
+	 */
+	nbd_cmd_set_inflight(nsock, cmd);
 
-	bio = req->bio;
-	while (bio) {
-		struct bio *next = bio->bi_next;
-		struct bvec_iter iter;
-		struct bio_vec bvec;
+	/*
+	 * Header and payload go out together, up to NBD_SEND_BVECS segments
+	 * per sendmsg, so that a small write costs a single trip into the
+	 * socket layer.  Every chunk but the last one carries MSG_MORE.
+	 */
+	nbd_add_bvec(bvecs, &nr, &len, &skip, virt_to_page(request),
+		     sizeof(*request), offset_in_page(request));
+	if (type != NBD_CMD_WRITE) {
+		result = nbd_send_bvecs(nbd, cmd, index, bvecs, nr, len, total,
+					&sent);
+		if (result)
+			return result;
+		goto out;
+	}
 
-		bio_for_each_segment(bvec, bio, iter) {
-			bool is_last = !next && bio_iter_last(bvec, iter);
-			int flags = is_last ? 0 : MSG_MORE;
+	rq_for_each_segment(bvec, req, iter) {
+		queued += bvec.bv_len;
+		if (!nbd_add_bvec(bvecs, &nr, &len, &skip, bvec.bv_page,
+				  bvec.bv_len, bvec.bv_offset) &&
+		    queued < size)
+			continue;
+		if (!nr)
+			continue;
 
-			dev_dbg(nbd_to_dev(nbd), "request %p: sending %d bytes data\n",
-				req, bvec.bv_len);
-			iov_iter_bvec(&from, WRITE, &bvec, 1, bvec.bv_len);
-			if (skip) {
-				if (skip >= iov_iter_count(&from)) {
-					skip -= iov_iter_count(&from);
-					continue;
-				}
-				iov_iter_advance(&from, skip);
-				skip = 0;
-			}
-			result = sock_xmit(nbd, index, 1, &from, flags, &sent);
-			if (result <= 0) {
-				if (was_interrupted(result)) {
-					/* We've already sent the header, we
-					 * have no choice but to set pending and
-					 * return BUSY.
-					 */
-					nsock->pending = req;
-					nsock->sent = sent;
-					set_bit(NBD_CMD_REQUEUED, &cmd->flags);
-					return BLK_STS_RESOURCE;
-				}
-				dev_err(disk_to_dev(nbd->disk),
-					"Send data failed (result %d)\n",
-					result);
-				return -EAGAIN;
-			}
-			/*
-			 * The completion might already have come in,
-			 * so break for the last one instead of letting
-			 * the iterator do it. This prevents use-after-free
-			 * of the bio.
-			 */
-			if (is_last)
-				break;
-		}
-		bio = next;
+		result = nbd_send_bvecs(nbd, cmd, index, bvecs, nr, len, total,
+					&sent);
+		if (result)
+			return result;
+		nr = 0;
+		len = 0;
+		/*
+		 * The completion might already have come in, so stop here
+		 * instead of letting the iterator walk the bios once more.
+		 * This prevents use-after-free of the bio.
+		 */
+		if (sent >= total)
+			break;
 	}
 out:
 	trace_nbd_payload_sent(req, handle);
@@ -809,6 +882,7 @@ static void recv_work(struct work_struct *work)
 			break;
 		}
 
+		nbd_cmd_clear_inflight(config, cmd);
 		rq = blk_mq_rq_from_pdu(cmd);
 		if (likely(!blk_should_fake_timeout(rq->q)))
 			blk_mq_complete_request(rq);
@@ -829,6 +903,7 @@ static bool nbd_clear_req(struct request *req, void *data, bool reserved)
 
 	mutex_lock(&cmd->lock);
 	cmd->status = BLK_STS_IOERR;
+	nbd_cmd_clear_inflight(cmd->nbd->config, cmd);
 	mutex_unlock(&cmd->lock);
 
 	blk_mq_complete_request(req);
@@ -898,6 +973,40 @@ static int wait_for_reconnect(struct nbd_device *nbd)
 				  config->dead_conn_timeout) > 0;
 }
 
+/*
+ * Steer @cmd to the live connection with the fewest commands in flight,
+ * the one of the hw queue winning ties.  A command that was partially
+ * sent has to go back to the connection it started on.  The lookup is
+ * lockless, nbd_handle_cmd() rechecks the socket under its tx_lock.
+ */
+static int nbd_pick_sock(struct nbd_config *config, struct nbd_cmd *cmd,
+			 int index)
+{
+	struct request *req = blk_mq_rq_from_pdu(cmd);
+	int i, best = index, best_load = INT_MAX;
+
+	if (config->num_connections <= 1)
+		return index;
+
+	if (cmd->index >= 0 && cmd->index < config->num_connections &&
+	    READ_ONCE(config->socks[cmd->index]->pending) == req)
+		return cmd->index;
+
+	for (i = 0; i < config->num_connections; i++) {
+		struct nbd_sock *nsock = config->socks[i];
+		int load;
+
+		if (READ_ONCE(nsock->dead) || READ_ONCE(nsock->pending))
+			continue;
+		load = atomic_read(&nsock->inflight);
+		if (load < best_load || (load == best_load && i == index)) {
+			best = i;
+			best_load = load;
+		}
+	}
+	return best;
+}
+
 static int nbd_handle_cmd(struct nbd_cmd *cmd, int index)
 {
 	struct request *req = blk_mq_rq_from_pdu(cmd);
@@ -921,6 +1030,7 @@ static int nbd_handle_cmd(struct nbd_cmd *cmd, int index)
 		blk_mq_start_request(req);
 		return -EINVAL;
 	}
+	index = nbd_pick_sock(config, cmd, index);
 	cmd->status = BLK_STS_OK;
 again:
 	nsock = config->socks[index];
@@ -964,6 +1074,8 @@ static int nbd_handle_cmd(struct nbd_cmd *cmd, int index)
 	 * returns EAGAIN can be retried on a different socket.
 	 */
 	ret = nbd_send_cmd(nbd, cmd, index);
+	if (ret && nsock->pending != req)
+		nbd_cmd_clear_inflight(config, cmd);
 	if (ret == -EAGAIN) {
 		dev_err_ratelimited(disk_to_dev(nbd->disk),
 				    "Request send failed, requeueing\n");
@@ -1085,6 +1197,7 @@ static int nbd_add_socket(struct nbd_device *nbd, unsigned long arg,
 	nsock->pending = NULL;
 	nsock->sent = 0;
 	nsock->cookie = 0;
+	atomic_set(&nsock->inflight, 0);
 	socks[config->num_connections++] = nsock;
 	atomic_inc(&config->live_connections);
 	blk_mq_unfreeze_queue(nbd->disk->queue);
@@ -1097,6 +1210,54 @@ static int nbd_add_socket(struct nbd_device *nbd, unsigned long arg,
 	return err;
 }
 
+struct nbd_requeue_args {
+	struct nbd_config *config;
+	int index;
+	int requeued;
+};
+
+static bool nbd_requeue_stale_req(struct request *req, void *data,
+				  bool reserved)
+{
+	struct nbd_cmd *cmd = blk_mq_rq_to_pdu(req);
+	struct nbd_requeue_args *args = data;
+	struct nbd_sock *nsock = args->config->socks[args->index];
+
+	if (blk_mq_request_completed(req))
+		return true;
+	/* busy commands are being sent or timed out, leave them alone */
+	if (!mutex_trylock(&cmd->lock))
+		return true;
+	if (cmd->index == args->index && cmd->cookie != nsock->cookie &&
+	    cmd->status == BLK_STS_OK &&
+	    !test_bit(NBD_CMD_REQUEUED, &cmd->flags)) {
+		clear_bit(NBD_CMD_INFLIGHT, &cmd->flags);
+		nbd_requeue_cmd(cmd);
+		args->requeued++;
+	}
+	mutex_unlock(&cmd->lock);
+	return true;
+}
+
+/*
+ * Replies for the commands sent over the socket that was replaced will
+ * never come in.  Requeue them right away instead of waiting for
+ * nbd_xmit_timeout(), the submit path spreads them over the live
+ * connections, the new one included.
+ */
+static void nbd_requeue_stale(struct nbd_device *nbd, int index)
+{
+	struct nbd_requeue_args args = {
+		.config = nbd->config,
+		.index = index,
+	};
+
+	blk_mq_tagset_busy_iter(&nbd->tag_set, nbd_requeue_stale_req, &args);
+	if (args.requeued)
+		dev_dbg(nbd_to_dev(nbd), "requeued %d commands of connection %d\n",
+			args.requeued, index);
+}
+
 static int nbd_reconnect_socket(struct nbd_device *nbd, unsigned long arg)
 {
 	struct nbd_config *config = nbd->config;
@@ -1139,6 +1300,7 @@ static int nbd_reconnect_socket(struct nbd_device *nbd, unsigned long arg)
 		args->index = i;
 		args->nbd = nbd;
 		nsock->cookie++;
+		atomic_set(&nsock->inflight, 0);
 		mutex_unlock(&nsock->tx_lock);
 		sockfd_put(old);
 
@@ -1151,6 +1313,7 @@ static int nbd_reconnect_socket(struct nbd_device *nbd, unsigned long arg)
 
 		atomic_inc(&config->live_connections);
 		wake_up(&config->conn_wait);
+		nbd_requeue_stale(nbd, i);
 		return 0;
 	}
 	sockfd_put(sock);
@@ -1660,6 +1823,7 @@ static int nbd_init_request(struct blk_mq_tag_set *set, struct request *rq,
 {
 	struct nbd_cmd *cmd = blk_mq_rq_to_pdu(rq);
 	cmd->nbd = set->driver_data;
+	cmd->index = -1;
 	cmd->flags = 0;
 	mutex_init(&cmd->lock);
 	return 0;
@@ -344,6 +344,23 @@ static int nullb_apply_submit_queues(struct nullb_device *dev,
 	return set->nr_hw_queues == submit_queues ? 0 : -ENOMEM;
 }
 
+/*
+ * Latency shaping may be retuned while the device is up: there is nothing
+ * to apply, null_cmd_latency() reads these values on every command.  The
+ * callbacks only make NULLB_DEVICE_ATTR accept writes to a powered device.
+ */
+static int nullb_apply_latency_ulong(struct nullb_device *dev,
+				     unsigned long val)
+{
+	return 0;
+}
+
+static int nullb_apply_latency_uint(struct nullb_device *dev,
+				    unsigned int val)
+{
+	return 0;
+}
+
 NULLB_DEVICE_ATTR(size, ulong, NULL);
 NULLB_DEVICE_ATTR(completion_nsec, ulong, NULL);
 NULLB_DEVICE_ATTR(submit_queues, uint, nullb_apply_submit_queues);
@@ -367,6 +384,10 @@ NULLB_DEVICE_ATTR(zone_nr_conv, uint, NULL);
 NULLB_DEVICE_ATTR(zone_max_open, uint, NULL);
 NULLB_DEVICE_ATTR(zone_max_active, uint, NULL);
 NULLB_DEVICE_ATTR(virt_boundary, bool, NULL);
+NULLB_DEVICE_ATTR(qd_nsec, ulong, nullb_apply_latency_ulong);
+NULLB_DEVICE_ATTR(stall_interval_ms, uint, nullb_apply_latency_uint);
+NULLB_DEVICE_ATTR(stall_duration_ms, uint, nullb_apply_latency_uint);
+NULLB_DEVICE_ATTR(zone_write_mbps, uint, nullb_apply_latency_uint);
 
 static ssize_t nullb_device_power_show(struct config_item *item, char *page)
 {
@@ -462,6 +483,161 @@ static ssize_t nullb_device_badblocks_store(struct config_item *item,
 }
 CONFIGFS_ATTR(nullb_device_, badblocks);
 
+static ssize_t nullb_lat_profile_show(struct nullb_device *dev, int dir,
+				      char *page)
+{
+	struct nullb_lat_profile *prof;
+	ssize_t len = 0;
+	unsigned int i;
+
+	rcu_read_lock();
+	prof = rcu_dereference(dev->lat_profile[dir]);
+	for (i = 0; prof && i < prof->nr_points; i++)
+		len += scnprintf(page + len, PAGE_SIZE - len, "%s%u.%02u:%llu",
+				 i ? " " : "", prof->points[i].pct / 100,
+				 prof->points[i].pct % 100,
+				 prof->points[i].nsec);
+	rcu_read_unlock();
+	len += scnprintf(page + len, PAGE_SIZE - len, "\n");
+	return len;
+}
+
+/* "99", "99.9" or "99.99", in hundredths of a percent */
+static int nullb_parse_pct(char *str, unsigned int *pct)
+{
+	char *frac = strchr(str, '.');
+	unsigned int ip, fp = 0;
+	int ret;
+
+	if (frac) {
+		size_t n;
+
+		*frac++ = '\0';
+		n = strlen(frac);
+		if (!n || n > 2)
+			return -EINVAL;
+		ret = kstrtouint(frac, 10, &fp);
+		if (ret)
+			return ret;
+		if (n == 1)
+			fp *= 10;
+	}
+	ret = kstrtouint(str, 10, &ip);
+	if (ret)
+		return ret;
+	if (ip > 100)
+		return -EINVAL;
+	*pct = ip * 100 + fp;
+	return *pct > 10000 ? -EINVAL : 0;
+}
+
+/*
+ * The profile is a list of "<percentile>:<nsec>" points, e.g.
+ * "50:20000 99:200000 99.99:5000000 100:20000000", with increasing
+ * percentiles and latencies, the last one for the 100th percentile.
+ * An empty string goes back to completion_nsec.
+ */
+static ssize_t nullb_lat_profile_store(struct nullb_device *dev, int dir,
+				       const char *page, size_t count)
+{
+	struct nullb_lat_profile *prof = NULL, *old;
+	char *orig, *buf, *tok;
+	int ret = -EINVAL;
+
+	orig = kstrndup(page, count, GFP_KERNEL);
+	if (!orig)
+		return -ENOMEM;
+	buf = strstrip(orig);
+
+	if (*buf) {
+		prof = kzalloc(sizeof(*prof), GFP_KERNEL);
+		if (!prof) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	while (prof && (tok = strsep(&buf, " \t,")) != NULL) {
+		unsigned int n = prof->nr_points;
+		char *nsec;
+
+		if (!*tok)
+			continue;
+		if (n == NULLB_LAT_MAX_POINTS)
+			goto out;
+		nsec = strchr(tok, ':');
+		if (!nsec)
+			goto out;
+		*nsec++ = '\0';
+		if (nullb_parse_pct(tok, &prof->points[n].pct) ||
+		    kstrtou64(nsec, 0, &prof->points[n].nsec))
+			goto out;
+		if (n && (prof->points[n].pct <= prof->points[n - 1].pct ||
+			  prof->points[n].nsec < prof->points[n - 1].nsec))
+			goto out;
+		prof->nr_points++;
+	}
+	if (prof && (!prof->nr_points ||
+		     prof->points[prof->nr_points - 1].pct != 10000))
+		goto out;
+
+	mutex_lock(&lock);
+	old = rcu_replace_pointer(dev->lat_profile[dir], prof,
+				  lockdep_is_held(&lock));
+	mutex_unlock(&lock);
+	if (old)
+		kfree_rcu(old, rcu);
+	prof = NULL;
+	ret = count;
+out:
+	kfree(prof);
+	kfree(orig);
+	return ret;
+}
+
+static ssize_t nullb_device_read_latency_show(struct config_item *item,
+					      char *page)
+{
+	return nullb_lat_profile_show(to_nullb_device(item), READ, page);
+}
+
+static ssize_t nullb_device_read_latency_store(struct config_item *item,
+					       const char *page, size_t count)
+{
+	return nullb_lat_profile_store(to_nullb_device(item), READ, page,
+				       count);
+}
+CONFIGFS_ATTR(nullb_device_, read_latency);
+
+static ssize_t nullb_device_write_latency_show(struct config_item *item,
+					       char *page)
+{
+	return nullb_lat_profile_show(to_nullb_device(item), WRITE, page);
+}
+
+static ssize_t nullb_device_write_latency_store(struct config_item *item,
+						const char *page, size_t count)
+{
+	return nullb_lat_profile_store(to_nullb_device(item), WRITE, page,
+				       count);
+}
+CONFIGFS_ATTR(nullb_device_, write_latency);
+
+/* reads, read latency (ns), writes, write latency (ns), stalled commands */
+static ssize_t nullb_device_latency_stat_show(struct config_item *item,
+					      char *page)
+{
+	struct nullb_device *dev = to_nullb_device(item);
+
+	return snprintf(page, PAGE_SIZE, "%8llu %12llu %8llu %12llu %8llu\n",
+			(u64)atomic64_read(&dev->lat_ios[READ]),
+			(u64)atomic64_read(&dev->lat_nsec[READ]),
+			(u64)atomic64_read(&dev->lat_ios[WRITE]),
+			(u64)atomic64_read(&dev->lat_nsec[WRITE]),
+			(u64)atomic64_read(&dev->lat_stalled));
+}
+CONFIGFS_ATTR_RO(nullb_device_, latency_stat);
+
 static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_size,
 	&nullb_device_attr_completion_nsec,
@@ -488,6 +664,13 @@ static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_zone_max_open,
 	&nullb_device_attr_zone_max_active,
 	&nullb_device_attr_virt_boundary,
+	&nullb_device_attr_read_latency,
+	&nullb_device_attr_write_latency,
+	&nullb_device_attr_qd_nsec,
+	&nullb_device_attr_stall_interval_ms,
+	&nullb_device_attr_stall_duration_ms,
+	&nullb_device_attr_zone_write_mbps,
+	&nullb_device_attr_latency_stat,
 	NULL,
 };
 
@@ -541,7 +724,7 @@ nullb_group_drop_item(struct config_group *group, struct config_item *item)
 static ssize_t memb_group_features_show(struct config_item *item, char *page)
 {
 	return snprintf(page, PAGE_SIZE,
-			"memory_backed,discard,bandwidth,cache,badblocks,zoned,zone_size,zone_capacity,zone_nr_conv,zone_max_open,zone_max_active,blocksize,max_sectors,virt_boundary\n");
+			"memory_backed,discard,bandwidth,cache,badblocks,zoned,zone_size,zone_capacity,zone_nr_conv,zone_max_open,zone_max_active,blocksize,max_sectors,virt_boundary,latency_profile,stall,zone_write_mbps\n");
 }
 
 CONFIGFS_ATTR_RO(memb_group_, features);
@@ -618,6 +801,8 @@ static void null_free_dev(struct nullb_device *dev)
 
 	null_free_zoned_dev(dev);
 	badblocks_exit(&dev->badblocks);
+	kfree(rcu_access_pointer(dev->lat_profile[READ]));
+	kfree(rcu_access_pointer(dev->lat_profile[WRITE]));
 	kfree(dev);
 }
 
@@ -712,14 +897,91 @@ static void end_cmd(struct nullb_cmd *cmd)
 
 static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
 {
-	end_cmd(container_of(timer, struct nullb_cmd, timer));
+	struct nullb_cmd *cmd = container_of(timer, struct nullb_cmd, timer);
+
+	atomic_dec(&cmd->nq->dev->nullb->lat_inflight);
+	end_cmd(cmd);
 
 	return HRTIMER_NORESTART;
 }
 
+static u64 null_lat_sample(struct nullb_lat_profile *prof)
+{
+	u32 r = prandom_u32_max(10000);
+	unsigned int i;
+	u64 lo, hi;
+
+	for (i = 0; i < prof->nr_points - 1; i++)
+		if (r < prof->points[i].pct)
+			break;
+	if (!i)
+		return prof->points[0].nsec;
+
+	lo = prof->points[i - 1].nsec;
+	hi = prof->points[i].nsec;
+	return lo + div_u64((hi - lo) * (r - prof->points[i - 1].pct),
+			    prof->points[i].pct - prof->points[i - 1].pct);
+}
+
+/*
+ * Service time of a command: sampled from the profile of its direction,
+ * or completion_nsec, plus qd_nsec for every other command in flight.
+ * Writes to a sequential zone are further delayed by the zone_write_mbps
+ * bandwidth of their zone.  Commands due within a stall window complete
+ * when the window closes.
+ */
+static u64 null_cmd_latency(struct nullb_cmd *cmd, unsigned int inflight)
+{
+	struct nullb_device *dev = cmd->nq->dev;
+	struct nullb_lat_profile *prof;
+	u64 nsec = dev->completion_nsec;
+	unsigned int interval = READ_ONCE(dev->stall_interval_ms);
+	unsigned int duration = READ_ONCE(dev->stall_duration_ms);
+	unsigned int bytes;
+	sector_t sector;
+	int dir;
+
+	if (dev->queue_mode == NULL_Q_BIO) {
+		dir = op_is_write(bio_op(cmd->bio)) ? WRITE : READ;
+		sector = cmd->bio->bi_iter.bi_sector;
+		bytes = cmd->bio->bi_iter.bi_size;
+	} else {
+		dir = op_is_write(req_op(cmd->rq)) ? WRITE : READ;
+		sector = blk_rq_pos(cmd->rq);
+		bytes = blk_rq_bytes(cmd->rq);
+	}
+
+	rcu_read_lock();
+	prof = rcu_dereference(dev->lat_profile[dir]);
+	if (prof)
+		nsec = null_lat_sample(prof);
+	rcu_read_unlock();
+
+	nsec += (u64)READ_ONCE(dev->qd_nsec) * inflight;
+	if (dir == WRITE && dev->zoned)
+		nsec += null_zone_write_nsec(dev, sector, bytes);
+
+	if (interval && duration && duration < interval) {
+		u64 due = ktime_get_ns() + nsec;
+		u64 phase;
+
+		div64_u64_rem(due, (u64)interval * NSEC_PER_MSEC, &phase);
+		if (phase < (u64)duration * NSEC_PER_MSEC) {
+			nsec += (u64)duration * NSEC_PER_MSEC - phase;
+			atomic64_inc(&dev->lat_stalled);
+		}
+	}
+
+	atomic64_inc(&dev->lat_ios[dir]);
+	atomic64_add(nsec, &dev->lat_nsec[dir]);
+	return nsec;
+}
+
 static void null_cmd_end_timer(struct nullb_cmd *cmd)
 {
-	ktime_t kt = cmd->nq->dev->completion_nsec;
+	struct nullb *nullb = cmd->nq->dev->nullb;
+	unsigned int inflight = atomic_inc_return(&nullb->lat_inflight) - 1;
+	ktime_t kt = null_cmd_latency(cmd, inflight);
 
 	hrtimer_start(&cmd->timer, kt, HRTIMER_MODE_REL);
 }
@@ -14,6 +14,7 @@
 #include <linux/fault-inject.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rcupdate.h>
 
 struct nullb_cmd {
 	struct request *rq;
@@ -53,6 +54,23 @@ struct nullb_zone {
 	sector_t wp;
 	unsigned int len;
 	unsigned int capacity;
+	atomic64_t wr_busy_ns;	/* zone_write_mbps: end of the queued writes */
+};
+
+#define NULLB_LAT_MAX_POINTS	16
+
+/*
+ * Completion latency distribution, given as points of its cumulative
+ * distribution function: a fraction pct / 10000 of the commands completes
+ * within nsec.  Latencies between two points are interpolated linearly.
+ */
+struct nullb_lat_profile {
+	struct rcu_head rcu;
+	unsigned int nr_points;
+	struct {
+		unsigned int pct;	/* in hundredths of a percent */
+		u64 nsec;
+	} points[NULLB_LAT_MAX_POINTS];
 };
 
 struct nullb_device {
@@ -74,6 +92,12 @@ struct nullb_device {
 	bool need_zone_res_mgmt;
 	spinlock_t zone_res_lock;
 
+	/* latency profiles for reads and writes, irqmode=2 only */
+	struct nullb_lat_profile __rcu *lat_profile[2];
+	atomic64_t lat_ios[2];
+	atomic64_t lat_nsec[2];
+	atomic64_t lat_stalled;
+
 	unsigned long size; /* device size in MB */
 	unsigned long completion_nsec; /* time in ns to complete a request */
 	unsigned long cache_size; /* disk cache size in MB */
@@ -91,6 +115,10 @@ struct nullb_device {
 	unsigned int hw_queue_depth; /* queue depth */
 	unsigned int index; /* index of the disk, only valid with a disk */
 	unsigned int mbps; /* Bandwidth throttle cap (in MB/s) */
+	unsigned long qd_nsec; /* extra latency per command in flight */
+	unsigned int stall_interval_ms; /* period of the injected stalls */
+	unsigned int stall_duration_ms; /* length of the injected stalls */
+	unsigned int zone_write_mbps; /* write bandwidth of each zone (in MB/s) */
 	bool blocking; /* blocking blk-mq device */
 	bool use_per_node_hctx; /* use per-node allocation for hardware context */
 	bool power; /* power on/off the device */
@@ -111,6 +139,7 @@ struct nullb {
 	unsigned int queue_depth;
 	atomic_long_t cur_bytes;
 	struct hrtimer bw_timer;
+	atomic_t lat_inflight;
 	unsigned long cache_flush_pos;
 	spinlock_t lock;
 
@@ -136,6 +165,8 @@ blk_status_t null_process_zoned_cmd(struct nullb_cmd *cmd,
 				    sector_t nr_sectors);
 size_t null_zone_valid_read_len(struct nullb *nullb,
 				sector_t sector, unsigned int len);
+u64 null_zone_write_nsec(struct nullb_device *dev, sector_t sector,
+			 unsigned int bytes);
 #else
 static inline int null_init_zoned_dev(struct nullb_device *dev,
 				      struct request_queue *q)
@@ -159,6 +190,11 @@ static inline size_t null_zone_valid_read_len(struct nullb *nullb,
 {
 	return len;
 }
+static inline u64 null_zone_write_nsec(struct nullb_device *dev,
+				       sector_t sector, unsigned int bytes)
+{
+	return 0;
+}
 #define null_report_zones	NULL
 #endif /* CONFIG_BLK_DEV_ZONED */
 #endif /* __NULL_BLK_H */
@@ -55,6 +55,36 @@ static inline void null_unlock_zone(struct nullb_device *dev,
 		mutex_unlock(&zone->mutex);
 }
 
+/*
+ * With zone_write_mbps set, the writes to a sequential zone are served one
+ * after the other at that bandwidth, independently of the other zones.
+ * Returns how long from now the write of @bytes at @sector completes.
+ */
+u64 null_zone_write_nsec(struct nullb_device *dev, sector_t sector,
+			 unsigned int bytes)
+{
+	unsigned int mbps = READ_ONCE(dev->zone_write_mbps);
+	unsigned int zno = null_zone_no(dev, sector);
+	struct nullb_zone *zone;
+	s64 now, busy, end;
+
+	if (!mbps || !bytes || zno >= dev->nr_zones)
+		return 0;
+
+	zone = &dev->zones[zno];
+	if (zone->type == BLK_ZONE_TYPE_CONVENTIONAL)
+		return 0;
+
+	now = ktime_get_ns();
+	busy = atomic64_read(&zone->wr_busy_ns);
+	do {
+		end = max(busy, now) +
+			div_u64((u64)bytes * NSEC_PER_SEC, (u64)mbps * SZ_1M);
+	} while (!atomic64_try_cmpxchg(&zone->wr_busy_ns, &busy, end));
+
+	return end - now;
+}
+
 int null_init_zoned_dev(struct nullb_device *dev, struct request_queue *q)
 {
 	sector_t dev_capacity_sects, zone_capacity_sects;
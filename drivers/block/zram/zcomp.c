@@ -79,8 +79,8 @@ bool zcomp_available_algorithm(const char *comp)
 	return crypto_has_comp(comp, 0, 0) == 1;
 }
 
-/* show available compressors */
-ssize_t zcomp_available_show(const char *comp, char *buf)
+/* show available compressors, appending to the @at bytes already in @buf */
+ssize_t zcomp_available_show(const char *comp, char *buf, ssize_t at)
 {
 	bool known_algorithm = false;
 	ssize_t sz = 0;
@@ -89,10 +89,10 @@ ssize_t zcomp_available_show(const char *comp, char *buf)
 	for (i = 0; i < ARRAY_SIZE(backends); i++) {
 		if (!strcmp(comp, backends[i])) {
 			known_algorithm = true;
-			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+			sz += scnprintf(buf + at + sz, PAGE_SIZE - at - sz - 2,
 					"[%s] ", backends[i]);
 		} else {
-			sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+			sz += scnprintf(buf + at + sz, PAGE_SIZE - at - sz - 2,
 					"%s ", backends[i]);
 		}
 	}
@@ -102,10 +102,10 @@ ssize_t zcomp_available_show(const char *comp, char *buf)
 	 * entry in `backends'.
 	 */
 	if (!known_algorithm && crypto_has_comp(comp, 0, 0) == 1)
-		sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2,
+		sz += scnprintf(buf + at + sz, PAGE_SIZE - at - sz - 2,
 				"[%s] ", comp);
 
-	sz += scnprintf(buf + sz, PAGE_SIZE - sz, "\n");
+	sz += scnprintf(buf + at + sz, PAGE_SIZE - at - sz, "\n");
 	return sz;
 }
 
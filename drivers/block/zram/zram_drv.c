@@ -138,6 +138,22 @@ static void zram_set_obj_size(struct zram *zram,
 	zram->table[index].flags = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+static u32 zram_get_priority(struct zram *zram, u32 index)
+{
+	u32 prio = zram->table[index].flags >> ZRAM_COMP_PRIORITY_BIT1;
+
+	return prio & ZRAM_COMP_PRIORITY_MASK;
+}
+
+static void zram_set_priority(struct zram *zram, u32 index, u32 prio)
+{
+	prio &= ZRAM_COMP_PRIORITY_MASK;
+	zram->table[index].flags &= ~((unsigned long)ZRAM_COMP_PRIORITY_MASK <<
+				      ZRAM_COMP_PRIORITY_BIT1);
+	zram->table[index].flags |= (unsigned long)prio <<
+				    ZRAM_COMP_PRIORITY_BIT1;
+}
+
 static inline bool zram_allocated(struct zram *zram, u32 index)
 {
 	return zram_get_obj_size(zram, index) ||
@@ -617,18 +633,333 @@ static int read_from_bdev_async(struct zram *zram, struct bio_vec *bvec,
 #define IDLE_WRITEBACK 2
 
 
+/*
+ * Writeback gathers up to ZRAM_WB_BATCH slots going to consecutive blocks
+ * of the backing device in a single bio, and keeps up to ZRAM_WB_INFLIGHT
+ * such bios in flight.
+ */
+#define ZRAM_WB_BATCH		32
+#define ZRAM_WB_INFLIGHT	4
+
+struct zram_wb_ctl;
+
+struct zram_wb_req {
+	struct list_head entry;
+	struct zram_wb_ctl *ctl;
+	struct bio *bio;
+	unsigned long blk_idx;		/* block of the first slot */
+	unsigned int nr;		/* slots in the batch */
+	blk_status_t status;
+	ktime_t start;
+	ktime_t end;
+	u32 index[ZRAM_WB_BATCH];
+	u32 charged[ZRAM_WB_BATCH];	/* writeback_limit taken per slot */
+	struct page *pages[ZRAM_WB_BATCH];
+};
+
+struct zram_wb_ctl {
+	spinlock_t lock;
+	struct list_head idle;		/* requests free to be filled */
+	struct list_head done;		/* requests whose bio completed */
+	unsigned int inflight;
+	wait_queue_head_t wait;
+};
+
+static void zram_wb_req_free(struct zram_wb_req *req)
+{
+	unsigned int i;
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		if (req->pages[i])
+			__free_page(req->pages[i]);
+	}
+	kfree(req);
+}
+
+static void zram_wb_ctl_free(struct zram_wb_ctl *ctl)
+{
+	struct zram_wb_req *req, *tmp;
+
+	list_for_each_entry_safe(req, tmp, &ctl->idle, entry)
+		zram_wb_req_free(req);
+	kfree(ctl);
+}
+
+/* as many requests as memory allows, up to ZRAM_WB_INFLIGHT */
+static struct zram_wb_ctl *zram_wb_ctl_alloc(void)
+{
+	struct zram_wb_ctl *ctl;
+	unsigned int i, j;
+
+	ctl = kzalloc(sizeof(*ctl), GFP_KERNEL);
+	if (!ctl)
+		return NULL;
+
+	spin_lock_init(&ctl->lock);
+	INIT_LIST_HEAD(&ctl->idle);
+	INIT_LIST_HEAD(&ctl->done);
+	init_waitqueue_head(&ctl->wait);
+
+	for (i = 0; i < ZRAM_WB_INFLIGHT; i++) {
+		struct zram_wb_req *req;
+
+		req = kzalloc(sizeof(*req), GFP_KERNEL);
+		if (!req)
+			break;
+
+		for (j = 0; j < ZRAM_WB_BATCH; j++) {
+			req->pages[j] = alloc_page(GFP_KERNEL);
+			if (!req->pages[j])
+				break;
+		}
+		if (j < ZRAM_WB_BATCH) {
+			zram_wb_req_free(req);
+			break;
+		}
+
+		req->ctl = ctl;
+		list_add_tail(&req->entry, &ctl->idle);
+	}
+
+	if (list_empty(&ctl->idle)) {
+		kfree(ctl);
+		return NULL;
+	}
+	return ctl;
+}
+
+static void zram_wb_end_io(struct bio *bio)
+{
+	struct zram_wb_req *req = bio->bi_private;
+	struct zram_wb_ctl *ctl = req->ctl;
+	unsigned long flags;
+
+	req->status = bio->bi_status;
+	req->end = ktime_get();
+
+	spin_lock_irqsave(&ctl->lock, flags);
+	list_add_tail(&req->entry, &ctl->done);
+	ctl->inflight--;
+	/*
+	 * Wake under the lock: writeback_store() frees ctl as soon as its
+	 * zram_wb_all_done() check, which takes the lock, sees no bio left.
+	 */
+	wake_up(&ctl->wait);
+	spin_unlock_irqrestore(&ctl->lock, flags);
+}
+
+static void zram_wb_submit(struct zram *zram, struct zram_wb_req *req)
+{
+	struct zram_wb_ctl *ctl = req->ctl;
+	struct bio *bio;
+	unsigned int i;
+
+	bio = bio_alloc(GFP_KERNEL, req->nr);
+	bio_set_dev(bio, zram->bdev);
+	bio->bi_iter.bi_sector = req->blk_idx * (PAGE_SIZE >> 9);
+	bio->bi_opf = REQ_OP_WRITE;
+	for (i = 0; i < req->nr; i++)
+		bio_add_page(bio, req->pages[i], PAGE_SIZE, 0);
+	bio->bi_private = req;
+	bio->bi_end_io = zram_wb_end_io;
+	req->bio = bio;
+
+	spin_lock_irq(&ctl->lock);
+	ctl->inflight++;
+	spin_unlock_irq(&ctl->lock);
+
+	atomic64_inc(&zram->stats.bd_wb_bios);
+	req->start = ktime_get();
+	submit_bio(bio);
+}
+
+/*
+ * writeback_limit is charged when a slot is picked, refunded if it fails.
+ * The last charge may be clamped to what was left, so the amount actually
+ * taken is returned in @charged for the refund.
+ */
+static bool zram_wb_limit_charge(struct zram *zram, u32 *charged)
+{
+	bool ret = true;
+
+	*charged = 0;
+	spin_lock(&zram->wb_limit_lock);
+	if (zram->wb_limit_enable) {
+		if (!zram->bd_wb_limit) {
+			ret = false;
+		} else {
+			*charged = min_t(u64, zram->bd_wb_limit,
+					 1UL << (PAGE_SHIFT - 12));
+			zram->bd_wb_limit -= *charged;
+		}
+	}
+	spin_unlock(&zram->wb_limit_lock);
+
+	return ret;
+}
+
+static void zram_wb_limit_refund(struct zram *zram, u32 charged)
+{
+	if (!charged)
+		return;
+
+	spin_lock(&zram->wb_limit_lock);
+	if (zram->wb_limit_enable)
+		zram->bd_wb_limit += charged;
+	spin_unlock(&zram->wb_limit_lock);
+}
+
+static void zram_wb_update_lat_max(struct zram *zram, u64 lat)
+{
+	u64 old_max, cur_max;
+
+	old_max = atomic64_read(&zram->stats.bd_wb_lat_max);
+	do {
+		cur_max = old_max;
+		if (lat > cur_max)
+			old_max = atomic64_cmpxchg(&zram->stats.bd_wb_lat_max,
+						   cur_max, lat);
+	} while (old_max != cur_max);
+}
+
+/* Hand the slots of a completed request over to the backing device */
+static int zram_wb_finish(struct zram *zram, struct zram_wb_req *req)
+{
+	int err = blk_status_to_errno(req->status);
+	u64 lat = ktime_us_delta(req->end, req->start);
+	unsigned int i;
+
+	atomic64_add(lat, &zram->stats.bd_wb_lat);
+	zram_wb_update_lat_max(zram, lat);
+
+	for (i = 0; i < req->nr; i++) {
+		unsigned long blk_idx = req->blk_idx + i;
+		u32 index = req->index[i];
+
+		if (!err)
+			atomic64_inc(&zram->stats.bd_writes);
+		/*
+		 * We released zram_slot_lock so need to check if the slot was
+		 * changed. If there is freeing for the slot, we can catch it
+		 * easily by zram_allocated.
+		 * A subtle case is the slot is freed/reallocated/marked as
+		 * ZRAM_IDLE again. To close the race, idle_store doesn't
+		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
+		 * Thus, we could close the race by checking ZRAM_IDLE bit.
+		 */
+		zram_slot_lock(zram, index);
+		if (err || !zram_allocated(zram, index) ||
+			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_clear_flag(zram, index, ZRAM_IDLE);
+			zram_slot_unlock(zram, index);
+			free_block_bdev(zram, blk_idx);
+			zram_wb_limit_refund(zram, req->charged[i]);
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram_set_element(zram, index, blk_idx);
+		atomic64_inc(&zram->stats.pages_stored);
+		zram_slot_unlock(zram, index);
+	}
+
+	bio_put(req->bio);
+	req->bio = NULL;
+	req->nr = 0;
+	return err;
+}
+
+/*
+ * Finish the completed requests and make them available again.  Returns
+ * the last IO error, if any.
+ */
+static int zram_wb_reap(struct zram *zram, struct zram_wb_ctl *ctl)
+{
+	struct zram_wb_req *req;
+	int ret = 0, err;
+
+	spin_lock_irq(&ctl->lock);
+	while (!list_empty(&ctl->done)) {
+		req = list_first_entry(&ctl->done, struct zram_wb_req, entry);
+		list_del(&req->entry);
+		spin_unlock_irq(&ctl->lock);
+
+		err = zram_wb_finish(zram, req);
+		if (err)
+			ret = err;
+
+		spin_lock_irq(&ctl->lock);
+		list_add_tail(&req->entry, &ctl->idle);
+	}
+	spin_unlock_irq(&ctl->lock);
+
+	return ret;
+}
+
+static bool zram_wb_idle_ready(struct zram_wb_ctl *ctl)
+{
+	bool ret;
+
+	spin_lock_irq(&ctl->lock);
+	ret = !list_empty(&ctl->idle) || !list_empty(&ctl->done);
+	spin_unlock_irq(&ctl->lock);
+
+	return ret;
+}
+
+static bool zram_wb_all_done(struct zram_wb_ctl *ctl)
+{
+	bool ret;
+
+	spin_lock_irq(&ctl->lock);
+	ret = !ctl->inflight;
+	spin_unlock_irq(&ctl->lock);
+
+	return ret;
+}
+
+/* Get an empty request, waiting for one of the bios in flight if needed */
+static struct zram_wb_req *zram_wb_get_req(struct zram *zram,
+					   struct zram_wb_ctl *ctl,
+					   ssize_t *ret)
+{
+	struct zram_wb_req *req;
+	int err;
+
+	wait_event(ctl->wait, zram_wb_idle_ready(ctl));
+
+	err = zram_wb_reap(zram, ctl);
+	/*
+	 * Return last IO error unless every IO were
+	 * not suceeded.
+	 */
+	if (err)
+		*ret = err;
+
+	spin_lock_irq(&ctl->lock);
+	req = list_first_entry(&ctl->idle, struct zram_wb_req, entry);
+	list_del(&req->entry);
+	spin_unlock_irq(&ctl->lock);
+
+	return req;
+}
+
 static ssize_t writeback_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	struct zram *zram = dev_to_zram(dev);
 	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
 	unsigned long index = 0;
-	struct bio bio;
-	struct bio_vec bio_vec;
-	struct page *page;
+	struct zram_wb_req *req = NULL;
+	struct zram_wb_ctl *ctl;
 	ssize_t ret = len;
+	ktime_t start;
 	int mode, err;
-	unsigned long blk_idx = 0;
+	unsigned long blk_idx;
+	u32 charged;
 
 	if (sysfs_streq(buf, "idle"))
 		mode = IDLE_WRITEBACK;
@@ -657,34 +988,21 @@ static ssize_t writeback_store(struct device *dev,
 		goto release_init_lock;
 	}
 
-	page = alloc_page(GFP_KERNEL);
-	if (!page) {
+	ctl = zram_wb_ctl_alloc();
+	if (!ctl) {
 		ret = -ENOMEM;
 		goto release_init_lock;
 	}
 
+	start = ktime_get();
 	for (; nr_pages != 0; index++, nr_pages--) {
 		struct bio_vec bvec;
+		unsigned int pos;
 
-		bvec.bv_page = page;
-		bvec.bv_len = PAGE_SIZE;
-		bvec.bv_offset = 0;
-
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && !zram->bd_wb_limit) {
-			spin_unlock(&zram->wb_limit_lock);
+		if (!zram_wb_limit_charge(zram, &charged)) {
 			ret = -EIO;
 			break;
 		}
-		spin_unlock(&zram->wb_limit_lock);
-
-		if (!blk_idx) {
-			blk_idx = alloc_block_bdev(zram);
-			if (!blk_idx) {
-				ret = -ENOSPC;
-				break;
-			}
-		}
 
 		zram_slot_lock(zram, index);
 		if (!zram_allocated(zram, index))
@@ -709,74 +1027,82 @@ static ssize_t writeback_store(struct device *dev,
 		/* Need for hugepage writeback racing */
 		zram_set_flag(zram, index, ZRAM_IDLE);
 		zram_slot_unlock(zram, index);
+
+		if (!req)
+			req = zram_wb_get_req(zram, ctl, &ret);
+
+		pos = req->nr;
+		bvec.bv_page = req->pages[pos];
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
 		if (zram_bvec_read(zram, &bvec, index, 0, NULL)) {
-			zram_slot_lock(zram, index);
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			zram_slot_unlock(zram, index);
-			continue;
+			err = 0;
+			goto fail;
 		}
 
-		bio_init(&bio, &bio_vec, 1);
-		bio_set_dev(&bio, zram->bdev);
-		bio.bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
-		bio.bi_opf = REQ_OP_WRITE | REQ_SYNC;
-
-		bio_add_page(&bio, bvec.bv_page, bvec.bv_len,
-				bvec.bv_offset);
-		/*
-		 * XXX: A single page IO would be inefficient for write
-		 * but it would be not bad as starter.
-		 */
-		err = submit_bio_wait(&bio);
-		if (err) {
-			zram_slot_lock(zram, index);
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			zram_slot_unlock(zram, index);
-			/*
-			 * Return last IO error unless every IO were
-			 * not suceeded.
-			 */
-			ret = err;
-			continue;
+		blk_idx = alloc_block_bdev(zram);
+		if (!blk_idx) {
+			err = -ENOSPC;
+			goto fail;
 		}
 
-		atomic64_inc(&zram->stats.bd_writes);
 		/*
-		 * We released zram_slot_lock so need to check if the slot was
-		 * changed. If there is freeing for the slot, we can catch it
-		 * easily by zram_allocated.
-		 * A subtle case is the slot is freed/reallocated/marked as
-		 * ZRAM_IDLE again. To close the race, idle_store doesn't
-		 * mark ZRAM_IDLE once it found the slot was ZRAM_UNDER_WB.
-		 * Thus, we could close the race by checking ZRAM_IDLE bit.
+		 * The block does not follow the batch: send the batch and
+		 * move the page just read to the next one.
 		 */
-		zram_slot_lock(zram, index);
-		if (!zram_allocated(zram, index) ||
-			  !zram_test_flag(zram, index, ZRAM_IDLE)) {
-			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-			zram_clear_flag(zram, index, ZRAM_IDLE);
-			goto next;
+		if (pos && blk_idx != req->blk_idx + pos) {
+			struct zram_wb_req *prev = req;
+
+			zram_wb_submit(zram, prev);
+			req = zram_wb_get_req(zram, ctl, &ret);
+			swap(req->pages[0], prev->pages[pos]);
+			pos = 0;
 		}
 
-		zram_free_page(zram, index);
+		if (!pos)
+			req->blk_idx = blk_idx;
+		req->index[pos] = index;
+		req->charged[pos] = charged;
+		req->nr = pos + 1;
+		if (req->nr == ZRAM_WB_BATCH) {
+			zram_wb_submit(zram, req);
+			req = NULL;
+		}
+		continue;
+fail:
+		zram_slot_lock(zram, index);
 		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
-		zram_set_flag(zram, index, ZRAM_WB);
-		zram_set_element(zram, index, blk_idx);
-		blk_idx = 0;
-		atomic64_inc(&zram->stats.pages_stored);
-		spin_lock(&zram->wb_limit_lock);
-		if (zram->wb_limit_enable && zram->bd_wb_limit > 0)
-			zram->bd_wb_limit -=  1UL << (PAGE_SHIFT - 12);
-		spin_unlock(&zram->wb_limit_lock);
+		zram_clear_flag(zram, index, ZRAM_IDLE);
+		zram_slot_unlock(zram, index);
+		zram_wb_limit_refund(zram, charged);
+		if (err) {
+			ret = err;
+			break;
+		}
+		continue;
 next:
 		zram_slot_unlock(zram, index);
+		zram_wb_limit_refund(zram, charged);
 	}
 
-	if (blk_idx)
-		free_block_bdev(zram, blk_idx);
-	__free_page(page);
+	if (req) {
+		if (req->nr) {
+			zram_wb_submit(zram, req);
+		} else {
+			spin_lock_irq(&ctl->lock);
+			list_add_tail(&req->entry, &ctl->idle);
+			spin_unlock_irq(&ctl->lock);
+		}
+	}
+
+	wait_event(ctl->wait, zram_wb_all_done(ctl));
+	err = zram_wb_reap(zram, ctl);
+	if (err)
+		ret = err;
+	zram_wb_ctl_free(ctl);
+
+	atomic64_add(ktime_us_delta(ktime_get(), start),
+		     &zram->stats.bd_wb_time);
 release_init_lock:
 	up_read(&zram->init_lock);
 
@@ -902,13 +1228,16 @@ static ssize_t read_block_state(struct file *file, char __user *buf,
 
 		ts = ktime_to_timespec64(zram->table[index].ac_time);
 		copied = snprintf(kbuf + written, count,
-			"%12zd %12lld.%06lu %c%c%c%c\n",
+			"%12zd %12lld.%06lu %c%c%c%c%c%c\n",
 			index, (s64)ts.tv_sec,
 			ts.tv_nsec / NSEC_PER_USEC,
 			zram_test_flag(zram, index, ZRAM_SAME) ? 's' : '.',
 			zram_test_flag(zram, index, ZRAM_WB) ? 'w' : '.',
 			zram_test_flag(zram, index, ZRAM_HUGE) ? 'h' : '.',
-			zram_test_flag(zram, index, ZRAM_IDLE) ? 'i' : '.');
+			zram_test_flag(zram, index, ZRAM_IDLE) ? 'i' : '.',
+			zram_get_priority(zram, index) ? 'r' : '.',
+			zram_test_flag(zram, index,
+				       ZRAM_INCOMPRESSIBLE) ? 'n' : '.');
 
 		if (count < copied) {
 			zram_slot_unlock(zram, index);
@@ -982,6 +1311,33 @@ static ssize_t max_comp_streams_store(struct device *dev,
 	return len;
 }
 
+static ssize_t __comp_algorithm_store(struct zram *zram, u32 prio,
+				      const char *buf)
+{
+	char compressor[CRYPTO_MAX_ALG_NAME];
+	size_t sz;
+
+	strlcpy(compressor, buf, sizeof(compressor));
+	/* ignore trailing newline */
+	sz = strlen(compressor);
+	if (sz > 0 && compressor[sz - 1] == '\n')
+		compressor[sz - 1] = 0x00;
+
+	if (!zcomp_available_algorithm(compressor))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+
+	strcpy(zram->comp_algs[prio], compressor);
+	up_write(&zram->init_lock);
+	return 0;
+}
+
 static ssize_t comp_algorithm_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -989,7 +1345,7 @@ static ssize_t comp_algorithm_show(struct device *dev,
 	struct zram *zram = dev_to_zram(dev);
 
 	down_read(&zram->init_lock);
-	sz = zcomp_available_show(zram->compressor, buf);
+	sz = zcomp_available_show(zram->comp_algs[ZRAM_PRIMARY_COMP], buf, 0);
 	up_read(&zram->init_lock);
 
 	return sz;
@@ -999,29 +1355,82 @@ static ssize_t comp_algorithm_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	struct zram *zram = dev_to_zram(dev);
-	char compressor[ARRAY_SIZE(zram->compressor)];
-	size_t sz;
+	int ret;
 
-	strlcpy(compressor, buf, sizeof(compressor));
-	/* ignore trailing newline */
-	sz = strlen(compressor);
-	if (sz > 0 && compressor[sz - 1] == '\n')
-		compressor[sz - 1] = 0x00;
+	ret = __comp_algorithm_store(zram, ZRAM_PRIMARY_COMP, buf);
+	return ret ? ret : len;
+}
 
-	if (!zcomp_available_algorithm(compressor))
-		return -EINVAL;
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t sz = 0;
+	u32 prio;
 
-	down_write(&zram->init_lock);
-	if (init_done(zram)) {
-		up_write(&zram->init_lock);
-		pr_info("Can't change algorithm for initialized device\n");
-		return -EBUSY;
+	down_read(&zram->init_lock);
+	for (prio = ZRAM_SECONDARY_COMP; prio < ZRAM_MAX_COMPS; prio++) {
+		if (!zram->comp_algs[prio][0])
+			continue;
+
+		sz += scnprintf(buf + sz, PAGE_SIZE - sz - 2, "#%u: ", prio);
+		sz += zcomp_available_show(zram->comp_algs[prio], buf, sz);
 	}
+	up_read(&zram->init_lock);
 
-	strcpy(zram->compressor, compressor);
-	up_write(&zram->init_lock);
-	return len;
+	return sz;
+}
+
+/* "algo=<name> [priority=<1..3>]", the priority defaulting to 1 */
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	char *args, *orig, *param, *val, *alg = NULL;
+	u32 prio = ZRAM_SECONDARY_COMP;
+	int ret = 0;
+
+	orig = args = kstrdup(buf, GFP_KERNEL);
+	if (!args)
+		return -ENOMEM;
+
+	args = skip_spaces(args);
+	while (*args) {
+		args = next_arg(args, &param, &val);
+
+		if (!val || !*val) {
+			ret = -EINVAL;
+			goto out;
+		}
+
+		if (!strcmp(param, "algo")) {
+			alg = val;
+			continue;
+		}
+
+		if (!strcmp(param, "priority")) {
+			ret = kstrtouint(val, 10, &prio);
+			if (ret)
+				goto out;
+			continue;
+		}
+
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (!alg || prio < ZRAM_SECONDARY_COMP || prio >= ZRAM_MAX_COMPS) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = __comp_algorithm_store(zram, prio, alg);
+out:
+	kfree(orig);
+	return ret ? ret : len;
 }
+#endif
 
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
@@ -1104,10 +1513,14 @@ static ssize_t bd_stat_show(struct device *dev,
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-		"%8llu %8llu %8llu\n",
+		"%8llu %8llu %8llu %8llu %8llu %8llu %8llu\n",
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
-			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)));
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)),
+			(u64)atomic64_read(&zram->stats.bd_wb_bios),
+			(u64)atomic64_read(&zram->stats.bd_wb_time),
+			(u64)atomic64_read(&zram->stats.bd_wb_lat),
+			(u64)atomic64_read(&zram->stats.bd_wb_lat_max));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1132,8 +1545,39 @@ static ssize_t debug_stat_show(struct device *dev,
 	return ret;
 }
 
+/*
+ * One line per algorithm: priority, name, pages stored, their compressed
+ * size, pages it shrank by recompressing them and the time it spent
+ * trying to, in ns.
+ */
+static ssize_t algo_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret = 0;
+	u32 prio;
+
+	down_read(&zram->init_lock);
+	for (prio = 0; prio < ZRAM_MAX_COMPS; prio++) {
+		if (!zram->comp_algs[prio][0])
+			continue;
+
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret,
+				"%u %s %8llu %8llu %8llu %8llu\n",
+				prio, zram->comp_algs[prio],
+				(u64)atomic64_read(&zram->stats.comp_pages[prio]),
+				(u64)atomic64_read(&zram->stats.comp_size[prio]),
+				(u64)atomic64_read(&zram->stats.recomp_pages[prio]),
+				(u64)atomic64_read(&zram->stats.recomp_ns[prio]));
+	}
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
 static DEVICE_ATTR_RO(io_stat);
 static DEVICE_ATTR_RO(mm_stat);
+static DEVICE_ATTR_RO(algo_stat);
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RO(bd_stat);
 #endif
@@ -1180,6 +1624,8 @@ static bool zram_meta_alloc(struct zram *zram, u64 disksize)
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	unsigned long handle;
+	size_t size;
+	u32 prio;
 
 #ifdef CONFIG_ZRAM_MEMORY_TRACKING
 	zram->table[index].ac_time = 0;
@@ -1187,6 +1633,9 @@ static void zram_free_page(struct zram *zram, size_t index)
 	if (zram_test_flag(zram, index, ZRAM_IDLE))
 		zram_clear_flag(zram, index, ZRAM_IDLE);
 
+	if (zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+		zram_clear_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+
 	if (zram_test_flag(zram, index, ZRAM_HUGE)) {
 		zram_clear_flag(zram, index, ZRAM_HUGE);
 		atomic64_dec(&zram->stats.huge_pages);
@@ -1214,39 +1663,34 @@ static void zram_free_page(struct zram *zram, size_t index)
 
 	zs_free(zram->mem_pool, handle);
 
-	atomic64_sub(zram_get_obj_size(zram, index),
-			&zram->stats.compr_data_size);
+	prio = zram_get_priority(zram, index);
+	size = zram_get_obj_size(zram, index);
+	atomic64_sub(size, &zram->stats.compr_data_size);
+	atomic64_sub(size, &zram->stats.comp_size[prio]);
+	atomic64_dec(&zram->stats.comp_pages[prio]);
 out:
 	atomic64_dec(&zram->stats.pages_stored);
 	zram_set_handle(zram, index, 0);
 	zram_set_obj_size(zram, index, 0);
+	zram_set_priority(zram, index, ZRAM_PRIMARY_COMP);
 	WARN_ON_ONCE(zram->table[index].flags &
 		~(1UL << ZRAM_LOCK | 1UL << ZRAM_UNDER_WB));
 }
 
-static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
-				struct bio *bio, bool partial_io)
+/*
+ * Decompress the slot, held locked by the caller, with the algorithm it
+ * was compressed with.
+ */
+static int zram_read_from_zspool(struct zram *zram, struct page *page,
+				 u32 index)
 {
 	struct zcomp_strm *zstrm;
 	unsigned long handle;
 	unsigned int size;
 	void *src, *dst;
+	u32 prio;
 	int ret;
 
-	zram_slot_lock(zram, index);
-	if (zram_test_flag(zram, index, ZRAM_WB)) {
-		struct bio_vec bvec;
-
-		zram_slot_unlock(zram, index);
-
-		bvec.bv_page = page;
-		bvec.bv_len = PAGE_SIZE;
-		bvec.bv_offset = 0;
-		return read_from_bdev(zram, &bvec,
-				zram_get_element(zram, index),
-				bio, partial_io);
-	}
-
 	handle = zram_get_handle(zram, index);
 	if (!handle || zram_test_flag(zram, index, ZRAM_SAME)) {
 		unsigned long value;
@@ -1256,14 +1700,14 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		mem = kmap_atomic(page);
 		zram_fill_page(mem, PAGE_SIZE, value);
 		kunmap_atomic(mem);
-		zram_slot_unlock(zram, index);
 		return 0;
 	}
 
 	size = zram_get_obj_size(zram, index);
+	prio = zram_get_priority(zram, index);
 
 	if (size != PAGE_SIZE)
-		zstrm = zcomp_stream_get(zram->comp);
+		zstrm = zcomp_stream_get(zram->comps[prio]);
 
 	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
 	if (size == PAGE_SIZE) {
@@ -1275,9 +1719,32 @@ static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
 		dst = kmap_atomic(page);
 		ret = zcomp_decompress(zstrm, src, size, dst);
 		kunmap_atomic(dst);
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(zram->comps[prio]);
 	}
 	zs_unmap_object(zram->mem_pool, handle);
+	return ret;
+}
+
+static int __zram_bvec_read(struct zram *zram, struct page *page, u32 index,
+				struct bio *bio, bool partial_io)
+{
+	int ret;
+
+	zram_slot_lock(zram, index);
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		struct bio_vec bvec;
+
+		zram_slot_unlock(zram, index);
+
+		bvec.bv_page = page;
+		bvec.bv_len = PAGE_SIZE;
+		bvec.bv_offset = 0;
+		return read_from_bdev(zram, &bvec,
+				zram_get_element(zram, index),
+				bio, partial_io);
+	}
+
+	ret = zram_read_from_zspool(zram, page, index);
 	zram_slot_unlock(zram, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
@@ -1344,13 +1811,13 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	kunmap_atomic(mem);
 
 compress_again:
-	zstrm = zcomp_stream_get(zram->comp);
+	zstrm = zcomp_stream_get(zram->comps[ZRAM_PRIMARY_COMP]);
 	src = kmap_atomic(page);
 	ret = zcomp_compress(zstrm, src, &comp_len);
 	kunmap_atomic(src);
 
 	if (unlikely(ret)) {
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 		pr_err("Compression failed! err=%d\n", ret);
 		zs_free(zram->mem_pool, handle);
 		return ret;
@@ -1378,7 +1845,7 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 				__GFP_HIGHMEM |
 				__GFP_MOVABLE);
 	if (!handle) {
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 		atomic64_inc(&zram->stats.writestall);
 		handle = zs_malloc(zram->mem_pool, comp_len,
 				GFP_NOIO | __GFP_HIGHMEM |
@@ -1392,7 +1859,7 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	update_used_max(zram, alloced_pages);
 
 	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
-		zcomp_stream_put(zram->comp);
+		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 		zs_free(zram->mem_pool, handle);
 		return -ENOMEM;
 	}
@@ -1406,7 +1873,7 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	if (comp_len == PAGE_SIZE)
 		kunmap_atomic(src);
 
-	zcomp_stream_put(zram->comp);
+	zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 	zs_unmap_object(zram->mem_pool, handle);
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
 out:
@@ -1429,6 +1896,9 @@ static int __zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	}  else {
 		zram_set_handle(zram, index, handle);
 		zram_set_obj_size(zram, index, comp_len);
+		atomic64_inc(&zram->stats.comp_pages[ZRAM_PRIMARY_COMP]);
+		atomic64_add(comp_len,
+			     &zram->stats.comp_size[ZRAM_PRIMARY_COMP]);
 	}
 	zram_slot_unlock(zram, index);
 
@@ -1478,6 +1948,235 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec,
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+/*
+ * Recompress the slot, held locked by the caller, with the first of the
+ * algorithms of priority [prio, prio_max) above the one it is compressed
+ * with that makes it smaller.  Slots smaller than threshold are left
+ * alone.  The stream buffers are per-cpu, so all of this runs with
+ * preemption disabled and the new object is allocated without direct
+ * reclaim.
+ */
+static int zram_recompress(struct zram *zram, u32 index, struct page *page,
+			   u32 threshold, u32 prio, u32 prio_max)
+{
+	struct zcomp_strm *zstrm = NULL;
+	unsigned long handle_old, handle_new;
+	unsigned int comp_len_old, comp_len_new;
+	u32 cur_prio = zram_get_priority(zram, index);
+	u32 first = max(prio, cur_prio + 1);
+	bool idle;
+	void *src, *dst;
+	u64 start;
+	int ret;
+
+	handle_old = zram_get_handle(zram, index);
+	if (!handle_old)
+		return -EINVAL;
+
+	comp_len_old = zram_get_obj_size(zram, index);
+	if (comp_len_old < threshold)
+		return 0;
+
+	ret = zram_read_from_zspool(zram, page, index);
+	if (ret)
+		return ret;
+
+	for (prio = first; prio < prio_max; prio++) {
+		if (!zram->comps[prio])
+			continue;
+
+		start = ktime_get_ns();
+		zstrm = zcomp_stream_get(zram->comps[prio]);
+		src = kmap_atomic(page);
+		ret = zcomp_compress(zstrm, src, &comp_len_new);
+		kunmap_atomic(src);
+		atomic64_add(ktime_get_ns() - start,
+			     &zram->stats.recomp_ns[prio]);
+
+		if (ret) {
+			zcomp_stream_put(zram->comps[prio]);
+			return ret;
+		}
+
+		if (comp_len_new < comp_len_old &&
+		    comp_len_new < huge_class_size)
+			break;
+
+		zcomp_stream_put(zram->comps[prio]);
+		zstrm = NULL;
+	}
+
+	if (!zstrm) {
+		/* every algorithm above the current one failed to shrink it */
+		if (prio_max == ZRAM_MAX_COMPS && first == cur_prio + 1)
+			zram_set_flag(zram, index, ZRAM_INCOMPRESSIBLE);
+		return 0;
+	}
+
+	handle_new = zs_malloc(zram->mem_pool, comp_len_new,
+			       __GFP_KSWAPD_RECLAIM |
+			       __GFP_NOWARN |
+			       __GFP_HIGHMEM |
+			       __GFP_MOVABLE);
+	if (!handle_new) {
+		zcomp_stream_put(zram->comps[prio]);
+		return -ENOMEM;
+	}
+
+	dst = zs_map_object(zram->mem_pool, handle_new, ZS_MM_WO);
+	memcpy(dst, zstrm->buffer, comp_len_new);
+	zcomp_stream_put(zram->comps[prio]);
+	zs_unmap_object(zram->mem_pool, handle_new);
+
+	idle = zram_test_flag(zram, index, ZRAM_IDLE);
+	zram_free_page(zram, index);
+	zram_set_handle(zram, index, handle_new);
+	zram_set_obj_size(zram, index, comp_len_new);
+	zram_set_priority(zram, index, prio);
+	/* the data was not accessed, keep it eligible for idle writeback */
+	if (idle)
+		zram_set_flag(zram, index, ZRAM_IDLE);
+
+	atomic64_add(comp_len_new, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.comp_pages[prio]);
+	atomic64_add(comp_len_new, &zram->stats.comp_size[prio]);
+	atomic64_inc(&zram->stats.recomp_pages[prio]);
+	atomic64_inc(&zram->stats.pages_stored);
+	return 0;
+}
+
+#define RECOMPRESS_IDLE		(1 << 0)
+#define RECOMPRESS_HUGE		(1 << 1)
+
+/*
+ * "type=<idle|huge|huge_idle> [threshold=<bytes>] [algo=<name>]"
+ *
+ * Without algo, all the secondary algorithms are tried by priority order.
+ */
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long nr_pages = zram->disksize >> PAGE_SHIFT;
+	char *args, *orig, *param, *val, *algo = NULL;
+	u32 prio = ZRAM_SECONDARY_COMP, prio_max = ZRAM_MAX_COMPS;
+	u32 mode = 0, threshold = 0;
+	unsigned long index;
+	struct page *page;
+	ssize_t ret;
+
+	orig = args = kstrdup(buf, GFP_KERNEL);
+	if (!args)
+		return -ENOMEM;
+
+	ret = -EINVAL;
+	args = skip_spaces(args);
+	while (*args) {
+		args = next_arg(args, &param, &val);
+
+		if (!val || !*val)
+			goto out_free;
+
+		if (!strcmp(param, "type")) {
+			if (!strcmp(val, "idle"))
+				mode = RECOMPRESS_IDLE;
+			else if (!strcmp(val, "huge"))
+				mode = RECOMPRESS_HUGE;
+			else if (!strcmp(val, "huge_idle"))
+				mode = RECOMPRESS_IDLE | RECOMPRESS_HUGE;
+			else
+				goto out_free;
+			continue;
+		}
+
+		if (!strcmp(param, "threshold")) {
+			/* only slots bigger than this get recompressed */
+			if (kstrtouint(val, 10, &threshold) ||
+			    threshold >= PAGE_SIZE)
+				goto out_free;
+			continue;
+		}
+
+		if (!strcmp(param, "algo")) {
+			algo = val;
+			continue;
+		}
+
+		goto out_free;
+	}
+
+	if (!mode)
+		goto out_free;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto release_init_lock;
+	}
+
+	if (algo) {
+		for (prio = ZRAM_SECONDARY_COMP; prio < ZRAM_MAX_COMPS; prio++) {
+			if (zram->comps[prio] &&
+			    !strcmp(zram->comp_algs[prio], algo))
+				break;
+		}
+		if (prio == ZRAM_MAX_COMPS) {
+			ret = -EINVAL;
+			goto release_init_lock;
+		}
+		prio_max = prio + 1;
+	}
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto release_init_lock;
+	}
+
+	ret = len;
+	for (index = 0; index < nr_pages; index++) {
+		int err = 0;
+
+		zram_slot_lock(zram, index);
+		if (!zram_allocated(zram, index))
+			goto next;
+
+		if (mode & RECOMPRESS_IDLE &&
+		    !zram_test_flag(zram, index, ZRAM_IDLE))
+			goto next;
+
+		if (mode & RECOMPRESS_HUGE &&
+		    !zram_test_flag(zram, index, ZRAM_HUGE))
+			goto next;
+
+		if (zram_test_flag(zram, index, ZRAM_WB) ||
+		    zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+		    zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
+			goto next;
+
+		err = zram_recompress(zram, index, page, threshold, prio,
+				      prio_max);
+next:
+		zram_slot_unlock(zram, index);
+		if (err) {
+			ret = err;
+			break;
+		}
+
+		cond_resched();
+	}
+
+	__free_page(page);
+release_init_lock:
+	up_read(&zram->init_lock);
+out_free:
+	kfree(orig);
+	return ret;
+}
+#endif
+
 /*
  * zram_bio_discard - handler on discard request
  * @index: physical block index in PAGE_SIZE units
@@ -1687,9 +2386,19 @@ static int zram_rw_page(struct block_device *bdev, sector_t sector,
 	return ret;
 }
 
+static void zram_destroy_comps(struct zram *zram)
+{
+	u32 prio;
+
+	for (prio = 0; prio < ZRAM_MAX_COMPS; prio++) {
+		if (zram->comps[prio])
+			zcomp_destroy(zram->comps[prio]);
+		zram->comps[prio] = NULL;
+	}
+}
+
 static void zram_reset_device(struct zram *zram)
 {
-	struct zcomp *comp;
 	u64 disksize;
 
 	down_write(&zram->init_lock);
@@ -1701,7 +2410,6 @@ static void zram_reset_device(struct zram *zram)
 		return;
 	}
 
-	comp = zram->comp;
 	disksize = zram->disksize;
 	zram->disksize = 0;
 
@@ -1712,7 +2420,7 @@ static void zram_reset_device(struct zram *zram)
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(zram, disksize);
 	memset(&zram->stats, 0, sizeof(zram->stats));
-	zcomp_destroy(comp);
+	zram_destroy_comps(zram);
 	reset_bdev(zram);
 }
 
@@ -1723,6 +2431,7 @@ static ssize_t disksize_store(struct device *dev,
 	struct zcomp *comp;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
+	u32 prio;
 
 	disksize = memparse(buf, NULL);
 	if (!disksize)
@@ -1741,22 +2450,28 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_unlock;
 	}
 
-	comp = zcomp_create(zram->compressor);
-	if (IS_ERR(comp)) {
-		pr_err("Cannot initialise %s compressing backend\n",
-				zram->compressor);
-		err = PTR_ERR(comp);
-		goto out_free_meta;
+	for (prio = 0; prio < ZRAM_MAX_COMPS; prio++) {
+		if (!zram->comp_algs[prio][0])
+			continue;
+
+		comp = zcomp_create(zram->comp_algs[prio]);
+		if (IS_ERR(comp)) {
+			pr_err("Cannot initialise %s compressing backend\n",
+					zram->comp_algs[prio]);
+			err = PTR_ERR(comp);
+			goto out_free_comps;
+		}
+		zram->comps[prio] = comp;
 	}
 
-	zram->comp = comp;
 	zram->disksize = disksize;
 	set_capacity_and_notify(zram->disk, zram->disksize >> SECTOR_SHIFT);
 	up_write(&zram->init_lock);
 
 	return len;
 
-out_free_meta:
+out_free_comps:
+	zram_destroy_comps(zram);
 	zram_meta_free(zram, disksize);
 out_unlock:
 	up_write(&zram->init_lock);
@@ -1842,6 +2557,10 @@ static DEVICE_ATTR_WO(mem_used_max);
 static DEVICE_ATTR_WO(idle);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_WO(recompress);
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 static DEVICE_ATTR_RW(backing_dev);
 static DEVICE_ATTR_WO(writeback);
@@ -1859,6 +2578,10 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_idle.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
+#endif
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_backing_dev.attr,
 	&dev_attr_writeback.attr,
@@ -1867,6 +2590,7 @@ static struct attribute *zram_disk_attrs[] = {
 #endif
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
+	&dev_attr_algo_stat.attr,
 #ifdef CONFIG_ZRAM_WRITEBACK
 	&dev_attr_bd_stat.attr,
 #endif
@@ -1955,7 +2679,8 @@ static int zram_add(void)
 	blk_queue_flag_set(QUEUE_FLAG_STABLE_WRITES, zram->disk->queue);
 	device_add_disk(NULL, zram->disk, zram_disk_attr_groups);
 
-	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
+	strlcpy(zram->comp_algs[ZRAM_PRIMARY_COMP], default_compressor,
+		sizeof(zram->comp_algs[ZRAM_PRIMARY_COMP]));
 
 	zram_debugfs_register(zram);
 	pr_info("Added device: %s\n", zram->disk->disk_name);
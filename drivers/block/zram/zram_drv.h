@@ -39,7 +39,10 @@
  * The lower ZRAM_FLAG_SHIFT bits is for object size (excluding header),
  * the higher bits is for zram_pageflags.
  */
-#define ZRAM_FLAG_SHIFT 24
+#define ZRAM_FLAG_SHIFT (PAGE_SHIFT + 1)
+
+/* Only 2 bits are allowed for comp priority index */
+#define ZRAM_COMP_PRIORITY_MASK	0x3
 
 /* Flags for zram pages (table[page_no].flags) */
 enum zram_pageflags {
@@ -50,10 +53,26 @@ enum zram_pageflags {
 	ZRAM_UNDER_WB,	/* page is under writeback */
 	ZRAM_HUGE,	/* Incompressible page */
 	ZRAM_IDLE,	/* not accessed page since last idle marking */
+	ZRAM_INCOMPRESSIBLE, /* none of the algorithms could shrink it */
+
+	ZRAM_COMP_PRIORITY_BIT1, /* algorithm the page is compressed with */
+	ZRAM_COMP_PRIORITY_BIT2,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
+/*
+ * The primary algorithm compresses the pages when they are written, the
+ * others, by increasing priority, recompress them later on request.
+ */
+#define ZRAM_PRIMARY_COMP	0U
+#define ZRAM_SECONDARY_COMP	1U
+#ifdef CONFIG_ZRAM_MULTI_COMP
+#define ZRAM_MAX_COMPS		4U
+#else
+#define ZRAM_MAX_COMPS		1U
+#endif
+
 /*-- Data structures */
 
 /* Allocated for each disk page */
@@ -87,13 +106,22 @@ struct zram_stats {
 	atomic64_t bd_count;		/* no. of pages in backing device */
 	atomic64_t bd_reads;		/* no. of reads from backing device */
 	atomic64_t bd_writes;		/* no. of writes from backing device */
+	atomic64_t bd_wb_bios;		/* no. of writeback bios */
+	atomic64_t bd_wb_time;		/* usecs spent in writeback */
+	atomic64_t bd_wb_lat;		/* sum of writeback bio latencies, us */
+	atomic64_t bd_wb_lat_max;	/* worst writeback bio latency, us */
 #endif
+	/* per algorithm, indexed by priority */
+	atomic64_t comp_pages[ZRAM_MAX_COMPS];	/* no. of pages stored */
+	atomic64_t comp_size[ZRAM_MAX_COMPS];	/* their compressed size */
+	atomic64_t recomp_pages[ZRAM_MAX_COMPS]; /* no. of pages it shrank */
+	atomic64_t recomp_ns[ZRAM_MAX_COMPS];	/* time spent recompressing */
 };
 
 struct zram {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
-	struct zcomp *comp;
+	struct zcomp *comps[ZRAM_MAX_COMPS];
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
@@ -108,7 +136,8 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
-	char compressor[CRYPTO_MAX_ALG_NAME];
+	/* algorithm names by priority, empty when not set */
+	char comp_algs[ZRAM_MAX_COMPS][CRYPTO_MAX_ALG_NAME];
 	/*
 	 * zram is claimed so open request will be failed
 	 */
@@ -64,6 +64,25 @@ static int __init iommu_dma_forcedac_setup(char *str)
 }
 early_param("iommu.forcedac", iommu_dma_forcedac_setup);
 
+static unsigned int iommu_dma_rcache_max __read_mostly =
+	IOVA_RANGE_CACHE_MAX_SIZE;
+
+static int __init iommu_dma_rcache_max_setup(char *str)
+{
+	unsigned int max;
+	int ret = kstrtouint(str, 0, &max);
+
+	if (ret)
+		return ret;
+	if (!max || max > IOVA_RANGE_CACHE_MAX_LIMIT)
+		return -EINVAL;
+
+	iommu_dma_rcache_max = max;
+	pr_info("Caching IOVA ranges of up to %lu pages\n", 1UL << (max - 1));
+	return 0;
+}
+early_param("iommu.iova_cache_max", iommu_dma_rcache_max_setup);
+
 static void iommu_dma_entry_dtor(unsigned long data)
 {
 	struct page *freelist = (struct page *)data;
@@ -393,6 +412,10 @@ static int iommu_dma_init_domain(struct iommu_domain *domain, dma_addr_t base,
 	}
 
 	init_iova_domain(iovad, 1UL << order, base_pfn);
+	if (iommu_dma_rcache_max != IOVA_RANGE_CACHE_MAX_SIZE &&
+	    iova_domain_set_rcache_max(iovad, iommu_dma_rcache_max))
+		pr_warn("Failed to size IOVA caches, using %lu pages max\n",
+			iova_rcache_range_max(iovad));
 
 	/* If the FQ fails we can simply fall back to strict mode */
 	if (domain->type == IOMMU_DOMAIN_DMA_FQ && iommu_dma_init_fq(domain))
@@ -450,7 +473,7 @@ static dma_addr_t iommu_dma_alloc_iova(struct iommu_domain *domain,
 	 * rounding up anything cacheable to make sure that can't happen. The
 	 * order of the unadjusted size will still match upon freeing.
 	 */
-	if (iova_len < (1 << (IOVA_RANGE_CACHE_MAX_SIZE - 1)))
+	if (iova_len < iova_rcache_range_max(iovad))
 		iova_len = roundup_pow_of_two(iova_len);
 
 	dma_limit = min_not_zero(dma_limit, dev->bus_dma_limit);
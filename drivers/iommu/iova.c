@@ -21,7 +21,8 @@ static bool iova_rcache_insert(struct iova_domain *iovad,
 static unsigned long iova_rcache_get(struct iova_domain *iovad,
 				     unsigned long size,
 				     unsigned long limit_pfn);
-static void init_iova_rcaches(struct iova_domain *iovad);
+static void init_iova_rcaches(struct iova_domain *iovad,
+			      unsigned int max_size);
 static void free_cpu_cached_iovas(unsigned int cpu, struct iova_domain *iovad);
 static void free_iova_rcaches(struct iova_domain *iovad);
 static void fq_destroy_all_entries(struct iova_domain *iovad);
@@ -69,10 +70,32 @@ init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 	rb_link_node(&iovad->anchor.node, NULL, &iovad->rbroot.rb_node);
 	rb_insert_color(&iovad->anchor.node, &iovad->rbroot);
 	cpuhp_state_add_instance_nocalls(CPUHP_IOMMU_IOVA_DEAD, &iovad->cpuhp_dead);
-	init_iova_rcaches(iovad);
+	init_iova_rcaches(iovad, IOVA_RANGE_CACHE_MAX_SIZE);
 }
 EXPORT_SYMBOL_GPL(init_iova_domain);
 
+/**
+ * iova_domain_set_rcache_max - set the range cache size classes of a domain
+ * @iovad: - iova domain in question, not used for allocations yet
+ * @max_size: - log of the largest cached range size (in pages), plus one
+ * Ranges of up to 2^(@max_size - 1) pages are then served by the per-cpu
+ * caches, larger ones always go to the rbtree.  Callers rounding sizes up
+ * for the caches must use iova_rcache_range_max() to decide what to round.
+ */
+int iova_domain_set_rcache_max(struct iova_domain *iovad,
+			       unsigned int max_size)
+{
+	if (!max_size || max_size > IOVA_RANGE_CACHE_MAX_LIMIT)
+		return -EINVAL;
+	if (max_size == iovad->rcache_max_size)
+		return 0;
+
+	free_iova_rcaches(iovad);
+	init_iova_rcaches(iovad, max_size);
+	return iovad->rcache_max_size == max_size ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL_GPL(iova_domain_set_rcache_max);
+
 static bool has_iova_flush_queue(struct iova_domain *iovad)
 {
 	return !!iovad->fq;
@@ -798,10 +821,14 @@ EXPORT_SYMBOL_GPL(reserve_iova);
  * dynamic size tuning described in the paper.
  */
 
-#define IOVA_MAG_SIZE 128
+/* 127 pfns plus the header make a magazine a power of two in size */
+#define IOVA_MAG_SIZE 127
 
 struct iova_magazine {
-	unsigned long size;
+	union {
+		unsigned long size;
+		struct iova_magazine *next;	/* in the depot, always full */
+	};
 	unsigned long pfns[IOVA_MAG_SIZE];
 };
 
@@ -884,20 +911,65 @@ static void iova_magazine_push(struct iova_magazine *mag, unsigned long pfn)
 	mag->pfns[mag->size++] = pfn;
 }
 
-static void init_iova_rcaches(struct iova_domain *iovad)
+/* Called with rcache->lock held */
+static void iova_depot_push(struct iova_rcache *rcache,
+			    struct iova_magazine *mag)
+{
+	mag->next = rcache->depot;
+	rcache->depot = mag;
+	rcache->depot_size++;
+}
+
+/* Called with rcache->lock held, the depot must not be empty */
+static struct iova_magazine *iova_depot_pop(struct iova_rcache *rcache)
+{
+	struct iova_magazine *mag = rcache->depot;
+
+	rcache->depot = mag->next;
+	rcache->depot_size--;
+	mag->size = IOVA_MAG_SIZE;
+	return mag;
+}
+
+/*
+ * The depot overflows when ranges are freed on some cpus much faster than
+ * they are allocated on the others.  Rather than handing the ranges back to
+ * the rbtree, which is what the caches are there to avoid, let it grow up
+ * to a limit; it shrinks back when the caches get flushed.
+ */
+static bool iova_depot_grow(struct iova_rcache *rcache)
+{
+	if (rcache->depot_max >= MAX_GLOBAL_MAGS_LIMIT)
+		return false;
+
+	rcache->depot_max *= 2;
+	return true;
+}
+
+static void init_iova_rcaches(struct iova_domain *iovad,
+			      unsigned int max_size)
 {
 	struct iova_cpu_rcache *cpu_rcache;
 	struct iova_rcache *rcache;
 	unsigned int cpu;
 	int i;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+	iovad->rcache_max_size = 0;
+	iovad->rcaches = kcalloc(max_size, sizeof(*iovad->rcaches), GFP_KERNEL);
+	if (WARN_ON(!iovad->rcaches))
+		return;
+
+	for (i = 0; i < max_size; ++i) {
 		rcache = &iovad->rcaches[i];
 		spin_lock_init(&rcache->lock);
 		rcache->depot_size = 0;
+		rcache->depot_max = MAX_GLOBAL_MAGS;
+		rcache->depot = NULL;
 		rcache->cpu_rcaches = __alloc_percpu(sizeof(*cpu_rcache), cache_line_size());
+		/* the smaller size classes are still usable */
 		if (WARN_ON(!rcache->cpu_rcaches))
-			continue;
+			break;
+		iovad->rcache_max_size = i + 1;
 		for_each_possible_cpu(cpu) {
 			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
 			spin_lock_init(&cpu_rcache->lock);
@@ -935,9 +1007,9 @@ static bool __iova_rcache_insert(struct iova_domain *iovad,
 
 		if (new_mag) {
 			spin_lock(&rcache->lock);
-			if (rcache->depot_size < MAX_GLOBAL_MAGS) {
-				rcache->depot[rcache->depot_size++] =
-						cpu_rcache->loaded;
+			if (rcache->depot_size < rcache->depot_max ||
+			    iova_depot_grow(rcache)) {
+				iova_depot_push(rcache, cpu_rcache->loaded);
 			} else {
 				mag_to_free = cpu_rcache->loaded;
 			}
@@ -966,7 +1038,7 @@ static bool iova_rcache_insert(struct iova_domain *iovad, unsigned long pfn,
 {
 	unsigned int log_size = order_base_2(size);
 
-	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE)
+	if (log_size >= iovad->rcache_max_size)
 		return false;
 
 	return __iova_rcache_insert(iovad, &iovad->rcaches[log_size], pfn);
@@ -997,7 +1069,7 @@ static unsigned long __iova_rcache_get(struct iova_rcache *rcache,
 		spin_lock(&rcache->lock);
 		if (rcache->depot_size > 0) {
 			iova_magazine_free(cpu_rcache->loaded);
-			cpu_rcache->loaded = rcache->depot[--rcache->depot_size];
+			cpu_rcache->loaded = iova_depot_pop(rcache);
 			has_pfn = true;
 		}
 		spin_unlock(&rcache->lock);
@@ -1022,7 +1094,7 @@ static unsigned long iova_rcache_get(struct iova_domain *iovad,
 {
 	unsigned int log_size = order_base_2(size);
 
-	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE)
+	if (log_size >= iovad->rcache_max_size)
 		return 0;
 
 	return __iova_rcache_get(&iovad->rcaches[log_size], limit_pfn - size);
@@ -1036,9 +1108,9 @@ static void free_iova_rcaches(struct iova_domain *iovad)
 	struct iova_rcache *rcache;
 	struct iova_cpu_rcache *cpu_rcache;
 	unsigned int cpu;
-	int i, j;
+	int i;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+	for (i = 0; i < iovad->rcache_max_size; ++i) {
 		rcache = &iovad->rcaches[i];
 		for_each_possible_cpu(cpu) {
 			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
@@ -1046,9 +1118,12 @@ static void free_iova_rcaches(struct iova_domain *iovad)
 			iova_magazine_free(cpu_rcache->prev);
 		}
 		free_percpu(rcache->cpu_rcaches);
-		for (j = 0; j < rcache->depot_size; ++j)
-			iova_magazine_free(rcache->depot[j]);
+		while (rcache->depot_size)
+			iova_magazine_free(iova_depot_pop(rcache));
 	}
+	kfree(iovad->rcaches);
+	iovad->rcaches = NULL;
+	iovad->rcache_max_size = 0;
 }
 
 /*
@@ -1061,7 +1136,7 @@ static void free_cpu_cached_iovas(unsigned int cpu, struct iova_domain *iovad)
 	unsigned long flags;
 	int i;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+	for (i = 0; i < iovad->rcache_max_size; ++i) {
 		rcache = &iovad->rcaches[i];
 		cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
 		spin_lock_irqsave(&cpu_rcache->lock, flags);
@@ -1078,16 +1153,19 @@ static void free_global_cached_iovas(struct iova_domain *iovad)
 {
 	struct iova_rcache *rcache;
 	unsigned long flags;
-	int i, j;
+	int i;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+	for (i = 0; i < iovad->rcache_max_size; ++i) {
 		rcache = &iovad->rcaches[i];
 		spin_lock_irqsave(&rcache->lock, flags);
-		for (j = 0; j < rcache->depot_size; ++j) {
-			iova_magazine_free_pfns(rcache->depot[j], iovad);
-			iova_magazine_free(rcache->depot[j]);
+		while (rcache->depot_size) {
+			struct iova_magazine *mag = iova_depot_pop(rcache);
+
+			iova_magazine_free_pfns(mag, iovad);
+			iova_magazine_free(mag);
 		}
-		rcache->depot_size = 0;
+		/* whatever made it grow is over, it is out of space now */
+		rcache->depot_max = MAX_GLOBAL_MAGS;
 		spin_unlock_irqrestore(&rcache->lock, flags);
 	}
 }
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * bcache read admission policies
+ *
+ * check_should_bypass() decides whether a request goes to the cache at all;
+ * once the hard reasons not to cache (cache mode, unaligned, full cache...)
+ * are ruled out, whether a read is worth caching is up to the admission
+ * policy of the cached device.
+ *
+ * The reuse based policies track bucket sized regions of the backing device:
+ * a one-shot scan touches each region once and so is never admitted, while a
+ * large read of a region that keeps being read is, whatever the sequential
+ * cutoff says.
+ */
+
+#include "bcache.h"
+#include "admit.h"
+
+#include <linux/hash.h>
+#include <linux/mm.h>
+
+#include <trace/events/bcache.h>
+
+struct bch_admit_ops {
+	/* size of the private state, allocated zeroed */
+	size_t		state_size;
+	bool		(*admit)(struct cached_dev *dc, void *state,
+				 struct bio *bio, unsigned int sectors);
+};
+
+static inline u64 bch_admit_region(struct cached_dev *dc, struct bio *bio)
+{
+	return bio->bi_iter.bi_sector >> dc->disk.c->bucket_bits;
+}
+
+/* Sequential: bypass streams longer than sequential_cutoff */
+
+static bool bch_admit_sequential(struct cached_dev *dc, void *state,
+				 struct bio *bio, unsigned int sectors)
+{
+	if (dc->sequential_cutoff &&
+	    sectors >= dc->sequential_cutoff >> 9) {
+		trace_bcache_bypass_sequential(bio);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Ghost: remember the last regions read in a direct mapped table, admit
+ * reads of regions found there.  A region is cached from its second read
+ * on, provided no more than about GHOST_SIZE other regions were read since.
+ */
+
+#define GHOST_BITS	14
+#define GHOST_SIZE	(1 << GHOST_BITS)
+
+struct bch_admit_ghost {
+	u64		tag[GHOST_SIZE];	/* region + 1, 0 if empty */
+};
+
+static bool bch_admit_ghost(struct cached_dev *dc, void *state,
+			    struct bio *bio, unsigned int sectors)
+{
+	struct bch_admit_ghost *g = state;
+	u64 region = bch_admit_region(dc, bio);
+	u64 *tag = &g->tag[hash_64(region, GHOST_BITS)];
+	bool seen = *tag == region + 1;
+
+	*tag = region + 1;
+	return seen;
+}
+
+/*
+ * Frequency: estimate how often each region was read with a count-min
+ * sketch of 4 bit counters, halved every SKETCH_SAMPLES reads so that old
+ * reads are forgotten.  Reads of regions estimated to have been read at
+ * least SKETCH_ADMIT times are admitted.
+ */
+
+#define SKETCH_BITS	14
+#define SKETCH_WIDTH	(1 << SKETCH_BITS)
+#define SKETCH_ROWS	4
+#define SKETCH_MAX	15
+#define SKETCH_SAMPLES	(10 * SKETCH_WIDTH)
+#define SKETCH_ADMIT	2
+
+struct bch_admit_sketch {
+	unsigned int	samples;
+	union {
+		u8	count[SKETCH_ROWS][SKETCH_WIDTH];
+		u64	words[SKETCH_ROWS * SKETCH_WIDTH / sizeof(u64)];
+	};
+};
+
+static const u64 sketch_seeds[SKETCH_ROWS] = {
+	0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+	0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL,
+};
+
+static void bch_admit_sketch_age(struct bch_admit_sketch *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(s->words); i++)
+		s->words[i] = (s->words[i] >> 1) & 0x7f7f7f7f7f7f7f7fULL;
+	s->samples /= 2;
+}
+
+static bool bch_admit_frequency(struct cached_dev *dc, void *state,
+				struct bio *bio, unsigned int sectors)
+{
+	struct bch_admit_sketch *s = state;
+	u64 region = bch_admit_region(dc, bio);
+	u8 *c[SKETCH_ROWS];
+	u8 min = SKETCH_MAX;
+	unsigned int i;
+
+	for (i = 0; i < SKETCH_ROWS; i++) {
+		c[i] = &s->count[i][hash_64(region ^ sketch_seeds[i],
+					    SKETCH_BITS)];
+		min = min(min, *c[i]);
+	}
+
+	/* conservative update: only the smallest counters grow */
+	if (min < SKETCH_MAX) {
+		for (i = 0; i < SKETCH_ROWS; i++)
+			if (*c[i] == min)
+				(*c[i])++;
+		min++;
+	}
+
+	if (++s->samples >= SKETCH_SAMPLES)
+		bch_admit_sketch_age(s);
+
+	return min >= SKETCH_ADMIT;
+}
+
+static const struct bch_admit_ops bch_admit_ops[BCH_ADMIT_NR] = {
+	[BCH_ADMIT_SEQUENTIAL] = {
+		.admit		= bch_admit_sequential,
+	},
+	[BCH_ADMIT_GHOST] = {
+		.state_size	= sizeof(struct bch_admit_ghost),
+		.admit		= bch_admit_ghost,
+	},
+	[BCH_ADMIT_FREQUENCY] = {
+		.state_size	= sizeof(struct bch_admit_sketch),
+		.admit		= bch_admit_frequency,
+	},
+};
+
+/*
+ * Called for reads check_should_bypass() would otherwise cache, with the
+ * length of the sequential stream the read is part of, in sectors.
+ */
+bool bch_admit_read(struct cached_dev *dc, struct bio *bio,
+		    unsigned int sectors)
+{
+	struct bch_admit *a = &dc->admit;
+	bool admit;
+
+	if (READ_ONCE(a->policy) == BCH_ADMIT_SEQUENTIAL) {
+		admit = bch_admit_sequential(dc, NULL, bio, sectors);
+	} else {
+		spin_lock(&a->lock);
+		admit = bch_admit_ops[a->policy].admit(dc, a->state, bio,
+						       sectors);
+		spin_unlock(&a->lock);
+	}
+
+	atomic64_inc(admit ? &a->admitted : &a->rejected);
+	return admit;
+}
+
+int bch_admit_set_policy(struct cached_dev *dc, unsigned int policy)
+{
+	struct bch_admit *a = &dc->admit;
+	void *state = NULL, *old;
+
+	if (policy >= BCH_ADMIT_NR)
+		return -EINVAL;
+	if (policy == READ_ONCE(a->policy))
+		return 0;
+
+	if (bch_admit_ops[policy].state_size) {
+		state = kvzalloc(bch_admit_ops[policy].state_size, GFP_KERNEL);
+		if (!state)
+			return -ENOMEM;
+	}
+
+	spin_lock(&a->lock);
+	old = a->state;
+	a->state = state;
+	WRITE_ONCE(a->policy, policy);
+	spin_unlock(&a->lock);
+
+	kvfree(old);
+	return 0;
+}
+
+void bch_admit_clear_stats(struct cached_dev *dc)
+{
+	atomic64_set(&dc->admit.admitted, 0);
+	atomic64_set(&dc->admit.rejected, 0);
+}
+
+void bch_admit_init(struct cached_dev *dc)
+{
+	struct bch_admit *a = &dc->admit;
+
+	spin_lock_init(&a->lock);
+	a->policy = BCH_ADMIT_SEQUENTIAL;
+	a->state = NULL;
+	bch_admit_clear_stats(dc);
+}
+
+void bch_admit_exit(struct cached_dev *dc)
+{
+	kvfree(dc->admit.state);
+	dc->admit.state = NULL;
+}
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _BCACHE_ADMIT_H_
+#define _BCACHE_ADMIT_H_
+
+/*
+ * Read admission policies, index into the list shown in sysfs:
+ *
+ * sequential:	reads are cached unless they are part of a stream longer than
+ *		sequential_cutoff (the historic behaviour)
+ * ghost:	a read is cached if its bucket sized region of the backing
+ *		device was read recently, whatever its size
+ * frequency:	a read is cached if its region was read at least twice
+ *		recently, according to a decaying count-min sketch
+ *
+ * Writes are always handled as in "sequential".
+ */
+#define BCH_ADMIT_SEQUENTIAL	0
+#define BCH_ADMIT_GHOST		1
+#define BCH_ADMIT_FREQUENCY	2
+#define BCH_ADMIT_NR		3
+
+struct cached_dev;
+struct bio;
+
+struct bch_admit {
+	spinlock_t		lock;
+	unsigned int		policy;
+	void			*state;		/* policy private, under lock */
+
+	/* reads cached/not cached by the policy, reset by clear_stats */
+	atomic64_t		admitted;
+	atomic64_t		rejected;
+};
+
+void bch_admit_init(struct cached_dev *dc);
+void bch_admit_exit(struct cached_dev *dc);
+int bch_admit_set_policy(struct cached_dev *dc, unsigned int policy);
+void bch_admit_clear_stats(struct cached_dev *dc);
+bool bch_admit_read(struct cached_dev *dc, struct bio *bio,
+		    unsigned int sectors);
+
+#endif /* _BCACHE_ADMIT_H_ */
@@ -218,6 +218,7 @@ BITMASK(GC_MOVE, struct bucket, gc_mark, 15, 1);
 
 #include "journal.h"
 #include "stats.h"
+#include "admit.h"
 struct search;
 struct btree;
 struct keybuf;
@@ -361,6 +362,7 @@ struct cached_dev {
 	spinlock_t		io_lock;
 
 	struct cache_accounting	accounting;
+	struct bch_admit	admit;
 
 	/* The rest of this all shows up in sysfs */
 	unsigned int		sequential_cutoff;
@@ -408,8 +408,10 @@ static bool check_should_bypass(struct cached_dev *dc, struct bio *bio)
 	}
 
 	congested = bch_get_congested(c);
-	if (!congested && !dc->sequential_cutoff)
-		goto rescale;
+	if (!congested && !dc->sequential_cutoff) {
+		sectors = 0;
+		goto admit;
+	}
 
 	spin_lock(&dc->io_lock);
 
@@ -439,7 +441,7 @@ static bool check_should_bypass(struct cached_dev *dc, struct bio *bio)
 	sectors = max(task->sequential_io,
 		      task->sequential_io_avg) >> 9;
 
-	if (dc->sequential_cutoff &&
+	if (op_is_write(bio_op(bio)) && dc->sequential_cutoff &&
 	    sectors >= dc->sequential_cutoff >> 9) {
 		trace_bcache_bypass_sequential(bio);
 		goto skip;
@@ -450,6 +452,10 @@ static bool check_should_bypass(struct cached_dev *dc, struct bio *bio)
 		goto skip;
 	}
 
+admit:
+	/* Whether a read is worth caching is up to the admission policy */
+	if (!op_is_write(bio_op(bio)) && !bch_admit_read(dc, bio, sectors))
+		goto skip;
 rescale:
 	bch_rescale_priorities(c, bio_sectors(bio));
 	return false;
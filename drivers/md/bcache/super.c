@@ -1375,6 +1375,8 @@ static void cached_dev_free(struct closure *cl)
 
 	mutex_unlock(&bch_register_lock);
 
+	bch_admit_exit(dc);
+
 	if (dc->sb_disk)
 		put_page(virt_to_page(dc->sb_disk));
 
@@ -1417,6 +1419,7 @@ static int cached_dev_init(struct cached_dev *dc, unsigned int block_size)
 	INIT_LIST_HEAD(&dc->io_lru);
 	spin_lock_init(&dc->io_lock);
 	bch_cache_accounting_init(&dc->accounting, &dc->disk.cl);
+	bch_admit_init(dc);
 
 	dc->sequential_cutoff		= 4 << 20;
 
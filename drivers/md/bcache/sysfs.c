@@ -34,6 +34,14 @@ static const char * const bch_reada_cache_policies[] = {
 	NULL
 };
 
+/* Default is 0 ("sequential"), indexed by BCH_ADMIT_* */
+static const char * const bch_admit_policies[] = {
+	"sequential",
+	"ghost",
+	"frequency",
+	NULL
+};
+
 /* Default is 0 ("auto") */
 static const char * const bch_stop_on_failure_modes[] = {
 	"auto",
@@ -111,6 +119,9 @@ rw_attribute(sequential_cutoff);
 rw_attribute(data_csum);
 rw_attribute(cache_mode);
 rw_attribute(readahead_cache_policy);
+rw_attribute(admit_policy);
+read_attribute(admit_admitted);
+read_attribute(admit_rejected);
 rw_attribute(stop_when_cache_set_failed);
 rw_attribute(writeback_metadata);
 rw_attribute(writeback_running);
@@ -187,6 +198,16 @@ SHOW(__bch_cached_dev)
 					      bch_reada_cache_policies,
 					      dc->cache_readahead_policy);
 
+	if (attr == &sysfs_admit_policy)
+		return bch_snprint_string_list(buf, PAGE_SIZE,
+					       bch_admit_policies,
+					       READ_ONCE(dc->admit.policy));
+
+	sysfs_printf(admit_admitted,	"%llu",
+		     (unsigned long long)atomic64_read(&dc->admit.admitted));
+	sysfs_printf(admit_rejected,	"%llu",
+		     (unsigned long long)atomic64_read(&dc->admit.rejected));
+
 	if (attr == &sysfs_stop_when_cache_set_failed)
 		return bch_snprint_string_list(buf, PAGE_SIZE,
 					       bch_stop_on_failure_modes,
@@ -364,8 +385,10 @@ STORE(__cached_dev)
 			    dc->sequential_cutoff,
 			    0, UINT_MAX);
 
-	if (attr == &sysfs_clear_stats)
+	if (attr == &sysfs_clear_stats) {
 		bch_cache_accounting_clear(&dc->accounting);
+		bch_admit_clear_stats(dc);
+	}
 
 	if (attr == &sysfs_running &&
 	    strtoul_or_return(buf)) {
@@ -394,6 +417,16 @@ STORE(__cached_dev)
 			dc->cache_readahead_policy = v;
 	}
 
+	if (attr == &sysfs_admit_policy) {
+		v = __sysfs_match_string(bch_admit_policies, -1, buf);
+		if (v < 0)
+			return v;
+
+		v = bch_admit_set_policy(dc, v);
+		if (v)
+			return v;
+	}
+
 	if (attr == &sysfs_stop_when_cache_set_failed) {
 		v = __sysfs_match_string(bch_stop_on_failure_modes, -1, buf);
 		if (v < 0)
@@ -509,6 +542,9 @@ static struct attribute *bch_cached_dev_files[] = {
 #endif
 	&sysfs_cache_mode,
 	&sysfs_readahead_cache_policy,
+	&sysfs_admit_policy,
+	&sysfs_admit_admitted,
+	&sysfs_admit_rejected,
 	&sysfs_stop_when_cache_set_failed,
 	&sysfs_writeback_metadata,
 	&sysfs_writeback_running,
@@ -13,7 +13,9 @@
 #include <net/tcp.h>
 #include <linux/blk-mq.h>
 #include <crypto/hash.h>
+#include <linux/crc32c.h>
 #include <net/busy_poll.h>
+#include <asm/unaligned.h>
 
 #include "nvme.h"
 #include "fabrics.h"
@@ -102,8 +104,8 @@ struct nvme_tcp_queue {
 
 	bool			hdr_digest;
 	bool			data_digest;
-	struct ahash_request	*rcv_hash;
 	struct ahash_request	*snd_hash;
+	u32			rcv_crc;
 	__le32			exp_ddgst;
 	__le32			recv_ddgst;
 
@@ -378,9 +380,9 @@ static int nvme_tcp_verify_hdgst(struct nvme_tcp_queue *queue,
 		return -EPROTO;
 	}
 
-	recv_digest = *(__le32 *)(pdu + hdr->hlen);
-	nvme_tcp_hdgst(queue->rcv_hash, pdu, pdu_len);
-	exp_digest = *(__le32 *)(pdu + hdr->hlen);
+	/* @pdu may point into the skb, leave it untouched */
+	recv_digest = get_unaligned((__le32 *)(pdu + hdr->hlen));
+	exp_digest = cpu_to_le32(~crc32c(~0, pdu, pdu_len));
 	if (recv_digest != exp_digest) {
 		dev_err(queue->ctrl->ctrl.device,
 			"header digest error: recv %#x expected %#x\n",
@@ -406,7 +408,7 @@ static int nvme_tcp_check_ddgst(struct nvme_tcp_queue *queue, void *pdu)
 		nvme_tcp_queue_id(queue));
 		return -EPROTO;
 	}
-	crypto_ahash_init(queue->rcv_hash);
+	queue->rcv_crc = ~0;
 
 	return 0;
 }
@@ -653,49 +655,105 @@ static int nvme_tcp_handle_r2t(struct nvme_tcp_queue *queue,
 	return 0;
 }
 
+/*
+ * Point at @len bytes at @offset of @skb when they sit within its linear
+ * area or within a single lowmem frag, so that the PDU header can be
+ * parsed in place.  NULL means it has to be staged in queue->pdu.
+ */
+static void *nvme_tcp_skb_ptr(struct sk_buff *skb, unsigned int offset,
+		size_t len)
+{
+	unsigned int headlen = skb_headlen(skb);
+	void *ptr = NULL;
+	int i;
+
+	if (offset + len <= headlen) {
+		ptr = skb->data + offset;
+		goto out;
+	}
+	if (offset < headlen)
+		return NULL;
+
+	offset -= headlen;
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+		skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+		unsigned int size = skb_frag_size(frag);
+
+		if (offset >= size) {
+			offset -= size;
+			continue;
+		}
+		if (offset + len > size || PageHighMem(skb_frag_page(frag)))
+			return NULL;
+		ptr = skb_frag_address(frag) + offset;
+		break;
+	}
+out:
+	if (!IS_ENABLED(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) &&
+	    !IS_ALIGNED((unsigned long)ptr, sizeof(u64)))
+		return NULL;
+	return ptr;
+}
+
 static int nvme_tcp_recv_pdu(struct nvme_tcp_queue *queue, struct sk_buff *skb,
 		unsigned int *offset, size_t *len)
 {
+	size_t pdu_len = queue->pdu_offset + queue->pdu_remaining;
 	struct nvme_tcp_hdr *hdr;
-	char *pdu = queue->pdu;
-	size_t rcv_len = min_t(size_t, *len, queue->pdu_remaining);
+	char *pdu = NULL;
 	int ret;
 
-	ret = skb_copy_bits(skb, *offset,
-		&pdu[queue->pdu_offset], rcv_len);
-	if (unlikely(ret))
-		return ret;
+	/* the whole header is in this skb, no need to stage it */
+	if (!queue->pdu_offset && *len >= queue->pdu_remaining)
+		pdu = nvme_tcp_skb_ptr(skb, *offset, queue->pdu_remaining);
 
-	queue->pdu_remaining -= rcv_len;
-	queue->pdu_offset += rcv_len;
-	*offset += rcv_len;
-	*len -= rcv_len;
-	if (queue->pdu_remaining)
-		return 0;
+	if (pdu) {
+		*offset += queue->pdu_remaining;
+		*len -= queue->pdu_remaining;
+		queue->pdu_remaining = 0;
+	} else {
+		size_t rcv_len = min_t(size_t, *len, queue->pdu_remaining);
 
-	hdr = queue->pdu;
+		pdu = queue->pdu;
+		ret = skb_copy_bits(skb, *offset,
+			&pdu[queue->pdu_offset], rcv_len);
+		if (unlikely(ret))
+			return ret;
+
+		queue->pdu_remaining -= rcv_len;
+		queue->pdu_offset += rcv_len;
+		*offset += rcv_len;
+		*len -= rcv_len;
+		if (queue->pdu_remaining)
+			return 0;
+	}
+
+	hdr = (void *)pdu;
 	if (queue->hdr_digest) {
-		ret = nvme_tcp_verify_hdgst(queue, queue->pdu, hdr->hlen);
+		ret = nvme_tcp_verify_hdgst(queue, pdu, hdr->hlen);
 		if (unlikely(ret))
 			return ret;
 	}
 
 
 	if (queue->data_digest) {
-		ret = nvme_tcp_check_ddgst(queue, queue->pdu);
+		ret = nvme_tcp_check_ddgst(queue, pdu);
 		if (unlikely(ret))
 			return ret;
 	}
 
 	switch (hdr->type) {
 	case nvme_tcp_c2h_data:
+		/* the data and digest states still need the header */
+		if (pdu != queue->pdu)
+			memcpy(queue->pdu, pdu, pdu_len);
 		return nvme_tcp_handle_c2h_data(queue, (void *)queue->pdu);
 	case nvme_tcp_rsp:
 		nvme_tcp_init_recv_ctx(queue);
-		return nvme_tcp_handle_comp(queue, (void *)queue->pdu);
+		return nvme_tcp_handle_comp(queue, (void *)pdu);
 	case nvme_tcp_r2t:
 		nvme_tcp_init_recv_ctx(queue);
-		return nvme_tcp_handle_r2t(queue, (void *)queue->pdu);
+		return nvme_tcp_handle_r2t(queue, (void *)pdu);
 	default:
 		dev_err(queue->ctrl->ctrl.device,
 			"unsupported pdu type (%d)\n", hdr->type);
@@ -711,6 +769,36 @@ static inline void nvme_tcp_end_request(struct request *rq, u16 status)
 		nvme_complete_rq(rq);
 }
 
+/*
+ * Copy @len bytes at @offset of @skb to @iter and fold them into the data
+ * digest in the same pass, while they are hot in the cache, rather than
+ * going through an ahash request for every fragment.
+ */
+static int nvme_tcp_copy_and_crc(struct nvme_tcp_queue *queue,
+		struct sk_buff *skb, unsigned int offset, struct iov_iter *iter,
+		unsigned int len)
+{
+	struct skb_seq_state st;
+	unsigned int consumed = 0;
+	const u8 *data;
+
+	skb_prepare_seq_read(skb, offset, offset + len, &st);
+	while (consumed < len) {
+		unsigned int n = skb_seq_read(consumed, &data, &st);
+
+		if (!n)
+			break;
+		n = min(n, len - consumed);
+		queue->rcv_crc = crc32c(queue->rcv_crc, data, n);
+		if (copy_to_iter(data, n, iter) != n)
+			break;
+		consumed += n;
+	}
+	skb_abort_seq_read(&st);
+
+	return consumed == len ? 0 : -EFAULT;
+}
+
 static int nvme_tcp_recv_data(struct nvme_tcp_queue *queue, struct sk_buff *skb,
 			      unsigned int *offset, size_t *len)
 {
@@ -748,8 +836,8 @@ static int nvme_tcp_recv_data(struct nvme_tcp_queue *queue, struct sk_buff *skb,
 				iov_iter_count(&req->iter));
 
 		if (queue->data_digest)
-			ret = skb_copy_and_hash_datagram_iter(skb, *offset,
-				&req->iter, recv_len, queue->rcv_hash);
+			ret = nvme_tcp_copy_and_crc(queue, skb, *offset,
+				&req->iter, recv_len);
 		else
 			ret = skb_copy_datagram_iter(skb, *offset,
 					&req->iter, recv_len);
@@ -767,7 +855,7 @@ static int nvme_tcp_recv_data(struct nvme_tcp_queue *queue, struct sk_buff *skb,
 
 	if (!queue->data_remaining) {
 		if (queue->data_digest) {
-			nvme_tcp_ddgst_final(queue->rcv_hash, &queue->exp_ddgst);
+			queue->exp_ddgst = cpu_to_le32(~queue->rcv_crc);
 			queue->ddgst_remaining = NVME_TCP_DIGEST_LENGTH;
 		} else {
 			if (pdu->hdr.flags & NVME_TCP_F_DATA_SUCCESS) {
@@ -1164,9 +1252,8 @@ static void nvme_tcp_io_work(struct work_struct *w)
 
 static void nvme_tcp_free_crypto(struct nvme_tcp_queue *queue)
 {
-	struct crypto_ahash *tfm = crypto_ahash_reqtfm(queue->rcv_hash);
+	struct crypto_ahash *tfm = crypto_ahash_reqtfm(queue->snd_hash);
 
-	ahash_request_free(queue->rcv_hash);
 	ahash_request_free(queue->snd_hash);
 	crypto_free_ahash(tfm);
 }
@@ -1184,14 +1271,7 @@ static int nvme_tcp_alloc_crypto(struct nvme_tcp_queue *queue)
 		goto free_tfm;
 	ahash_request_set_callback(queue->snd_hash, 0, NULL, NULL);
 
-	queue->rcv_hash = ahash_request_alloc(tfm, GFP_KERNEL);
-	if (!queue->rcv_hash)
-		goto free_snd_hash;
-	ahash_request_set_callback(queue->rcv_hash, 0, NULL, NULL);
-
 	return 0;
-free_snd_hash:
-	ahash_request_free(queue->snd_hash);
 free_tfm:
 	crypto_free_ahash(tfm);
 	return -ENOMEM;
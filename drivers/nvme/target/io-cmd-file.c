@@ -13,6 +13,10 @@
 #define NVMET_MAX_MPOOL_BVEC		16
 #define NVMET_MIN_MPOOL_OBJ		16
 
+static void nvmet_file_retry_work(struct work_struct *w);
+static void nvmet_file_flush_work(struct work_struct *w);
+static void nvmet_file_write_zeroes_work(struct work_struct *w);
+
 int nvmet_file_ns_revalidate(struct nvmet_ns *ns)
 {
 	struct kstat stat;
@@ -30,6 +34,16 @@ void nvmet_file_ns_disable(struct nvmet_ns *ns)
 	if (ns->file) {
 		if (ns->buffered_io)
 			flush_workqueue(buffered_io_wq);
+		if (ns->file_ctx) {
+			int cpu;
+
+			for_each_possible_cpu(cpu)
+				flush_work(&per_cpu_ptr(ns->file_ctx, cpu)->work);
+			free_percpu(ns->file_ctx);
+			ns->file_ctx = NULL;
+		}
+		flush_work(&ns->flush_work);
+		flush_work(&ns->zeroes_work);
 		mempool_destroy(ns->bvec_pool);
 		ns->bvec_pool = NULL;
 		kmem_cache_destroy(ns->bvec_cache);
@@ -42,11 +56,16 @@ void nvmet_file_ns_disable(struct nvmet_ns *ns)
 int nvmet_file_ns_enable(struct nvmet_ns *ns)
 {
 	int flags = O_RDWR | O_LARGEFILE;
-	int ret;
+	int ret, cpu;
 
 	if (!ns->buffered_io)
 		flags |= O_DIRECT;
 
+	init_llist_head(&ns->flush_reqs);
+	INIT_WORK(&ns->flush_work, nvmet_file_flush_work);
+	init_llist_head(&ns->zeroes_reqs);
+	INIT_WORK(&ns->zeroes_work, nvmet_file_write_zeroes_work);
+
 	ns->file = filp_open(ns->device_path, flags, 0);
 	if (IS_ERR(ns->file)) {
 		ret = PTR_ERR(ns->file);
@@ -83,6 +102,19 @@ int nvmet_file_ns_enable(struct nvmet_ns *ns)
 		goto err;
 	}
 
+	ns->file_ctx = alloc_percpu(struct nvmet_file_ctx);
+	if (!ns->file_ctx) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	for_each_possible_cpu(cpu) {
+		struct nvmet_file_ctx *ctx = per_cpu_ptr(ns->file_ctx, cpu);
+
+		ctx->ns = ns;
+		init_llist_head(&ctx->reqs);
+		INIT_WORK(&ctx->work, nvmet_file_retry_work);
+	}
+
 	return ret;
 err:
 	ns->size = 0;
@@ -121,10 +153,61 @@ static ssize_t nvmet_file_submit_bvec(struct nvmet_req *req, loff_t pos,
 	iocb->ki_pos = pos;
 	iocb->ki_filp = req->ns->file;
 	iocb->ki_flags = ki_flags | iocb_flags(req->ns->file);
+	if (ki_flags & IOCB_WAITQ)
+		iocb->ki_waitq = &req->f.wpq;
 
 	return call_iter(iocb, &iter);
 }
 
+static void nvmet_file_queue_retry(struct nvmet_req *req)
+{
+	int cpu = raw_smp_processor_id();
+	struct nvmet_file_ctx *ctx = per_cpu_ptr(req->ns->file_ctx, cpu);
+
+	if (llist_add(&req->f.lnode, &ctx->reqs))
+		queue_work_on(cpu, buffered_io_wq, &ctx->work);
+}
+
+/*
+ * Called by the page cache, possibly from interrupt context, once the
+ * page a buffered read was waiting for is unlocked.  The read cannot be
+ * issued from here, so hand it over to the submission context.
+ */
+static int nvmet_file_buf_wake(struct wait_queue_entry *wait, unsigned mode,
+		int sync, void *arg)
+{
+	struct wait_page_queue *wpq =
+		container_of(wait, struct wait_page_queue, wait);
+
+	if (!wake_page_match(wpq, arg))
+		return 0;
+
+	list_del_init(&wait->entry);
+	nvmet_file_queue_retry(wait->private);
+	return 1;
+}
+
+static void nvmet_file_init_waitq(struct nvmet_req *req)
+{
+	struct wait_page_queue *wpq = &req->f.wpq;
+
+	wpq->wait.func = nvmet_file_buf_wake;
+	wpq->wait.private = req;
+	wpq->wait.flags = 0;
+	INIT_LIST_HEAD(&wpq->wait.entry);
+}
+
+/*
+ * Buffered reads of files supporting async page waits need not block:
+ * instead of sleeping on a locked page, they get a callback once it is
+ * unlocked, just like io_uring does.
+ */
+static bool nvmet_file_can_waitq(struct nvmet_req *req)
+{
+	return req->cmd->rw.opcode == nvme_cmd_read &&
+		(req->ns->file->f_mode & FMODE_BUF_RASYNC);
+}
+
 static void nvmet_file_io_done(struct kiocb *iocb, long ret, long ret2)
 {
 	struct nvmet_req *req = container_of(iocb, struct nvmet_req, f.iocb);
@@ -196,18 +279,21 @@ static bool nvmet_file_execute_io(struct nvmet_req *req, int ki_flags)
 
 	/*
 	 * A NULL ki_complete ask for synchronous execution, which we want
-	 * for the IOCB_NOWAIT case.
+	 * for the IOCB_NOWAIT and IOCB_WAITQ cases.
 	 */
-	if (!(ki_flags & IOCB_NOWAIT))
+	if (!(ki_flags & (IOCB_NOWAIT | IOCB_WAITQ)))
 		req->f.iocb.ki_complete = nvmet_file_io_done;
+	if (ki_flags & IOCB_WAITQ)
+		nvmet_file_init_waitq(req);
 
 	ret = nvmet_file_submit_bvec(req, pos, bv_cnt, total_len, ki_flags);
 
 	switch (ret) {
 	case -EIOCBQUEUED:
+		/* with IOCB_WAITQ, nvmet_file_buf_wake() takes it from here */
 		return true;
 	case -EAGAIN:
-		if (WARN_ON_ONCE(!(ki_flags & IOCB_NOWAIT)))
+		if (WARN_ON_ONCE(!(ki_flags & (IOCB_NOWAIT | IOCB_WAITQ))))
 			goto complete;
 		return false;
 	case -EOPNOTSUPP:
@@ -216,7 +302,17 @@ static bool nvmet_file_execute_io(struct nvmet_req *req, int ki_flags)
 		 * IOCB_NOWAIT error case separately and retry without
 		 * IOCB_NOWAIT.
 		 */
-		if ((ki_flags & IOCB_NOWAIT))
+		if ((ki_flags & (IOCB_NOWAIT | IOCB_WAITQ)))
+			return false;
+		break;
+	default:
+		/*
+		 * A non-blocking attempt may stop short at the first page it
+		 * would have to wait for, without arming the waitqueue.  The
+		 * whole command is simply issued again, which is harmless.
+		 */
+		if ((ki_flags & (IOCB_NOWAIT | IOCB_WAITQ)) &&
+		    ret >= 0 && ret < total_len)
 			return false;
 		break;
 	}
@@ -239,6 +335,26 @@ static void nvmet_file_submit_buffered_io(struct nvmet_req *req)
 	queue_work(buffered_io_wq, &req->f.work);
 }
 
+/*
+ * Retry the reads whose pages got unlocked since they were parked, all
+ * of them from a single work item.  A read may park itself again on the
+ * next page it misses; only those which cannot wait asynchronously at
+ * all get a blocking work item of their own.
+ */
+static void nvmet_file_retry_work(struct work_struct *w)
+{
+	struct nvmet_file_ctx *ctx =
+		container_of(w, struct nvmet_file_ctx, work);
+	struct llist_node *list = llist_del_all(&ctx->reqs);
+	struct nvmet_req *req, *tmp;
+
+	list = llist_reverse_order(list);
+	llist_for_each_entry_safe(req, tmp, list, f.lnode) {
+		if (!nvmet_file_execute_io(req, IOCB_WAITQ))
+			nvmet_file_submit_buffered_io(req);
+	}
+}
+
 static void nvmet_file_execute_rw(struct nvmet_req *req)
 {
 	ssize_t nr_bvec = req->sg_cnt;
@@ -268,6 +384,9 @@ static void nvmet_file_execute_rw(struct nvmet_req *req)
 		if (likely(!req->f.mpool_alloc) &&
 				nvmet_file_execute_io(req, IOCB_NOWAIT))
 			return;
+		if (likely(!req->f.mpool_alloc) && nvmet_file_can_waitq(req) &&
+				nvmet_file_execute_io(req, IOCB_WAITQ))
+			return;
 		nvmet_file_submit_buffered_io(req);
 	} else
 		nvmet_file_execute_io(req, 0);
@@ -278,19 +397,31 @@ u16 nvmet_file_flush(struct nvmet_req *req)
 	return errno_to_nvme_status(req, vfs_fsync(req->ns->file, 1));
 }
 
+/*
+ * A single fsync covers all the flushes queued before it started, the
+ * ones coming in meanwhile get the next one.
+ */
 static void nvmet_file_flush_work(struct work_struct *w)
 {
-	struct nvmet_req *req = container_of(w, struct nvmet_req, f.work);
+	struct nvmet_ns *ns = container_of(w, struct nvmet_ns, flush_work);
+	struct llist_node *list = llist_del_all(&ns->flush_reqs);
+	struct nvmet_req *req, *tmp;
+	int ret;
+
+	if (!list)
+		return;
 
-	nvmet_req_complete(req, nvmet_file_flush(req));
+	ret = vfs_fsync(ns->file, 1);
+	llist_for_each_entry_safe(req, tmp, list, f.lnode)
+		nvmet_req_complete(req, errno_to_nvme_status(req, ret));
 }
 
 static void nvmet_file_execute_flush(struct nvmet_req *req)
 {
 	if (!nvmet_check_transfer_len(req, 0))
 		return;
-	INIT_WORK(&req->f.work, nvmet_file_flush_work);
-	schedule_work(&req->f.work);
+	if (llist_add(&req->f.lnode, &req->ns->flush_reqs))
+		queue_work(buffered_io_wq, &req->ns->flush_work);
 }
 
 static void nvmet_file_execute_discard(struct nvmet_req *req)
@@ -353,9 +484,8 @@ static void nvmet_file_execute_dsm(struct nvmet_req *req)
 	schedule_work(&req->f.work);
 }
 
-static void nvmet_file_write_zeroes_work(struct work_struct *w)
+static void nvmet_file_write_zeroes(struct nvmet_req *req)
 {
-	struct nvmet_req *req = container_of(w, struct nvmet_req, f.work);
 	struct nvme_write_zeroes_cmd *write_zeroes = &req->cmd->write_zeroes;
 	int mode = FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE;
 	loff_t offset;
@@ -375,12 +505,27 @@ static void nvmet_file_write_zeroes_work(struct work_struct *w)
 	nvmet_req_complete(req, ret < 0 ? errno_to_nvme_status(req, ret) : 0);
 }
 
+/*
+ * fallocate() serializes on the inode anyway, so a single work item per
+ * namespace runs the queued write zeroes commands in order.
+ */
+static void nvmet_file_write_zeroes_work(struct work_struct *w)
+{
+	struct nvmet_ns *ns = container_of(w, struct nvmet_ns, zeroes_work);
+	struct llist_node *list = llist_del_all(&ns->zeroes_reqs);
+	struct nvmet_req *req, *tmp;
+
+	list = llist_reverse_order(list);
+	llist_for_each_entry_safe(req, tmp, list, f.lnode)
+		nvmet_file_write_zeroes(req);
+}
+
 static void nvmet_file_execute_write_zeroes(struct nvmet_req *req)
 {
 	if (!nvmet_check_transfer_len(req, 0))
 		return;
-	INIT_WORK(&req->f.work, nvmet_file_write_zeroes_work);
-	schedule_work(&req->f.work);
+	if (llist_add(&req->f.lnode, &req->ns->zeroes_reqs))
+		queue_work(buffered_io_wq, &req->ns->zeroes_work);
 }
 
 u16 nvmet_file_parse_io_cmd(struct nvmet_req *req)
@@ -20,6 +20,8 @@
 #include <linux/blkdev.h>
 #include <linux/radix-tree.h>
 #include <linux/t10-pi.h>
+#include <linux/llist.h>
+#include <linux/pagemap.h>
 
 #define NVMET_DEFAULT_VS		NVME_VS(1, 3, 0)
 
@@ -55,6 +57,16 @@
 #define IPO_IATTR_CONNECT_SQE(x)	\
 	(cpu_to_le32(offsetof(struct nvmf_connect_command, x)))
 
+/*
+ * Per-cpu submission context of a file backed namespace: buffered reads
+ * woken up by the page cache are retried from here, in batches.
+ */
+struct nvmet_file_ctx {
+	struct nvmet_ns		*ns;
+	struct llist_head	reqs;
+	struct work_struct	work;
+};
+
 struct nvmet_ns {
 	struct percpu_ref	ref;
 	struct block_device	*bdev;
@@ -78,6 +90,11 @@ struct nvmet_ns {
 	struct completion	disable_done;
 	mempool_t		*bvec_pool;
 	struct kmem_cache	*bvec_cache;
+	struct nvmet_file_ctx __percpu *file_ctx;
+	struct llist_head	flush_reqs;
+	struct work_struct	flush_work;
+	struct llist_head	zeroes_reqs;
+	struct work_struct	zeroes_work;
 
 	int			use_p2pmem;
 	struct pci_dev		*p2p_dev;
@@ -332,6 +349,8 @@ struct nvmet_req {
 			struct kiocb            iocb;
 			struct bio_vec          *bvec;
 			struct work_struct      work;
+			struct llist_node	lnode;
+			struct wait_page_queue	wpq;
 		} f;
 		struct {
 			struct bio		inline_bio;
@@ -13,7 +13,10 @@
 #include <net/tcp.h>
 #include <linux/inet.h>
 #include <linux/llist.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <crypto/hash.h>
+#include <net/busy_poll.h>
 
 #include "nvmet.h"
 
@@ -39,9 +42,25 @@ module_param(idle_poll_period_usecs, int, 0644);
 MODULE_PARM_DESC(idle_poll_period_usecs,
 		"nvmet tcp io_work poll till idle time period in usecs");
 
+/* Define a time period (in usecs) that io_work() shall busy poll the
+ * socket for new commands and completed responses when it runs out of
+ * work, rather than going back to sleep.  Only effective with
+ * CONFIG_NET_RX_BUSY_POLL and a NIC which does busy polling.
+ */
+static int busy_poll_usecs;
+module_param(busy_poll_usecs, int, 0644);
+MODULE_PARM_DESC(busy_poll_usecs,
+		"nvmet tcp io_work busy poll time period in usecs");
+
+/* minimum budgets, they grow with the average queue depth */
 #define NVMET_TCP_RECV_BUDGET		8
 #define NVMET_TCP_SEND_BUDGET		8
 #define NVMET_TCP_IO_WORK_BUDGET	64
+#define NVMET_TCP_MAX_BUDGET		32
+
+/* responses gathered into a single sendmsg */
+#define NVMET_TCP_RSP_BATCH		16
+#define NVMET_TCP_BATCH_BUCKETS		5
 
 enum nvmet_tcp_send_state {
 	NVMET_TCP_SEND_DATA_PDU,
@@ -100,6 +119,15 @@ enum nvmet_tcp_queue_state {
 	NVMET_TCP_Q_DISCONNECTING,
 };
 
+struct nvmet_tcp_queue_stats {
+	u64			rsp_batches;
+	/* batches of 1, 2-3, 4-7, 8-15 and 16 responses */
+	u64			rsp_batch_hist[NVMET_TCP_BATCH_BUCKETS];
+	u64			io_work_requeues;
+	u64			busy_poll_hits;
+	u64			busy_poll_misses;
+};
+
 struct nvmet_tcp_queue {
 	struct socket		*sock;
 	struct nvmet_tcp_port	*port;
@@ -131,6 +159,15 @@ struct nvmet_tcp_queue {
 
 	unsigned long           poll_end;
 
+	/* io_work budgets, sized from the average queue depth */
+	int			nr_busy;
+	unsigned int		avg_depth;
+	unsigned int		recv_budget;
+	unsigned int		send_budget;
+	unsigned int		io_budget;
+	struct nvmet_tcp_queue_stats stats;
+	struct dentry		*dbg_file;
+
 	spinlock_t		state_lock;
 	enum nvmet_tcp_queue_state state;
 
@@ -163,6 +200,7 @@ static LIST_HEAD(nvmet_tcp_queue_list);
 static DEFINE_MUTEX(nvmet_tcp_queue_mutex);
 
 static struct workqueue_struct *nvmet_tcp_wq;
+static struct dentry *nvmet_tcp_dbg_dir;
 static const struct nvmet_fabrics_ops nvmet_tcp_ops;
 static void nvmet_tcp_free_cmd(struct nvmet_tcp_cmd *c);
 static void nvmet_tcp_finish_cmd(struct nvmet_tcp_cmd *cmd);
@@ -212,6 +250,7 @@ nvmet_tcp_get_cmd(struct nvmet_tcp_queue *queue)
 	if (!cmd)
 		return NULL;
 	list_del_init(&cmd->entry);
+	queue->nr_busy++;
 
 	cmd->rbytes_done = cmd->wbytes_done = 0;
 	cmd->pdu_len = 0;
@@ -227,6 +266,7 @@ static inline void nvmet_tcp_put_cmd(struct nvmet_tcp_cmd *cmd)
 		return;
 
 	list_add_tail(&cmd->entry, &cmd->queue->free_list);
+	cmd->queue->nr_busy--;
 }
 
 static inline int queue_cpu(struct nvmet_tcp_queue *queue)
@@ -776,12 +816,103 @@ static int nvmet_tcp_try_send_one(struct nvmet_tcp_queue *queue,
 	return 1;
 }
 
+static void nvmet_tcp_account_rsp_batch(struct nvmet_tcp_queue *queue,
+		int nr)
+{
+	queue->stats.rsp_batches++;
+	queue->stats.rsp_batch_hist[min(ilog2(nr),
+					NVMET_TCP_BATCH_BUCKETS - 1)]++;
+}
+
+/*
+ * Gather the plain responses at the head of the send list, those of
+ * commands without data to transfer, and push them out with a single
+ * sendmsg.  Commands with data are left for nvmet_tcp_try_send_one().
+ * Returns the number of responses fully sent.
+ */
+static int nvmet_tcp_try_send_rsp_batch(struct nvmet_tcp_queue *queue,
+		int budget)
+{
+	struct nvmet_tcp_cmd *cmds[NVMET_TCP_RSP_BATCH], *cmd, *tmp;
+	struct kvec iov[NVMET_TCP_RSP_BATCH];
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT };
+	u8 hdgst = nvmet_tcp_hdgst_len(queue);
+	int nr = 0, done = 0, i, ret;
+	size_t len = 0;
+
+	if (list_empty(&queue->resp_send_list))
+		nvmet_tcp_process_resp_list(queue);
+
+	budget = min(budget, NVMET_TCP_RSP_BATCH);
+	list_for_each_entry_safe(cmd, tmp, &queue->resp_send_list, entry) {
+		if (nr == budget || nvmet_tcp_need_data_out(cmd) ||
+		    nvmet_tcp_need_data_in(cmd))
+			break;
+		list_del_init(&cmd->entry);
+		queue->send_list_len--;
+		nvmet_setup_response_pdu(cmd);
+
+		cmds[nr] = cmd;
+		iov[nr].iov_base = cmd->rsp_pdu;
+		iov[nr].iov_len = sizeof(*cmd->rsp_pdu) + hdgst;
+		len += iov[nr].iov_len;
+		nr++;
+	}
+	if (!nr)
+		return 0;
+
+	if (nr < budget && queue->send_list_len)
+		msg.msg_flags |= MSG_MORE;
+	else
+		msg.msg_flags |= MSG_EOR;
+
+	ret = kernel_sendmsg(queue->sock, &msg, iov, nr, len);
+	len = max(ret, 0);
+	for (i = 0; i < nr && len >= iov[i].iov_len; i++) {
+		cmd = cmds[i];
+		len -= iov[i].iov_len;
+		kfree(cmd->iov);
+		sgl_free(cmd->req.sg);
+		nvmet_tcp_put_cmd(cmd);
+		done++;
+	}
+
+	/* a partially sent response has to be completed first */
+	if (i < nr && len) {
+		cmds[i]->offset = len;
+		queue->snd_cmd = cmds[i++];
+	}
+	/* and the ones not sent at all go back where they were */
+	while (nr > i) {
+		list_add(&cmds[--nr]->entry, &queue->resp_send_list);
+		queue->send_list_len++;
+	}
+
+	if (done)
+		nvmet_tcp_account_rsp_batch(queue, done);
+	if (ret < 0 && ret != -EAGAIN)
+		return ret;
+	return done;
+}
+
 static int nvmet_tcp_try_send(struct nvmet_tcp_queue *queue,
 		int budget, int *sends)
 {
 	int i, ret = 0;
 
 	for (i = 0; i < budget; i++) {
+		if (!queue->snd_cmd) {
+			ret = nvmet_tcp_try_send_rsp_batch(queue, budget - i);
+			if (unlikely(ret < 0)) {
+				nvmet_tcp_socket_error(queue, ret);
+				goto done;
+			} else if (ret > 0) {
+				*sends += ret;
+				i += ret - 1;
+				continue;
+			}
+		}
+
 		ret = nvmet_tcp_try_send_one(queue, i == budget - 1);
 		if (unlikely(ret < 0)) {
 			nvmet_tcp_socket_error(queue, ret);
@@ -1268,38 +1399,111 @@ static bool nvmet_tcp_check_queue_deadline(struct nvmet_tcp_queue *queue,
 	return !time_after(jiffies, queue->poll_end);
 }
 
+/*
+ * Size the budgets from a moving average of the commands in flight, so
+ * that a deep queue is not throttled to a handful of PDUs per round.
+ */
+static void nvmet_tcp_update_budgets(struct nvmet_tcp_queue *queue)
+{
+	unsigned int depth;
+
+	/* scaled by 8 */
+	queue->avg_depth += max(queue->nr_busy, 0) - (queue->avg_depth >> 3);
+	depth = queue->avg_depth >> 3;
+
+	queue->recv_budget = clamp_t(unsigned int, depth,
+			NVMET_TCP_RECV_BUDGET, NVMET_TCP_MAX_BUDGET);
+	queue->send_budget = clamp_t(unsigned int, depth,
+			NVMET_TCP_SEND_BUDGET, NVMET_TCP_MAX_BUDGET);
+	queue->io_budget = max_t(unsigned int, NVMET_TCP_IO_WORK_BUDGET,
+			2 * (queue->recv_budget + queue->send_budget));
+}
+
+/*
+ * Spin on the socket for a while instead of rescheduling io_work, the
+ * next command or completion is likely to show up within a few usecs.
+ */
+static bool nvmet_tcp_busy_poll(struct nvmet_tcp_queue *queue)
+{
+	struct sock *sk = queue->sock->sk;
+	u64 end = local_clock() + (u64)busy_poll_usecs * NSEC_PER_USEC;
+
+	do {
+		if (sk_can_busy_loop(sk))
+			sk_busy_loop(sk, true);
+		if (!skb_queue_empty_lockless(&sk->sk_receive_queue) ||
+		    !llist_empty(&queue->resp_list)) {
+			queue->stats.busy_poll_hits++;
+			return true;
+		}
+		cpu_relax();
+	} while (!need_resched() && local_clock() < end);
+
+	queue->stats.busy_poll_misses++;
+	return false;
+}
+
 static void nvmet_tcp_io_work(struct work_struct *w)
 {
 	struct nvmet_tcp_queue *queue =
 		container_of(w, struct nvmet_tcp_queue, io_work);
+	int ret, ops = 0, polled_ops = -1;
 	bool pending;
-	int ret, ops = 0;
+
+	nvmet_tcp_update_budgets(queue);
 
 	do {
 		pending = false;
 
-		ret = nvmet_tcp_try_recv(queue, NVMET_TCP_RECV_BUDGET, &ops);
+		ret = nvmet_tcp_try_recv(queue, queue->recv_budget, &ops);
 		if (ret > 0)
 			pending = true;
 		else if (ret < 0)
 			return;
 
-		ret = nvmet_tcp_try_send(queue, NVMET_TCP_SEND_BUDGET, &ops);
+		ret = nvmet_tcp_try_send(queue, queue->send_budget, &ops);
 		if (ret > 0)
 			pending = true;
 		else if (ret < 0)
 			return;
 
-	} while (pending && ops < NVMET_TCP_IO_WORK_BUDGET);
+		/* poll again only if the last poll led somewhere */
+		if (!pending && busy_poll_usecs > 0 && ops != polled_ops &&
+		    ops < queue->io_budget) {
+			polled_ops = ops;
+			pending = nvmet_tcp_busy_poll(queue);
+		}
+	} while (pending && ops < queue->io_budget);
 
 	/*
 	 * Requeue the worker if idle deadline period is in progress or any
 	 * ops activity was recorded during the do-while loop above.
 	 */
-	if (nvmet_tcp_check_queue_deadline(queue, ops) || pending)
+	if (nvmet_tcp_check_queue_deadline(queue, ops) || pending) {
+		queue->stats.io_work_requeues++;
 		queue_work_on(queue_cpu(queue), nvmet_tcp_wq, &queue->io_work);
+	}
 }
 
+static int nvmet_tcp_queue_stats_show(struct seq_file *m, void *v)
+{
+	struct nvmet_tcp_queue *queue = m->private;
+	struct nvmet_tcp_queue_stats *stats = &queue->stats;
+	int i;
+
+	seq_printf(m, "depth %u budgets recv %u send %u io %u\n",
+		   queue->avg_depth >> 3, queue->recv_budget,
+		   queue->send_budget, queue->io_budget);
+	seq_printf(m, "rsp_batches %llu hist", stats->rsp_batches);
+	for (i = 0; i < NVMET_TCP_BATCH_BUCKETS; i++)
+		seq_printf(m, " %llu", stats->rsp_batch_hist[i]);
+	seq_printf(m, "\nio_work_requeues %llu\n", stats->io_work_requeues);
+	seq_printf(m, "busy_poll hits %llu misses %llu\n",
+		   stats->busy_poll_hits, stats->busy_poll_misses);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nvmet_tcp_queue_stats);
+
 static int nvmet_tcp_alloc_cmd(struct nvmet_tcp_queue *queue,
 		struct nvmet_tcp_cmd *c)
 {
@@ -1435,6 +1639,7 @@ static void nvmet_tcp_release_queue_work(struct work_struct *w)
 	list_del_init(&queue->queue_list);
 	mutex_unlock(&nvmet_tcp_queue_mutex);
 
+	debugfs_remove(queue->dbg_file);
 	nvmet_tcp_restore_socket_callbacks(queue);
 	flush_work(&queue->io_work);
 
@@ -1582,6 +1787,9 @@ static int nvmet_tcp_alloc_queue(struct nvmet_tcp_port *port,
 	INIT_LIST_HEAD(&queue->free_list);
 	init_llist_head(&queue->resp_list);
 	INIT_LIST_HEAD(&queue->resp_send_list);
+	queue->recv_budget = NVMET_TCP_RECV_BUDGET;
+	queue->send_budget = NVMET_TCP_SEND_BUDGET;
+	queue->io_budget = NVMET_TCP_IO_WORK_BUDGET;
 
 	queue->idx = ida_simple_get(&nvmet_tcp_queue_ida, 0, 0, GFP_KERNEL);
 	if (queue->idx < 0) {
@@ -1607,6 +1815,15 @@ static int nvmet_tcp_alloc_queue(struct nvmet_tcp_port *port,
 	if (ret)
 		goto out_destroy_sq;
 
+	if (nvmet_tcp_dbg_dir) {
+		char name[16];
+
+		snprintf(name, sizeof(name), "queue%d", queue->idx);
+		queue->dbg_file = debugfs_create_file(name, 0444,
+				nvmet_tcp_dbg_dir, queue,
+				&nvmet_tcp_queue_stats_fops);
+	}
+
 	return 0;
 out_destroy_sq:
 	mutex_lock(&nvmet_tcp_queue_mutex);
@@ -1814,12 +2031,15 @@ static int __init nvmet_tcp_init(void)
 	if (!nvmet_tcp_wq)
 		return -ENOMEM;
 
+	nvmet_tcp_dbg_dir = debugfs_create_dir("nvmet-tcp", NULL);
+
 	ret = nvmet_register_transport(&nvmet_tcp_ops);
 	if (ret)
 		goto err;
 
 	return 0;
 err:
+	debugfs_remove(nvmet_tcp_dbg_dir);
 	destroy_workqueue(nvmet_tcp_wq);
 	return ret;
 }
@@ -1837,6 +2057,7 @@ static void __exit nvmet_tcp_exit(void)
 	mutex_unlock(&nvmet_tcp_queue_mutex);
 	flush_scheduled_work();
 
+	debugfs_remove_recursive(nvmet_tcp_dbg_dir);
 	destroy_workqueue(nvmet_tcp_wq);
 }
 
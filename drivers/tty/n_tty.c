@@ -1492,20 +1492,25 @@ n_tty_receive_buf_real_raw(struct tty_struct *tty, const unsigned char *cp,
 	ldata->read_head += n;
 }
 
+/* Copy the runs of TTY_NORMAL chars in bulk, handle the others one by one */
 static void
 n_tty_receive_buf_raw(struct tty_struct *tty, const unsigned char *cp,
 		      const char *fp, int count)
 {
-	struct n_tty_data *ldata = tty->disc_data;
-	char flag = TTY_NORMAL;
+	const char *p;
+	int n;
 
-	while (count--) {
-		if (fp)
-			flag = *fp++;
-		if (likely(flag == TTY_NORMAL))
-			put_tty_queue(*cp++, ldata);
-		else
-			n_tty_receive_char_flagged(tty, *cp++, flag);
+	while (count) {
+		p = fp ? memchr_inv(fp, TTY_NORMAL, count) : NULL;
+		n = p ? p - fp : count;
+		n_tty_receive_buf_real_raw(tty, cp, NULL, n);
+		if (!p)
+			break;
+
+		n_tty_receive_char_flagged(tty, cp[n], *p);
+		cp += n + 1;
+		fp += n + 1;
+		count -= n + 1;
 	}
 }
 
@@ -1523,15 +1528,56 @@ n_tty_receive_buf_closing(struct tty_struct *tty, const unsigned char *cp,
 	}
 }
 
+/*
+ * Whether the chars which are not in char_map can go straight to the read
+ * buffer: nothing to echo, strip, fold or escape, and no IXANY restart.
+ */
+static bool n_tty_plain_chars(struct tty_struct *tty)
+{
+	return !L_ECHO(tty) && !L_EXTPROC(tty) && !I_PARMRK(tty) &&
+	       !I_ISTRIP(tty) && !(I_IUCLC(tty) && L_IEXTEN(tty)) &&
+	       !(I_IXON(tty) && I_IXANY(tty));
+}
+
+/* Length of the run of TTY_NORMAL chars not in char_map at @cp */
+static int n_tty_plain_run(struct n_tty_data *ldata, const unsigned char *cp,
+			   const char *fp, int count)
+{
+	int n = 0;
+
+	while (n < count && (!fp || fp[n] == TTY_NORMAL) &&
+	       !test_bit(cp[n], ldata->char_map))
+		n++;
+
+	return n;
+}
+
 static void n_tty_receive_buf_standard(struct tty_struct *tty,
 		const unsigned char *cp, const char *fp, int count)
 {
 	struct n_tty_data *ldata = tty->disc_data;
+	bool plain = n_tty_plain_chars(tty);
 	char flag = TTY_NORMAL;
+	int n;
+
+	while (count) {
+		unsigned char c;
+
+		if (plain && !ldata->lnext) {
+			n = n_tty_plain_run(ldata, cp, fp, count);
+			if (n) {
+				n_tty_receive_buf_real_raw(tty, cp, NULL, n);
+				cp += n;
+				if (fp)
+					fp += n;
+				count -= n;
+				if (!count)
+					break;
+			}
+		}
 
-	while (count--) {
-		unsigned char c = *cp++;
-
+		c = *cp++;
+		count--;
 		if (fp)
 			flag = *fp++;
 
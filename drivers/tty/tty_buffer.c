@@ -38,6 +38,13 @@
 
 #define TTY_BUFFER_PAGE	(((PAGE_SIZE - sizeof(struct tty_buffer)) / 2) & ~0xFF)
 
+/*
+ * New buffers are made larger, up to this size, while the ldisc lags
+ * behind the driver, so that fast links are flushed to the ldisc in fewer
+ * and larger chunks. The size shrinks again when buffers go mostly unused.
+ */
+#define TTY_BUFFER_MAX	(((4 * PAGE_SIZE - sizeof(struct tty_buffer)) / 2) & ~0xFF)
+
 /**
  *	tty_buffer_lock_exclusive	-	gain exclusive access to buffer
  *	tty_buffer_unlock_exclusive	-	release exclusive access
@@ -261,7 +268,7 @@ static int __tty_buffer_request_room(struct tty_port *port, size_t size,
 {
 	struct tty_bufhead *buf = &port->buf;
 	struct tty_buffer *b, *n;
-	int left, change;
+	int left, change, alloc;
 
 	b = buf->tail;
 	if (b->flags & TTYB_NORMAL)
@@ -272,7 +279,22 @@ static int __tty_buffer_request_room(struct tty_port *port, size_t size,
 	change = (b->flags & TTYB_NORMAL) && (~flags & TTYB_NORMAL);
 	if (change || left < size) {
 		/* This is the slow path - looking for new buffers to use */
-		n = tty_buffer_alloc(port, size);
+		alloc = READ_ONCE(buf->alloc_size);
+		/*
+		 * Filled up a buffer while older ones are still waiting for
+		 * the ldisc: the driver is outrunning flush_to_ldisc().
+		 */
+		if (!change && b != &buf->sentinel && READ_ONCE(buf->head) != b &&
+		    alloc < TTY_BUFFER_MAX) {
+			alloc = min_t(int, 2 * alloc, TTY_BUFFER_MAX);
+			WRITE_ONCE(buf->alloc_size, alloc);
+		}
+
+		n = NULL;
+		if (alloc > size)
+			n = tty_buffer_alloc(port, alloc);
+		if (n == NULL)
+			n = tty_buffer_alloc(port, size);
 		if (n != NULL) {
 			n->flags = flags;
 			buf->tail = n;
@@ -478,6 +500,16 @@ int tty_ldisc_receive_buf(struct tty_ldisc *ld, const unsigned char *p,
 }
 EXPORT_SYMBOL_GPL(tty_ldisc_receive_buf);
 
+/* Make new buffers smaller if @b, which is done with, was mostly unused */
+static void tty_buffer_shrink(struct tty_bufhead *buf, struct tty_buffer *b)
+{
+	int alloc = READ_ONCE(buf->alloc_size);
+	int capacity = (b->flags & TTYB_NORMAL) ? 2 * b->size : b->size;
+
+	if (alloc > MIN_TTYB_SIZE && b->used < capacity / 4)
+		WRITE_ONCE(buf->alloc_size, max(alloc / 2, MIN_TTYB_SIZE));
+}
+
 static int
 receive_buf(struct tty_port *port, struct tty_buffer *head, int count)
 {
@@ -535,6 +567,7 @@ static void flush_to_ldisc(struct work_struct *work)
 		if (!count) {
 			if (next == NULL)
 				break;
+			tty_buffer_shrink(buf, head);
 			buf->head = next;
 			tty_buffer_free(port, head);
 			continue;
@@ -588,6 +621,7 @@ void tty_buffer_init(struct tty_port *port)
 	atomic_set(&buf->priority, 0);
 	INIT_WORK(&buf->work, flush_to_ldisc);
 	buf->mem_limit = TTYB_DEFAULT_MEM_LIMIT;
+	buf->alloc_size = MIN_TTYB_SIZE;
 }
 
 /**
@@ -22,6 +22,8 @@
  */
 
 #include <linux/compat.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/highmem.h>
@@ -31,6 +33,8 @@
 #include <linux/kthread.h>
 #include <linux/rbtree.h>
 #include <linux/sched/signal.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
 #include <linux/sched/mm.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
@@ -62,6 +66,34 @@ module_param_named(dma_entry_limit, dma_entry_limit, uint, 0644);
 MODULE_PARM_DESC(dma_entry_limit,
 		 "Maximum number of user DMA mappings per container (65535).");
 
+static unsigned int pin_threads __read_mostly = 1;
+module_param_named(pin_threads, pin_threads, uint, 0644);
+MODULE_PARM_DESC(pin_threads,
+		 "Maximum number of threads pinning and mapping a large user DMA mapping (1).");
+
+/*
+ * User DMA mappings are pinned and mapped by up to pin_threads threads,
+ * each of them taking care of at least VFIO_PIN_CHUNK_SIZE bytes.
+ *
+ * The extra threads are kworkers: pages they fault in follow the memory
+ * policy and cpuset of the kworker, not the ones of the caller, which is
+ * why this is opt-in.
+ */
+#define VFIO_PIN_CHUNK_SIZE	SZ_1G
+
+/* Where the time goes when large mappings are set up and torn down */
+static struct {
+	atomic64_t	pin_ns;		/* in vfio_pin_map_dma() */
+	atomic64_t	unpin_ns;	/* in vfio_unmap_unpin() */
+	atomic64_t	pinned;		/* pages pinned by vfio_pin_pages_remote() */
+	atomic64_t	runs;		/* physically contiguous runs of them */
+	atomic64_t	huge_runs;	/* runs starting in a compound page */
+	atomic64_t	unpinned;	/* pages unpinned by vfio_unpin_pages_remote() */
+	atomic64_t	parallel;	/* mappings pinned by several threads */
+} vfio_pin_stats;
+
+static struct dentry *vfio_debugfs_root;
+
 struct vfio_iommu {
 	struct list_head	domain_list;
 	struct list_head	iova_list;
@@ -416,6 +448,22 @@ static int vfio_iova_put_vfio_pfn(struct vfio_dma *dma, struct vfio_pfn *vpfn)
 	return ret;
 }
 
+/* Count the externally pinned pages of [iova, iova + npage pages) */
+static long vfio_count_vpfns(struct vfio_dma *dma, dma_addr_t iova,
+			     long npage)
+{
+	long i, count = 0;
+
+	if (RB_EMPTY_ROOT(&dma->pfn_list))
+		return 0;
+
+	for (i = 0; i < npage; i++, iova += PAGE_SIZE)
+		if (vfio_find_vpfn(dma, iova))
+			count++;
+
+	return count;
+}
+
 static int vfio_lock_acct(struct vfio_dma *dma, long npage, bool async)
 {
 	struct mm_struct *mm;
@@ -654,6 +702,7 @@ static long vfio_pin_pages_remote(struct vfio_dma *dma, unsigned long vaddr,
 	unsigned long pfn;
 	struct mm_struct *mm = current->mm;
 	long ret, pinned = 0, lock_acct = 0;
+	long nr, acct;
 	bool rsvd;
 	dma_addr_t iova = vaddr - dma->vaddr + dma->iova;
 
@@ -702,28 +751,54 @@ static long vfio_pin_pages_remote(struct vfio_dma *dma, unsigned long vaddr,
 			    rsvd != is_invalid_reserved_pfn(pfn))
 				goto out;
 
+			/*
+			 * Take the physically contiguous pages that follow,
+			 * typically the rest of a huge page, as a whole.
+			 * Only pages with a struct page can be part of a run,
+			 * so the batch holds valid pages past the first one.
+			 */
+			nr = 1;
+			if (!rsvd) {
+				long max = min_t(long, npage, batch->size);
+
+				/*
+				 * A reserved pfn isn't accounted, and isn't
+				 * unpinned either, so it ends the run.
+				 */
+				while (nr < max &&
+				       page_to_pfn(batch->pages[batch->offset + nr]) ==
+				       pfn + nr &&
+				       !is_invalid_reserved_pfn(pfn + nr))
+					nr++;
+
+				if (PageCompound(batch->pages[batch->offset]))
+					atomic64_inc(&vfio_pin_stats.huge_runs);
+			}
+			atomic64_inc(&vfio_pin_stats.runs);
+
 			/*
 			 * Reserved pages aren't counted against the user,
 			 * externally pinned pages are already counted against
 			 * the user.
 			 */
-			if (!rsvd && !vfio_find_vpfn(dma, iova)) {
-				if (!dma->lock_cap &&
-				    mm->locked_vm + lock_acct + 1 > limit) {
+			if (!rsvd) {
+				acct = nr - vfio_count_vpfns(dma, iova, nr);
+				if (acct && !dma->lock_cap &&
+				    mm->locked_vm + lock_acct + acct > limit) {
 					pr_warn("%s: RLIMIT_MEMLOCK (%ld) exceeded\n",
 						__func__, limit << PAGE_SHIFT);
 					ret = -ENOMEM;
 					goto unpin_out;
 				}
-				lock_acct++;
+				lock_acct += acct;
 			}
 
-			pinned++;
-			npage--;
-			vaddr += PAGE_SIZE;
-			iova += PAGE_SIZE;
-			batch->offset++;
-			batch->size--;
+			pinned += nr;
+			npage -= nr;
+			vaddr += nr << PAGE_SHIFT;
+			iova += nr << PAGE_SHIFT;
+			batch->offset += nr;
+			batch->size -= nr;
 
 			if (!batch->size)
 				break;
@@ -737,6 +812,7 @@ static long vfio_pin_pages_remote(struct vfio_dma *dma, unsigned long vaddr,
 
 out:
 	ret = vfio_lock_acct(dma, lock_acct, false);
+	atomic64_add(pinned, &vfio_pin_stats.pinned);
 
 unpin_out:
 	if (batch->size == 1 && !batch->offset) {
@@ -763,16 +839,28 @@ static long vfio_unpin_pages_remote(struct vfio_dma *dma, dma_addr_t iova,
 				    bool do_accounting)
 {
 	long unlocked = 0, locked = 0;
-	long i;
+	long i, nr;
 
-	for (i = 0; i < npage; i++, iova += PAGE_SIZE) {
-		if (put_pfn(pfn++, dma->prot)) {
-			unlocked++;
-			if (vfio_find_vpfn(dma, iova))
-				locked++;
-		}
+	/*
+	 * Unpin the runs of pages with a struct page at once, so that a huge
+	 * page costs a single reference drop instead of one per base page.
+	 */
+	for (i = 0; i < npage; i += nr) {
+		nr = 1;
+		if (is_invalid_reserved_pfn(pfn + i))
+			continue;
+
+		while (i + nr < npage && !is_invalid_reserved_pfn(pfn + i + nr))
+			nr++;
+
+		unpin_user_page_range_dirty_lock(pfn_to_page(pfn + i), nr,
+						 dma->prot & IOMMU_WRITE);
+		unlocked += nr;
+		locked += vfio_count_vpfns(dma, iova + (i << PAGE_SHIFT), nr);
 	}
 
+	atomic64_add(unlocked, &vfio_pin_stats.unpinned);
+
 	if (do_accounting)
 		vfio_lock_acct(dma, locked - unlocked, true);
 
@@ -1077,22 +1165,21 @@ static size_t unmap_unpin_slow(struct vfio_domain *domain,
 	return unmapped;
 }
 
-static long vfio_unmap_unpin(struct vfio_iommu *iommu, struct vfio_dma *dma,
-			     bool do_accounting)
+/*
+ * Unmap [start, start + size) of @dma from every domain and unpin the pages
+ * backing it, returning the number of pages unpinned.
+ */
+static long vfio_unmap_unpin_range(struct vfio_iommu *iommu,
+				   struct vfio_dma *dma, dma_addr_t start,
+				   size_t size)
 {
-	dma_addr_t iova = dma->iova, end = dma->iova + dma->size;
+	dma_addr_t iova = start, end = start + size;
 	struct vfio_domain *domain, *d;
 	LIST_HEAD(unmapped_region_list);
 	struct iommu_iotlb_gather iotlb_gather;
 	int unmapped_region_cnt = 0;
 	long unlocked = 0;
 
-	if (!dma->size)
-		return 0;
-
-	if (!IS_IOMMU_CAP_DOMAIN_IN_CONTAINER(iommu))
-		return 0;
-
 	/*
 	 * We use the IOMMU to track the physical addresses, otherwise we'd
 	 * need a much more complicated tracking system.  Unfortunately that
@@ -1104,7 +1191,7 @@ static long vfio_unmap_unpin(struct vfio_iommu *iommu, struct vfio_dma *dma,
 				      struct vfio_domain, next);
 
 	list_for_each_entry_continue(d, &iommu->domain_list, next) {
-		iommu_unmap(d->domain, dma->iova, dma->size);
+		iommu_unmap(d->domain, start, size);
 		cond_resched();
 	}
 
@@ -1147,13 +1234,31 @@ static long vfio_unmap_unpin(struct vfio_iommu *iommu, struct vfio_dma *dma,
 		}
 	}
 
-	dma->iommu_mapped = false;
-
 	if (unmapped_region_cnt) {
 		unlocked += vfio_sync_unpin(dma, domain, &unmapped_region_list,
 					    &iotlb_gather);
 	}
 
+	return unlocked;
+}
+
+static long vfio_unmap_unpin(struct vfio_iommu *iommu, struct vfio_dma *dma,
+			     bool do_accounting)
+{
+	u64 start_ns;
+	long unlocked;
+
+	if (!dma->size)
+		return 0;
+
+	if (!IS_IOMMU_CAP_DOMAIN_IN_CONTAINER(iommu))
+		return 0;
+
+	start_ns = ktime_get_ns();
+	unlocked = vfio_unmap_unpin_range(iommu, dma, dma->iova, dma->size);
+	dma->iommu_mapped = false;
+	atomic64_add(ktime_get_ns() - start_ns, &vfio_pin_stats.unpin_ns);
+
 	if (do_accounting) {
 		vfio_lock_acct(dma, -unlocked, true);
 		return 0;
@@ -1483,22 +1588,37 @@ static int vfio_iommu_map(struct vfio_iommu *iommu, dma_addr_t iova,
 	return ret;
 }
 
-static int vfio_pin_map_dma(struct vfio_iommu *iommu, struct vfio_dma *dma,
-			    size_t map_size)
+/*
+ * Pin and map [offset, offset + size) of @dma, with current->mm being the
+ * mm of the mapping.  *done is set to how much of it was pinned and mapped,
+ * which is left in place on error.
+ *
+ * GUP only notices fatal signals of current, which is a kworker when the
+ * mapping is pinned in parallel, so the owner of the mapping is checked
+ * between batches: a killed process must not keep faulting in memory.
+ */
+static int vfio_pin_map_range(struct vfio_iommu *iommu, struct vfio_dma *dma,
+			      size_t offset, size_t size, unsigned long limit,
+			      size_t *done)
 {
-	dma_addr_t iova = dma->iova;
-	unsigned long vaddr = dma->vaddr;
+	dma_addr_t iova = dma->iova + offset;
+	unsigned long vaddr = dma->vaddr + offset;
 	struct vfio_batch batch;
-	size_t size = map_size;
+	unsigned long pfn;
 	long npage;
-	unsigned long pfn, limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
 	int ret = 0;
 
+	*done = 0;
 	vfio_batch_init(&batch);
 
 	while (size) {
+		if (fatal_signal_pending(dma->task)) {
+			ret = -EINTR;
+			break;
+		}
+
 		/* Pin a contiguous chunk of memory */
-		npage = vfio_pin_pages_remote(dma, vaddr + dma->size,
+		npage = vfio_pin_pages_remote(dma, vaddr + *done,
 					      size >> PAGE_SHIFT, &pfn, limit,
 					      &batch);
 		if (npage <= 0) {
@@ -1508,21 +1628,151 @@ static int vfio_pin_map_dma(struct vfio_iommu *iommu, struct vfio_dma *dma,
 		}
 
 		/* Map it! */
-		ret = vfio_iommu_map(iommu, iova + dma->size, pfn, npage,
+		ret = vfio_iommu_map(iommu, iova + *done, pfn, npage,
 				     dma->prot);
 		if (ret) {
-			vfio_unpin_pages_remote(dma, iova + dma->size, pfn,
+			vfio_unpin_pages_remote(dma, iova + *done, pfn,
 						npage, true);
 			vfio_batch_unpin(&batch, dma);
 			break;
 		}
 
 		size -= npage << PAGE_SHIFT;
-		dma->size += npage << PAGE_SHIFT;
+		*done += npage << PAGE_SHIFT;
 	}
 
 	vfio_batch_fini(&batch);
+	return ret;
+}
+
+struct vfio_pin_chunk {
+	struct work_struct	work;
+	struct completion	comp;
+	struct vfio_iommu	*iommu;
+	struct vfio_dma		*dma;
+	struct mm_struct	*mm;
+	size_t			offset;		/* from dma->iova */
+	size_t			size;
+	size_t			done;
+	unsigned long		limit;
+	int			ret;
+};
+
+static void vfio_pin_map_work(struct work_struct *work)
+{
+	struct vfio_pin_chunk *chunk = container_of(work,
+					struct vfio_pin_chunk, work);
+
+	kthread_use_mm(chunk->mm);
+	chunk->ret = vfio_pin_map_range(chunk->iommu, chunk->dma,
+					chunk->offset, chunk->size,
+					chunk->limit, &chunk->done);
+	kthread_unuse_mm(chunk->mm);
+	complete(&chunk->comp);
+}
+
+/*
+ * Split the mapping in up to @nr chunks aligned on VFIO_PIN_CHUNK_SIZE in
+ * IOVA space, so that huge pages are not split across threads, and have
+ * kworkers pin and map all but the first one while we take care of it.
+ * The caller's mm is kept alive by the caller waiting for the workers.
+ */
+static int vfio_pin_map_dma_parallel(struct vfio_iommu *iommu,
+				     struct vfio_dma *dma, size_t map_size,
+				     unsigned long limit, int nr)
+{
+	size_t per = ALIGN(DIV_ROUND_UP(map_size, nr), VFIO_PIN_CHUNK_SIZE);
+	struct vfio_pin_chunk *chunks;
+	size_t offset = 0, end;
+	long unlocked;
+	int i, ret = 0;
+
+	chunks = kcalloc(nr, sizeof(*chunks), GFP_KERNEL);
+	if (!chunks)
+		return -ENOMEM;
+
+	for (i = 0; i < nr && offset < map_size; i++) {
+		end = ALIGN(dma->iova + offset + per, VFIO_PIN_CHUNK_SIZE) -
+		      dma->iova;
+		end = min(end, map_size);
+
+		chunks[i].iommu = iommu;
+		chunks[i].dma = dma;
+		chunks[i].mm = current->mm;
+		chunks[i].offset = offset;
+		chunks[i].size = end - offset;
+		chunks[i].limit = limit;
+		INIT_WORK(&chunks[i].work, vfio_pin_map_work);
+		init_completion(&chunks[i].comp);
+		if (i)
+			queue_work(system_unbound_wq, &chunks[i].work);
+		offset = end;
+	}
+	nr = i;
+
+	chunks[0].ret = vfio_pin_map_range(iommu, dma, 0, chunks[0].size,
+					   limit, &chunks[0].done);
+
+	/*
+	 * Once we are killed, the workers stop at their next batch, so
+	 * only that much is left to wait for before unwinding.
+	 */
+	for (i = 1; i < nr; i++) {
+		if (wait_for_completion_killable(&chunks[i].comp))
+			break;
+	}
+	for (i = 1; i < nr; i++)
+		flush_work(&chunks[i].work);
+
+	for (i = 0; i < nr; i++) {
+		if (chunks[i].ret) {
+			ret = chunks[i].ret;
+			break;
+		}
+	}
+
+	if (!ret) {
+		dma->size = map_size;
+	} else {
+		/* Unwind what the successful parts of each chunk did */
+		for (i = 0; i < nr; i++) {
+			if (!chunks[i].done)
+				continue;
+			unlocked = vfio_unmap_unpin_range(iommu, dma,
+						dma->iova + chunks[i].offset,
+						chunks[i].done);
+			vfio_lock_acct(dma, -unlocked, true);
+		}
+	}
+
+	kfree(chunks);
+	atomic64_inc(&vfio_pin_stats.parallel);
+	return ret;
+}
+
+static int vfio_pin_map_dma(struct vfio_iommu *iommu, struct vfio_dma *dma,
+			    size_t map_size)
+{
+	unsigned long limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
+	u64 start_ns = ktime_get_ns();
+	int nr, ret;
+
+	nr = min_t(u64, DIV_ROUND_UP_ULL(map_size, VFIO_PIN_CHUNK_SIZE),
+		   min(READ_ONCE(pin_threads), num_online_cpus()));
+
+	if (nr > 1 && current->mm) {
+		ret = vfio_pin_map_dma_parallel(iommu, dma, map_size, limit,
+						nr);
+	} else {
+		size_t done;
+
+		ret = vfio_pin_map_range(iommu, dma, 0, map_size, limit,
+					 &done);
+		dma->size = done;
+	}
+
 	dma->iommu_mapped = true;
+	atomic64_add(ktime_get_ns() - start_ns, &vfio_pin_stats.pin_ns);
 
 	if (ret)
 		vfio_remove_dma(iommu, dma);
@@ -3272,14 +3522,41 @@ static const struct vfio_iommu_driver_ops vfio_iommu_driver_ops_type1 = {
 	.notify			= vfio_iommu_type1_notify,
 };
 
+static int vfio_pin_stats_show(struct seq_file *s, void *unused)
+{
+	seq_printf(s, "pin_ns %lld\n", atomic64_read(&vfio_pin_stats.pin_ns));
+	seq_printf(s, "unpin_ns %lld\n",
+		   atomic64_read(&vfio_pin_stats.unpin_ns));
+	seq_printf(s, "pinned %lld\n", atomic64_read(&vfio_pin_stats.pinned));
+	seq_printf(s, "runs %lld\n", atomic64_read(&vfio_pin_stats.runs));
+	seq_printf(s, "huge_runs %lld\n",
+		   atomic64_read(&vfio_pin_stats.huge_runs));
+	seq_printf(s, "unpinned %lld\n",
+		   atomic64_read(&vfio_pin_stats.unpinned));
+	seq_printf(s, "parallel %lld\n",
+		   atomic64_read(&vfio_pin_stats.parallel));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(vfio_pin_stats);
+
 static int __init vfio_iommu_type1_init(void)
 {
-	return vfio_register_iommu_driver(&vfio_iommu_driver_ops_type1);
+	int ret;
+
+	ret = vfio_register_iommu_driver(&vfio_iommu_driver_ops_type1);
+	if (ret)
+		return ret;
+
+	vfio_debugfs_root = debugfs_create_dir("vfio_iommu_type1", NULL);
+	debugfs_create_file("pin_stats", 0444, vfio_debugfs_root, NULL,
+			    &vfio_pin_stats_fops);
+	return 0;
 }
 
 static void __exit vfio_iommu_type1_cleanup(void)
 {
 	vfio_unregister_iommu_driver(&vfio_iommu_driver_ops_type1);
+	debugfs_remove_recursive(vfio_debugfs_root);
 }
 
 module_init(vfio_iommu_type1_init);
@@ -40,6 +40,11 @@ module_param(experimental_zcopytx, int, 0444);
 MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
 		                       " 1 -Enable; 0 - Disable");
 
+static bool per_vq_workers;
+module_param(per_vq_workers, bool, 0444);
+MODULE_PARM_DESC(per_vq_workers, "Run TX and RX of a queue pair on worker"
+				 " threads of their own");
+
 /* Max number of bytes transferred before requeueing the job.
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_NET_WEIGHT 0x80000
@@ -515,6 +520,35 @@ static void vhost_net_busy_poll_try_queue(struct vhost_net *net,
 	}
 }
 
+/* Busy poll of a worker serving a single virtqueue: the caller holds its
+ * mutex, the paired virtqueue makes progress on its own worker meanwhile.
+ */
+static void vhost_net_busy_poll_own(struct vhost_net *net,
+				    struct vhost_virtqueue *vq,
+				    bool *busyloop_intr, bool poll_rx)
+{
+	struct socket *sock = vhost_vq_get_backend(vq);
+	unsigned long endtime;
+
+	preempt_disable();
+	endtime = busy_clock() + vq->busyloop_timeout;
+
+	while (vhost_can_busy_poll(endtime)) {
+		if (vhost_vq_has_work(vq)) {
+			*busyloop_intr = true;
+			break;
+		}
+
+		if ((!poll_rx || sock_has_rx_data(sock)) &&
+		    !vhost_vq_avail_empty(&net->dev, vq))
+			break;
+
+		cpu_relax();
+	}
+
+	preempt_enable();
+}
+
 static void vhost_net_busy_poll(struct vhost_net *net,
 				struct vhost_virtqueue *rvq,
 				struct vhost_virtqueue *tvq,
@@ -525,6 +559,17 @@ static void vhost_net_busy_poll(struct vhost_net *net,
 	unsigned long endtime;
 	struct socket *sock;
 	struct vhost_virtqueue *vq = poll_rx ? tvq : rvq;
+	struct vhost_virtqueue *own_vq = poll_rx ? rvq : tvq;
+	/* When both virtqueues share the worker, each of them has to be
+	 * polled here for the other one, otherwise every worker polls only
+	 * for the virtqueue it serves.
+	 */
+	bool shared = rvq->worker == tvq->worker;
+
+	if (!shared) {
+		vhost_net_busy_poll_own(net, own_vq, busyloop_intr, poll_rx);
+		return;
+	}
 
 	/* Try to hold the vq mutex of the paired virtqueue. We can't
 	 * use mutex_lock() here since we could not guarantee a
@@ -543,7 +588,7 @@ static void vhost_net_busy_poll(struct vhost_net *net,
 	endtime = busy_clock() + busyloop_timeout;
 
 	while (vhost_can_busy_poll(endtime)) {
-		if (vhost_has_work(&net->dev)) {
+		if (vhost_vq_has_work(own_vq)) {
 			*busyloop_intr = true;
 			break;
 		}
@@ -1338,9 +1383,13 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		       UIO_MAXIOV + VHOST_NET_BATCH,
 		       VHOST_NET_PKT_WEIGHT, VHOST_NET_WEIGHT, true,
 		       NULL);
+	if (per_vq_workers)
+		dev->nworkers = VHOST_NET_VQ_MAX;
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev,
+			vqs[VHOST_NET_VQ_TX]);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev,
+			vqs[VHOST_NET_VQ_RX]);
 
 	f->private_data = n;
 	n->page_frag.page = NULL;
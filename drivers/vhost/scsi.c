@@ -34,6 +34,8 @@
 #include <linux/virtio_scsi.h>
 #include <linux/llist.h>
 #include <linux/bitmap.h>
+#include <linux/hash.h>
+#include <linux/mmu_notifier.h>
 
 #include "vhost.h"
 
@@ -50,6 +52,26 @@
  */
 #define VHOST_SCSI_WEIGHT 256
 
+/*
+ * Pinned guest pages are cached per virtqueue, so that the buffers the
+ * guest keeps reusing are not looked up and pinned again for every
+ * command.  Only segments of up to VHOST_SCSI_PAGE_CACHE_MAX_SEG pages
+ * are cached, larger ones are mostly streaming I/O.
+ */
+#define VHOST_SCSI_PAGE_CACHE_BITS	7
+#define VHOST_SCSI_PAGE_CACHE_SIZE	(1 << VHOST_SCSI_PAGE_CACHE_BITS)
+#define VHOST_SCSI_PAGE_CACHE_MAX_SEG	16
+
+static unsigned int vhost_scsi_workers = 1;
+module_param_named(workers, vhost_scsi_workers, uint, 0444);
+MODULE_PARM_DESC(workers,
+	"Number of worker threads servicing the virtqueues of a device (default: 1)");
+
+static bool vhost_scsi_page_cache;
+module_param_named(page_cache, vhost_scsi_page_cache, bool, 0444);
+MODULE_PARM_DESC(page_cache,
+	"Keep guest data pages pinned across commands (default: N)");
+
 struct vhost_scsi_inflight {
 	/* Wait for the flush operation to finish */
 	struct completion comp;
@@ -162,6 +184,18 @@ enum {
 #define VHOST_SCSI_MAX_VQ	128
 #define VHOST_SCSI_MAX_EVENT	128
 
+struct vhost_scsi_page_cache_ent {
+	/* user address of the page, bit 0 set if pinned for writing */
+	unsigned long key;
+	struct page *page;
+};
+
+struct vhost_scsi_page_cache {
+	spinlock_t lock;
+	unsigned int nr;
+	struct vhost_scsi_page_cache_ent ent[VHOST_SCSI_PAGE_CACHE_SIZE];
+};
+
 struct vhost_scsi_virtqueue {
 	struct vhost_virtqueue vq;
 	/*
@@ -178,6 +212,11 @@ struct vhost_scsi_virtqueue {
 	struct vhost_scsi_cmd *scsi_cmds;
 	struct sbitmap scsi_tags;
 	int max_cmds;
+
+	struct vhost_work completion_work; /* cmd completion work item */
+	struct llist_head completion_list; /* cmd completion queue */
+
+	struct vhost_scsi_page_cache page_cache;
 };
 
 struct vhost_scsi {
@@ -188,14 +227,20 @@ struct vhost_scsi {
 	struct vhost_dev dev;
 	struct vhost_scsi_virtqueue vqs[VHOST_SCSI_MAX_VQ];
 
-	struct vhost_work vs_completion_work; /* cmd completion work item */
-	struct llist_head vs_completion_list; /* cmd completion queue */
-
 	struct vhost_work vs_event_work; /* evt injection work item */
 	struct llist_head vs_event_list; /* evt injection queue */
 
 	bool vs_events_missed; /* any missed events, protected by vq->mutex */
 	int vs_events_nr; /* num of pending events, protected by vq->mutex */
+
+	/*
+	 * Invalidation of the page caches.  Pages pinned while an
+	 * invalidation is in progress, or across one, are not cached.
+	 */
+	struct mmu_notifier vs_mn;
+	struct mm_struct *vs_mn_mm; /* set once registered, under dev.mutex */
+	atomic_t vs_mn_invalidating;
+	atomic_t vs_mn_seq;
 };
 
 struct vhost_scsi_tmf {
@@ -361,14 +406,15 @@ static void vhost_scsi_release_cmd(struct se_cmd *se_cmd)
 		struct vhost_scsi_tmf *tmf = container_of(se_cmd,
 					struct vhost_scsi_tmf, se_cmd);
 
-		vhost_work_queue(&tmf->vhost->dev, &tmf->vwork);
+		vhost_vq_work_queue(&tmf->svq->vq, &tmf->vwork);
 	} else {
 		struct vhost_scsi_cmd *cmd = container_of(se_cmd,
 					struct vhost_scsi_cmd, tvc_se_cmd);
-		struct vhost_scsi *vs = cmd->tvc_vhost;
+		struct vhost_scsi_virtqueue *svq = container_of(cmd->tvc_vq,
+					struct vhost_scsi_virtqueue, vq);
 
-		llist_add(&cmd->tvc_completion_list, &vs->vs_completion_list);
-		vhost_work_queue(&vs->dev, &vs->vs_completion_work);
+		llist_add(&cmd->tvc_completion_list, &svq->completion_list);
+		vhost_vq_work_queue(&svq->vq, &svq->completion_work);
 	}
 }
 
@@ -526,24 +572,27 @@ static void vhost_scsi_evt_work(struct vhost_work *work)
 
 /* Fill in status and signal that we are done processing this command
  *
- * This is scheduled in the vhost work queue so we are called with the owner
- * process mm and can access the vring.
+ * This is scheduled on the worker of the command virtqueue so we are called
+ * with the owner process mm and can access the vring.  All the commands
+ * completed since the last run are published with a single used ring update
+ * and a single guest notification.
  */
 static void vhost_scsi_complete_cmd_work(struct vhost_work *work)
 {
-	struct vhost_scsi *vs = container_of(work, struct vhost_scsi,
-					vs_completion_work);
-	DECLARE_BITMAP(signal, VHOST_SCSI_MAX_VQ);
+	struct vhost_scsi_virtqueue *svq = container_of(work,
+				struct vhost_scsi_virtqueue, completion_work);
+	struct vhost_virtqueue *vq = &svq->vq;
 	struct virtio_scsi_cmd_resp v_rsp;
 	struct vhost_scsi_cmd *cmd, *t;
 	struct llist_node *llnode;
 	struct se_cmd *se_cmd;
 	struct iov_iter iov_iter;
-	int ret, vq;
+	unsigned int nheads = 0;
+	bool signal = false;
+	int ret;
 
-	bitmap_zero(signal, VHOST_SCSI_MAX_VQ);
-	llnode = llist_del_all(&vs->vs_completion_list);
-	llist_for_each_entry_safe(cmd, t, llnode, tvc_completion_list) {
+	llnode = llist_del_all(&svq->completion_list);
+	llist_for_each_entry(cmd, llnode, tvc_completion_list) {
 		se_cmd = &cmd->tvc_se_cmd;
 
 		pr_debug("%s tv_cmd %p resid %u status %#02x\n", __func__,
@@ -562,21 +611,27 @@ static void vhost_scsi_complete_cmd_work(struct vhost_work *work)
 			      cmd->tvc_in_iovs, sizeof(v_rsp));
 		ret = copy_to_iter(&v_rsp, sizeof(v_rsp), &iov_iter);
 		if (likely(ret == sizeof(v_rsp))) {
-			struct vhost_scsi_virtqueue *q;
-			vhost_add_used(cmd->tvc_vq, cmd->tvc_vq_desc, 0);
-			q = container_of(cmd->tvc_vq, struct vhost_scsi_virtqueue, vq);
-			vq = q - vs->vqs;
-			__set_bit(vq, signal);
+			vq->heads[nheads].id = cpu_to_vhost32(vq,
+							      cmd->tvc_vq_desc);
+			vq->heads[nheads].len = 0;
+			if (++nheads == vq->dev->iov_limit) {
+				vhost_add_used_n(vq, vq->heads, nheads);
+				nheads = 0;
+			}
+			signal = true;
 		} else
 			pr_err("Faulted on virtio_scsi_cmd_resp\n");
-
-		vhost_scsi_release_cmd_res(se_cmd);
 	}
 
-	vq = -1;
-	while ((vq = find_next_bit(signal, VHOST_SCSI_MAX_VQ, vq + 1))
-		< VHOST_SCSI_MAX_VQ)
-		vhost_signal(&vs->dev, &vs->vqs[vq].vq);
+	if (nheads)
+		vhost_add_used_n(vq, vq->heads, nheads);
+
+	/* Only now that the descriptors are used, let the tags be reused. */
+	llist_for_each_entry_safe(cmd, t, llnode, tvc_completion_list)
+		vhost_scsi_release_cmd_res(&cmd->tvc_se_cmd);
+
+	if (signal)
+		vhost_signal(vq->dev, vq);
 }
 
 static struct vhost_scsi_cmd *
@@ -626,6 +681,239 @@ vhost_scsi_get_cmd(struct vhost_virtqueue *vq, struct vhost_scsi_tpg *tpg,
 	return cmd;
 }
 
+static inline struct vhost_scsi_page_cache_ent *
+vhost_scsi_page_cache_ent(struct vhost_scsi_page_cache *pc, unsigned long key)
+{
+	return &pc->ent[hash_long(key >> PAGE_SHIFT,
+				  VHOST_SCSI_PAGE_CACHE_BITS)];
+}
+
+static void vhost_scsi_page_cache_evict(struct vhost_scsi_page_cache *pc,
+					struct vhost_scsi_page_cache_ent *ent)
+{
+	put_page(ent->page);
+	ent->page = NULL;
+	ent->key = 0;
+	pc->nr--;
+}
+
+/*
+ * Drop the cached pages of [start, end).  pc->nr is only looked at under
+ * pc->lock: vhost_scsi_cache_pages() checks vs_mn_seq and then inserts
+ * under the same lock, so an insertion that raced with the invalidation
+ * either sees the new seq or is visible here.
+ */
+static void vhost_scsi_page_cache_drop(struct vhost_scsi_virtqueue *svq,
+				       unsigned long start, unsigned long end)
+{
+	struct vhost_scsi_page_cache *pc = &svq->page_cache;
+	struct vhost_scsi_page_cache_ent *ent;
+	unsigned long addr;
+	int i;
+
+	spin_lock(&pc->lock);
+	if (!pc->nr)
+		goto out;
+
+	if ((end - start) >> PAGE_SHIFT < VHOST_SCSI_PAGE_CACHE_SIZE) {
+		/* both the read and the write key of a page share a slot */
+		for (addr = start & PAGE_MASK; addr < end; addr += PAGE_SIZE) {
+			ent = vhost_scsi_page_cache_ent(pc, addr);
+			if (ent->page && (ent->key & PAGE_MASK) == addr)
+				vhost_scsi_page_cache_evict(pc, ent);
+		}
+	} else {
+		for (i = 0; i < VHOST_SCSI_PAGE_CACHE_SIZE && pc->nr; i++) {
+			ent = &pc->ent[i];
+			addr = ent->key & PAGE_MASK;
+			if (ent->page && addr >= (start & PAGE_MASK) &&
+			    addr < end)
+				vhost_scsi_page_cache_evict(pc, ent);
+		}
+	}
+out:
+	spin_unlock(&pc->lock);
+}
+
+static void vhost_scsi_page_cache_drop_all(struct vhost_scsi *vs)
+{
+	int i;
+
+	for (i = 0; i < VHOST_SCSI_MAX_VQ; i++)
+		vhost_scsi_page_cache_drop(&vs->vqs[i], 0, ULONG_MAX);
+}
+
+static int vhost_scsi_mn_invalidate_range_start(struct mmu_notifier *mn,
+					const struct mmu_notifier_range *range)
+{
+	struct vhost_scsi *vs = container_of(mn, struct vhost_scsi, vs_mn);
+	int i;
+
+	atomic_inc(&vs->vs_mn_invalidating);
+	smp_mb__after_atomic();
+	atomic_inc(&vs->vs_mn_seq);
+	/* pairs with the seq check of vhost_scsi_cache_pages() */
+	smp_mb__after_atomic();
+	for (i = 0; i < VHOST_SCSI_MAX_VQ; i++)
+		vhost_scsi_page_cache_drop(&vs->vqs[i], range->start,
+					   range->end);
+	return 0;
+}
+
+static void vhost_scsi_mn_invalidate_range_end(struct mmu_notifier *mn,
+					const struct mmu_notifier_range *range)
+{
+	struct vhost_scsi *vs = container_of(mn, struct vhost_scsi, vs_mn);
+
+	atomic_dec(&vs->vs_mn_invalidating);
+}
+
+static void vhost_scsi_mn_release(struct mmu_notifier *mn,
+				  struct mm_struct *mm)
+{
+	struct vhost_scsi *vs = container_of(mn, struct vhost_scsi, vs_mn);
+
+	/* the pages are not going to be mapped by the guest anymore */
+	atomic_inc(&vs->vs_mn_invalidating);
+	atomic_inc(&vs->vs_mn_seq);
+	vhost_scsi_page_cache_drop_all(vs);
+}
+
+static const struct mmu_notifier_ops vhost_scsi_mn_ops = {
+	.invalidate_range_start	= vhost_scsi_mn_invalidate_range_start,
+	.invalidate_range_end	= vhost_scsi_mn_invalidate_range_end,
+	.release		= vhost_scsi_mn_release,
+};
+
+/* Called with vs->dev.mutex held */
+static void vhost_scsi_page_cache_enable(struct vhost_scsi *vs)
+{
+	int ret;
+
+	if (!vhost_scsi_page_cache || vs->vs_mn_mm || !vs->dev.mm)
+		return;
+
+	vs->vs_mn.ops = &vhost_scsi_mn_ops;
+	ret = mmu_notifier_register(&vs->vs_mn, vs->dev.mm);
+	if (ret) {
+		pr_warn("Unable to register mmu notifier, page cache disabled: %d\n",
+			ret);
+		return;
+	}
+	vs->vs_mn_mm = vs->dev.mm;
+}
+
+static void vhost_scsi_page_cache_disable(struct vhost_scsi *vs)
+{
+	if (!vs->vs_mn_mm)
+		return;
+
+	mmu_notifier_unregister(&vs->vs_mn, vs->vs_mn_mm);
+	vs->vs_mn_mm = NULL;
+	vhost_scsi_page_cache_drop_all(vs);
+}
+
+static inline unsigned long
+vhost_scsi_page_cache_key(unsigned long uaddr, bool write)
+{
+	return (uaddr & PAGE_MASK) | write;
+}
+
+/*
+ * Map the current segment of @iter out of the page cache of the command
+ * virtqueue.  Either every page of the segment is cached, or nothing is
+ * done and 0 is returned.
+ */
+static int
+vhost_scsi_map_cached(struct vhost_scsi_cmd *cmd, struct iov_iter *iter,
+		      struct scatterlist *sgl, bool write)
+{
+	struct vhost_scsi_virtqueue *svq = container_of(cmd->tvc_vq,
+					struct vhost_scsi_virtqueue, vq);
+	struct vhost_scsi_page_cache *pc = &svq->page_cache;
+	struct page **pages = cmd->tvc_upages;
+	struct vhost_scsi *vs = cmd->tvc_vhost;
+	struct vhost_scsi_page_cache_ent *ent;
+	unsigned long uaddr, addr;
+	size_t bytes, offset;
+	unsigned int npages, i;
+
+	if (!READ_ONCE(pc->nr) || atomic_read(&vs->vs_mn_invalidating))
+		return 0;
+
+	uaddr = (unsigned long)iter->iov->iov_base + iter->iov_offset;
+	bytes = min(iter->iov->iov_len - iter->iov_offset, iter->count);
+	offset = offset_in_page(uaddr);
+	npages = DIV_ROUND_UP(offset + bytes, PAGE_SIZE);
+	if (!bytes || npages > VHOST_SCSI_PAGE_CACHE_MAX_SEG)
+		return 0;
+
+	spin_lock(&pc->lock);
+	for (i = 0, addr = uaddr; i < npages; i++, addr += PAGE_SIZE) {
+		unsigned long key = vhost_scsi_page_cache_key(addr, write);
+
+		ent = vhost_scsi_page_cache_ent(pc, key);
+		if (!ent->page || ent->key != key) {
+			spin_unlock(&pc->lock);
+			return 0;
+		}
+		pages[i] = ent->page;
+	}
+	for (i = 0; i < npages; i++)
+		get_page(pages[i]);
+	spin_unlock(&pc->lock);
+
+	iov_iter_advance(iter, bytes);
+
+	for (i = 0; bytes; i++) {
+		unsigned int n = min_t(unsigned int, PAGE_SIZE - offset, bytes);
+
+		sg_set_page(&sgl[i], pages[i], n, offset);
+		bytes -= n;
+		offset = 0;
+	}
+	return npages;
+}
+
+/*
+ * Remember the pages just pinned for [uaddr, uaddr + npages pages), unless
+ * the mappings may have changed since before they were looked up (@seq).
+ */
+static void
+vhost_scsi_cache_pages(struct vhost_scsi_cmd *cmd, unsigned long uaddr,
+		       struct page **pages, unsigned int npages, bool write,
+		       int seq)
+{
+	struct vhost_scsi_virtqueue *svq = container_of(cmd->tvc_vq,
+					struct vhost_scsi_virtqueue, vq);
+	struct vhost_scsi_page_cache *pc = &svq->page_cache;
+	struct vhost_scsi *vs = cmd->tvc_vhost;
+	struct vhost_scsi_page_cache_ent *ent;
+	unsigned int i;
+
+	spin_lock(&pc->lock);
+	if (atomic_read(&vs->vs_mn_invalidating) ||
+	    atomic_read(&vs->vs_mn_seq) != seq)
+		goto out;
+
+	for (i = 0; i < npages; i++, uaddr += PAGE_SIZE) {
+		unsigned long key = vhost_scsi_page_cache_key(uaddr, write);
+
+		ent = vhost_scsi_page_cache_ent(pc, key);
+		if (ent->page) {
+			if (ent->key == key && ent->page == pages[i])
+				continue;
+			vhost_scsi_page_cache_evict(pc, ent);
+		}
+		get_page(pages[i]);
+		ent->page = pages[i];
+		ent->key = key;
+		pc->nr++;
+	}
+out:
+	spin_unlock(&pc->lock);
+}
+
 /*
  * Map a user memory range into a scatterlist
  *
@@ -637,11 +925,31 @@ vhost_scsi_map_to_sgl(struct vhost_scsi_cmd *cmd,
 		      struct scatterlist *sgl,
 		      bool write)
 {
+	struct vhost_scsi *vs = cmd->tvc_vhost;
 	struct page **pages = cmd->tvc_upages;
 	struct scatterlist *sg = sgl;
+	unsigned long uaddr = 0;
+	bool cache = false;
 	ssize_t bytes;
 	size_t offset;
 	unsigned int npages = 0;
+	int ret, seq = 0;
+
+	/*
+	 * The cache is keyed by user address, so it only works with the
+	 * current segment being the one iov_iter_get_pages() pins.
+	 */
+	if (READ_ONCE(vs->vs_mn_mm) && iter_is_iovec(iter) &&
+	    iter->iov_offset < iter->iov->iov_len) {
+		ret = vhost_scsi_map_cached(cmd, iter, sgl, write);
+		if (ret)
+			return ret;
+
+		uaddr = (unsigned long)iter->iov->iov_base + iter->iov_offset;
+		seq = atomic_read(&vs->vs_mn_seq);
+		smp_rmb();
+		cache = !atomic_read(&vs->vs_mn_invalidating);
+	}
 
 	bytes = iov_iter_get_pages(iter, pages, LONG_MAX,
 				VHOST_SCSI_PREALLOC_UPAGES, &offset);
@@ -651,6 +959,11 @@ vhost_scsi_map_to_sgl(struct vhost_scsi_cmd *cmd,
 
 	iov_iter_advance(iter, bytes);
 
+	npages = DIV_ROUND_UP(offset + bytes, PAGE_SIZE);
+	if (cache && npages <= VHOST_SCSI_PAGE_CACHE_MAX_SEG)
+		vhost_scsi_cache_pages(cmd, uaddr, pages, npages, write, seq);
+	npages = 0;
+
 	while (bytes) {
 		unsigned n = min_t(unsigned, PAGE_SIZE - offset, bytes);
 		sg_set_page(sg++, pages[npages++], n, offset);
@@ -1390,7 +1703,7 @@ vhost_scsi_send_evt(struct vhost_scsi *vs,
 	}
 
 	llist_add(&evt->list, &vs->vs_event_list);
-	vhost_work_queue(&vs->dev, &vs->vs_event_work);
+	vhost_vq_work_queue(&vs->vqs[VHOST_SCSI_VQ_EVT].vq, &vs->vs_event_work);
 }
 
 static void vhost_scsi_evt_handle_kick(struct vhost_work *work)
@@ -1613,6 +1926,8 @@ vhost_scsi_set_endpoint(struct vhost_scsi *vs,
 				goto destroy_vq_cmds;
 		}
 
+		vhost_scsi_page_cache_enable(vs);
+
 		for (i = 0; i < VHOST_SCSI_MAX_VQ; i++) {
 			vq = &vs->vqs[i].vq;
 			mutex_lock(&vq->mutex);
@@ -1728,6 +2043,7 @@ vhost_scsi_clear_endpoint(struct vhost_scsi *vs,
 			vq = &vs->vqs[i].vq;
 			vhost_scsi_destroy_vq_cmds(vq);
 		}
+		vhost_scsi_page_cache_drop_all(vs);
 	}
 	/*
 	 * Act as synchronize_rcu to make sure access to
@@ -1788,7 +2104,6 @@ static int vhost_scsi_open(struct inode *inode, struct file *f)
 	if (!vqs)
 		goto err_vqs;
 
-	vhost_work_init(&vs->vs_completion_work, vhost_scsi_complete_cmd_work);
 	vhost_work_init(&vs->vs_event_work, vhost_scsi_evt_work);
 
 	vs->vs_events_nr = 0;
@@ -1802,8 +2117,15 @@ static int vhost_scsi_open(struct inode *inode, struct file *f)
 		vqs[i] = &vs->vqs[i].vq;
 		vs->vqs[i].vq.handle_kick = vhost_scsi_handle_kick;
 	}
+	for (i = 0; i < VHOST_SCSI_MAX_VQ; i++) {
+		vhost_work_init(&vs->vqs[i].completion_work,
+				vhost_scsi_complete_cmd_work);
+		init_llist_head(&vs->vqs[i].completion_list);
+		spin_lock_init(&vs->vqs[i].page_cache.lock);
+	}
 	vhost_dev_init(&vs->dev, vqs, VHOST_SCSI_MAX_VQ, UIO_MAXIOV,
 		       VHOST_SCSI_WEIGHT, 0, true, NULL);
+	vs->dev.nworkers = vhost_scsi_workers;
 
 	vhost_scsi_init_inflight(vs, NULL);
 
@@ -1826,6 +2148,7 @@ static int vhost_scsi_release(struct inode *inode, struct file *f)
 	mutex_unlock(&vs->dev.mutex);
 	vhost_scsi_clear_endpoint(vs, &t);
 	vhost_dev_stop(&vs->dev);
+	vhost_scsi_page_cache_disable(vs);
 	vhost_dev_cleanup(&vs->dev);
 	/* Jobs can re-queue themselves in evt kick handler. Do extra flush. */
 	vhost_scsi_flush(vs);
@@ -185,14 +185,17 @@ void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn)
 }
 EXPORT_SYMBOL_GPL(vhost_work_init);
 
-/* Init poll structure */
+/* Init poll structure. Works of polls with a vq run on the worker of the vq,
+ * the others on the first worker of the device. */
 void vhost_poll_init(struct vhost_poll *poll, vhost_work_fn_t fn,
-		     __poll_t mask, struct vhost_dev *dev)
+		     __poll_t mask, struct vhost_dev *dev,
+		     struct vhost_virtqueue *vq)
 {
 	init_waitqueue_func_entry(&poll->wait, vhost_poll_wakeup);
 	init_poll_funcptr(&poll->table, vhost_poll_func);
 	poll->mask = mask;
 	poll->dev = dev;
+	poll->vq = vq;
 	poll->wqh = NULL;
 
 	vhost_work_init(&poll->work, fn);
@@ -231,17 +234,39 @@ void vhost_poll_stop(struct vhost_poll *poll)
 }
 EXPORT_SYMBOL_GPL(vhost_poll_stop);
 
-void vhost_work_dev_flush(struct vhost_dev *dev)
+static void vhost_worker_queue(struct vhost_worker *worker,
+			       struct vhost_work *work)
+{
+	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
+		/* We can only add the work to the list after we're
+		 * sure it was not in the list.
+		 * test_and_set_bit() implies a memory barrier.
+		 */
+		llist_add(&work->node, &worker->work_list);
+		wake_up_process(worker->task);
+	}
+}
+
+static void vhost_worker_flush(struct vhost_worker *worker)
 {
 	struct vhost_flush_struct flush;
 
-	if (dev->worker) {
-		init_completion(&flush.wait_event);
-		vhost_work_init(&flush.work, vhost_flush_work);
+	init_completion(&flush.wait_event);
+	vhost_work_init(&flush.work, vhost_flush_work);
 
-		vhost_work_queue(dev, &flush.work);
-		wait_for_completion(&flush.wait_event);
-	}
+	vhost_worker_queue(worker, &flush.work);
+	wait_for_completion(&flush.wait_event);
+}
+
+void vhost_work_dev_flush(struct vhost_dev *dev)
+{
+	int i;
+
+	if (!dev->workers)
+		return;
+
+	for (i = 0; i < dev->nworkers; i++)
+		vhost_worker_flush(&dev->workers[i]);
 }
 EXPORT_SYMBOL_GPL(vhost_work_dev_flush);
 
@@ -255,30 +280,54 @@ EXPORT_SYMBOL_GPL(vhost_poll_flush);
 
 void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
 {
-	if (!dev->worker)
+	if (!dev->workers)
 		return;
 
-	if (!test_and_set_bit(VHOST_WORK_QUEUED, &work->flags)) {
-		/* We can only add the work to the list after we're
-		 * sure it was not in the list.
-		 * test_and_set_bit() implies a memory barrier.
-		 */
-		llist_add(&work->node, &dev->work_list);
-		wake_up_process(dev->worker);
-	}
+	vhost_worker_queue(&dev->workers[0], work);
 }
 EXPORT_SYMBOL_GPL(vhost_work_queue);
 
+void vhost_vq_work_queue(struct vhost_virtqueue *vq, struct vhost_work *work)
+{
+	struct vhost_worker *worker = READ_ONCE(vq->worker);
+
+	if (!worker)
+		return;
+
+	vhost_worker_queue(worker, work);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_work_queue);
+
 /* A lockless hint for busy polling code to exit the loop */
 bool vhost_has_work(struct vhost_dev *dev)
 {
-	return !llist_empty(&dev->work_list);
+	int i;
+
+	if (!dev->workers)
+		return false;
+
+	for (i = 0; i < dev->nworkers; i++)
+		if (!llist_empty(&dev->workers[i].work_list))
+			return true;
+	return false;
 }
 EXPORT_SYMBOL_GPL(vhost_has_work);
 
+/* Same as vhost_has_work(), for the worker @vq is running on only */
+bool vhost_vq_has_work(struct vhost_virtqueue *vq)
+{
+	struct vhost_worker *worker = READ_ONCE(vq->worker);
+
+	return worker && !llist_empty(&worker->work_list);
+}
+EXPORT_SYMBOL_GPL(vhost_vq_has_work);
+
 void vhost_poll_queue(struct vhost_poll *poll)
 {
-	vhost_work_queue(poll->dev, &poll->work);
+	if (poll->vq)
+		vhost_vq_work_queue(poll->vq, &poll->work);
+	else
+		vhost_work_queue(poll->dev, &poll->work);
 }
 EXPORT_SYMBOL_GPL(vhost_poll_queue);
 
@@ -343,7 +392,8 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work, *work_next;
 	struct llist_node *node;
 
@@ -358,7 +408,7 @@ static int vhost_worker(void *data)
 			break;
 		}
 
-		node = llist_del_all(&dev->work_list);
+		node = llist_del_all(&worker->work_list);
 		if (!node)
 			schedule();
 
@@ -481,13 +531,13 @@ void vhost_dev_init(struct vhost_dev *dev,
 	dev->umem = NULL;
 	dev->iotlb = NULL;
 	dev->mm = NULL;
-	dev->worker = NULL;
+	dev->workers = NULL;
+	dev->nworkers = 1;
 	dev->iov_limit = iov_limit;
 	dev->weight = weight;
 	dev->byte_weight = byte_weight;
 	dev->use_worker = use_worker;
 	dev->msg_handler = msg_handler;
-	init_llist_head(&dev->work_list);
 	init_waitqueue_head(&dev->wait);
 	INIT_LIST_HEAD(&dev->read_list);
 	INIT_LIST_HEAD(&dev->pending_list);
@@ -500,11 +550,12 @@ void vhost_dev_init(struct vhost_dev *dev,
 		vq->indirect = NULL;
 		vq->heads = NULL;
 		vq->dev = dev;
+		vq->worker = NULL;
 		mutex_init(&vq->mutex);
 		vhost_vq_reset(dev, vq);
 		if (vq->handle_kick)
 			vhost_poll_init(&vq->poll, vq->handle_kick,
-					EPOLLIN, dev);
+					EPOLLIN, dev, vq);
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_dev_init);
@@ -534,12 +585,17 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 static int vhost_attach_cgroups(struct vhost_dev *dev)
 {
 	struct vhost_attach_cgroups_struct attach;
+	int i;
 
 	attach.owner = current;
-	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_dev_flush(dev);
-	return attach.ret;
+	for (i = 0; i < dev->nworkers; i++) {
+		vhost_work_init(&attach.work, vhost_attach_cgroups_work);
+		vhost_worker_queue(&dev->workers[i], &attach.work);
+		vhost_worker_flush(&dev->workers[i]);
+		if (attach.ret)
+			return attach.ret;
+	}
+	return 0;
 }
 
 /* Caller should have device mutex */
@@ -579,10 +635,68 @@ static void vhost_detach_mm(struct vhost_dev *dev)
 	dev->mm = NULL;
 }
 
+static void vhost_workers_free(struct vhost_dev *dev)
+{
+	int i;
+
+	if (!dev->workers)
+		return;
+
+	for (i = 0; i < dev->nvqs; i++)
+		WRITE_ONCE(dev->vqs[i]->worker, NULL);
+
+	for (i = 0; i < dev->nworkers; i++) {
+		WARN_ON(!llist_empty(&dev->workers[i].work_list));
+		if (dev->workers[i].task)
+			kthread_stop(dev->workers[i].task);
+	}
+	kfree(dev->workers);
+	dev->workers = NULL;
+}
+
+static int vhost_workers_create(struct vhost_dev *dev)
+{
+	struct vhost_worker *workers;
+	struct task_struct *task;
+	int i, err;
+
+	dev->nworkers = clamp(dev->nworkers, 1, max(dev->nvqs, 1));
+	workers = kcalloc(dev->nworkers, sizeof(*workers), GFP_KERNEL);
+	if (!workers)
+		return -ENOMEM;
+	dev->workers = workers;
+
+	for (i = 0; i < dev->nworkers; i++) {
+		workers[i].dev = dev;
+		init_llist_head(&workers[i].work_list);
+		task = kthread_create(vhost_worker, &workers[i],
+				      "vhost-%d", current->pid);
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			goto err;
+		}
+
+		workers[i].task = task;
+		wake_up_process(task); /* avoid contributing to loadavg */
+	}
+
+	/* each worker gets the cgroups, cpuset included, of the owner */
+	err = vhost_attach_cgroups(dev);
+	if (err)
+		goto err;
+
+	for (i = 0; i < dev->nvqs; i++)
+		WRITE_ONCE(dev->vqs[i]->worker, &workers[i % dev->nworkers]);
+
+	return 0;
+err:
+	vhost_workers_free(dev);
+	return err;
+}
+
 /* Caller should have device mutex */
 long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
 	int err;
 
 	/* Is there an owner already? */
@@ -595,19 +709,9 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	dev->kcov_handle = kcov_common_handle();
 	if (dev->use_worker) {
-		worker = kthread_create(vhost_worker, dev,
-					"vhost-%d", current->pid);
-		if (IS_ERR(worker)) {
-			err = PTR_ERR(worker);
-			goto err_worker;
-		}
-
-		dev->worker = worker;
-		wake_up_process(worker); /* avoid contributing to loadavg */
-
-		err = vhost_attach_cgroups(dev);
+		err = vhost_workers_create(dev);
 		if (err)
-			goto err_cgroup;
+			goto err_worker;
 	}
 
 	err = vhost_dev_alloc_iovecs(dev);
@@ -616,10 +720,7 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	return 0;
 err_cgroup:
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
-	}
+	vhost_workers_free(dev);
 err_worker:
 	vhost_detach_mm(dev);
 	dev->kcov_handle = 0;
@@ -712,10 +813,8 @@ void vhost_dev_cleanup(struct vhost_dev *dev)
 	dev->iotlb = NULL;
 	vhost_clear_msg(dev);
 	wake_up_interruptible_poll(&dev->wait, EPOLLIN | EPOLLRDNORM);
-	WARN_ON(!llist_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
+	if (dev->workers) {
+		vhost_workers_free(dev);
 		dev->kcov_handle = 0;
 	}
 	vhost_detach_mm(dev);
@@ -21,6 +21,8 @@
 #include <linux/magic.h>
 #include <linux/pseudo_fs.h>
 #include <linux/page_reporting.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
 
 /*
  * Balloon device works in 4K page units.  So each page is pointed to by
@@ -28,7 +30,15 @@
  * page units.
  */
 #define VIRTIO_BALLOON_PAGES_PER_PAGE (unsigned)(PAGE_SIZE >> VIRTIO_BALLOON_PFN_SHIFT)
-#define VIRTIO_BALLOON_ARRAY_PFNS_MAX 256
+/* Up to 16MB worth of pfns per round trip to the host */
+#define VIRTIO_BALLOON_ARRAY_PFNS_MAX 4096
+/*
+ * The balloon is inflated with blocks of up to this order first (2MB with
+ * 4K pages, the THP size on most architectures) and with single pages once
+ * memory is too fragmented for those.  Blocks are not movable: they are
+ * allocated as unmovable so as not to pin down movable pageblocks.
+ */
+#define VIRTIO_BALLOON_HUGE_ORDER_MAX 9
 /* Maximum number of (4k) pages to deflate on OOM notifications. */
 #define VIRTIO_BALLOON_OOM_NR_PAGES 256
 #define VIRTIO_BALLOON_OOM_NOTIFY_PRIORITY 80
@@ -46,6 +56,11 @@
 static struct vfsmount *balloon_mnt;
 #endif
 
+static unsigned int huge_order = VIRTIO_BALLOON_HUGE_ORDER_MAX;
+module_param(huge_order, uint, 0444);
+MODULE_PARM_DESC(huge_order, "Order of the blocks to inflate the balloon with,"
+			     " 0 for single pages only");
+
 enum virtio_balloon_vq {
 	VIRTIO_BALLOON_VQ_INFLATE,
 	VIRTIO_BALLOON_VQ_DEFLATE,
@@ -59,6 +74,13 @@ enum virtio_balloon_config_read {
 	VIRTIO_BALLOON_CONFIG_READ_CMD_ID = 0,
 };
 
+/* Inflate/deflate activity per block order, in blocks */
+struct virtio_balloon_order_stat {
+	u64 inflated;
+	u64 deflated;
+	u64 alloc_failed;
+};
+
 struct virtio_balloon {
 	struct virtio_device *vdev;
 	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq, *free_page_vq;
@@ -107,6 +129,14 @@ struct virtio_balloon {
 	 */
 	struct balloon_dev_info vb_dev_info;
 
+	/*
+	 * The blocks of 2^huge_order pages we've told the Host we're not
+	 * using, linked by their first page.  Each of them adds
+	 * VIRTIO_BALLOON_PAGES_PER_PAGE << huge_order to num_pages.
+	 */
+	struct list_head huge_pages;
+	unsigned int huge_order;
+
 	/* Synchronize access/update to this struct virtio_balloon elements */
 	struct mutex balloon_lock;
 
@@ -114,6 +144,12 @@ struct virtio_balloon {
 	unsigned int num_pfns;
 	__virtio32 pfns[VIRTIO_BALLOON_ARRAY_PFNS_MAX];
 
+	/* Protected by balloon_lock */
+	struct virtio_balloon_order_stat order_stats[VIRTIO_BALLOON_HUGE_ORDER_MAX + 1];
+	u64 inflate_ns;
+	u64 deflate_ns;
+	struct dentry *debugfs;
+
 	/* Memory statistics */
 	struct virtio_balloon_stat stats[VIRTIO_BALLOON_S_NR];
 
@@ -193,33 +229,59 @@ static int virtballoon_free_page_report(struct page_reporting_dev_info *pr_dev_i
 }
 
 static void set_page_pfns(struct virtio_balloon *vb,
-			  __virtio32 pfns[], struct page *page)
+			  __virtio32 pfns[], struct page *page,
+			  unsigned int order)
 {
 	unsigned int i;
 
 	BUILD_BUG_ON(VIRTIO_BALLOON_PAGES_PER_PAGE > VIRTIO_BALLOON_ARRAY_PFNS_MAX);
 
 	/*
-	 * Set balloon pfns pointing at this page.
+	 * Set balloon pfns pointing at this page, or block of pages.
 	 * Note that the first pfn points at start of the page.
 	 */
-	for (i = 0; i < VIRTIO_BALLOON_PAGES_PER_PAGE; i++)
+	for (i = 0; i < VIRTIO_BALLOON_PAGES_PER_PAGE << order; i++)
 		pfns[i] = cpu_to_virtio32(vb->vdev,
 					  page_to_balloon_pfn(page) + i);
 }
 
+static unsigned int huge_block_pfns(struct virtio_balloon *vb)
+{
+	return VIRTIO_BALLOON_PAGES_PER_PAGE << vb->huge_order;
+}
+
+static struct page *balloon_huge_page_alloc(unsigned int order)
+{
+	return alloc_pages(GFP_HIGHUSER | __GFP_NOMEMALLOC | __GFP_NORETRY |
+			   __GFP_NOWARN, order);
+}
+
 static unsigned fill_balloon(struct virtio_balloon *vb, size_t num)
 {
+	unsigned int block_pfns = huge_block_pfns(vb);
 	unsigned num_allocated_pages;
-	unsigned num_pfns;
+	unsigned int huge_failed = 0;
+	ktime_t start = ktime_get();
+	unsigned num_pfns = 0;
 	struct page *page;
 	LIST_HEAD(pages);
+	LIST_HEAD(huge_pages);
 
 	/* We can only do one array worth at a time. */
 	num = min(num, ARRAY_SIZE(vb->pfns));
 
-	for (num_pfns = 0; num_pfns < num;
-	     num_pfns += VIRTIO_BALLOON_PAGES_PER_PAGE) {
+	/* Whole blocks as long as they fit and can be had, pages then */
+	while (vb->huge_order && num - num_pfns >= block_pfns) {
+		page = balloon_huge_page_alloc(vb->huge_order);
+		if (!page) {
+			huge_failed++;
+			break;
+		}
+		list_add(&page->lru, &huge_pages);
+		num_pfns += block_pfns;
+	}
+
+	for (; num_pfns < num; num_pfns += VIRTIO_BALLOON_PAGES_PER_PAGE) {
 		struct page *page = balloon_page_alloc();
 
 		if (!page) {
@@ -238,21 +300,41 @@ static unsigned fill_balloon(struct virtio_balloon *vb, size_t num)
 
 	vb->num_pfns = 0;
 
+	while ((page = list_first_entry_or_null(&huge_pages, struct page,
+						lru))) {
+		list_move(&page->lru, &vb->huge_pages);
+
+		set_page_pfns(vb, vb->pfns + vb->num_pfns, page,
+			      vb->huge_order);
+		vb->num_pages += block_pfns;
+		if (!virtio_has_feature(vb->vdev,
+					VIRTIO_BALLOON_F_DEFLATE_ON_OOM))
+			adjust_managed_page_count(page,
+						  -(1L << vb->huge_order));
+		vb->num_pfns += block_pfns;
+		vb->order_stats[vb->huge_order].inflated++;
+	}
+	vb->order_stats[vb->huge_order].alloc_failed += huge_failed;
+
 	while ((page = balloon_page_pop(&pages))) {
 		balloon_page_enqueue(&vb->vb_dev_info, page);
 
-		set_page_pfns(vb, vb->pfns + vb->num_pfns, page);
+		set_page_pfns(vb, vb->pfns + vb->num_pfns, page, 0);
 		vb->num_pages += VIRTIO_BALLOON_PAGES_PER_PAGE;
 		if (!virtio_has_feature(vb->vdev,
 					VIRTIO_BALLOON_F_DEFLATE_ON_OOM))
 			adjust_managed_page_count(page, -1);
 		vb->num_pfns += VIRTIO_BALLOON_PAGES_PER_PAGE;
+		vb->order_stats[0].inflated++;
 	}
+	if (vb->num_pfns < num)
+		vb->order_stats[0].alloc_failed++;
 
 	num_allocated_pages = vb->num_pfns;
 	/* Did we get any? */
 	if (vb->num_pfns != 0)
 		tell_host(vb, vb->inflate_vq);
+	vb->inflate_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 	mutex_unlock(&vb->balloon_lock);
 
 	return num_allocated_pages;
@@ -272,12 +354,40 @@ static void release_pages_balloon(struct virtio_balloon *vb,
 	}
 }
 
+static void release_huge_pages_balloon(struct virtio_balloon *vb,
+				       struct list_head *pages)
+{
+	struct page *page, *next;
+
+	list_for_each_entry_safe(page, next, pages, lru) {
+		if (!virtio_has_feature(vb->vdev,
+					VIRTIO_BALLOON_F_DEFLATE_ON_OOM))
+			adjust_managed_page_count(page, 1L << vb->huge_order);
+		list_del(&page->lru);
+		__free_pages(page, vb->huge_order);
+	}
+}
+
+/* Called with balloon_lock held */
+static void leak_huge_page(struct virtio_balloon *vb, struct list_head *pages)
+{
+	struct page *page = list_first_entry(&vb->huge_pages, struct page, lru);
+
+	list_move(&page->lru, pages);
+	set_page_pfns(vb, vb->pfns + vb->num_pfns, page, vb->huge_order);
+	vb->num_pages -= huge_block_pfns(vb);
+	vb->num_pfns += huge_block_pfns(vb);
+	vb->order_stats[vb->huge_order].deflated++;
+}
+
 static unsigned leak_balloon(struct virtio_balloon *vb, size_t num)
 {
 	unsigned num_freed_pages;
 	struct page *page;
 	struct balloon_dev_info *vb_dev_info = &vb->vb_dev_info;
+	ktime_t start = ktime_get();
 	LIST_HEAD(pages);
+	LIST_HEAD(huge_pages);
 
 	/* We can only do one array worth at a time. */
 	num = min(num, ARRAY_SIZE(vb->pfns));
@@ -285,16 +395,30 @@ static unsigned leak_balloon(struct virtio_balloon *vb, size_t num)
 	mutex_lock(&vb->balloon_lock);
 	/* We can't release more pages than taken */
 	num = min(num, (size_t)vb->num_pages);
-	for (vb->num_pfns = 0; vb->num_pfns < num;
+	vb->num_pfns = 0;
+	/* Give back contiguous memory first */
+	while (num - vb->num_pfns >= huge_block_pfns(vb) &&
+	       !list_empty(&vb->huge_pages))
+		leak_huge_page(vb, &huge_pages);
+
+	for (; vb->num_pfns < num;
 	     vb->num_pfns += VIRTIO_BALLOON_PAGES_PER_PAGE) {
 		page = balloon_page_dequeue(vb_dev_info);
 		if (!page)
 			break;
-		set_page_pfns(vb, vb->pfns + vb->num_pfns, page);
+		set_page_pfns(vb, vb->pfns + vb->num_pfns, page, 0);
 		list_add(&page->lru, &pages);
 		vb->num_pages -= VIRTIO_BALLOON_PAGES_PER_PAGE;
+		vb->order_stats[0].deflated++;
 	}
 
+	/*
+	 * Out of single pages with less than a block to go: release a whole
+	 * block rather than nothing, the balloon gets refilled if need be.
+	 */
+	if (!vb->num_pfns && num && !list_empty(&vb->huge_pages))
+		leak_huge_page(vb, &huge_pages);
+
 	num_freed_pages = vb->num_pfns;
 	/*
 	 * Note that if
@@ -304,10 +428,38 @@ static unsigned leak_balloon(struct virtio_balloon *vb, size_t num)
 	if (vb->num_pfns != 0)
 		tell_host(vb, vb->deflate_vq);
 	release_pages_balloon(vb, &pages);
+	release_huge_pages_balloon(vb, &huge_pages);
+	vb->deflate_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
 	mutex_unlock(&vb->balloon_lock);
 	return num_freed_pages;
 }
 
+static int virtio_balloon_debug_show(struct seq_file *f, void *unused)
+{
+	struct virtio_balloon *vb = f->private;
+	unsigned int order;
+
+	mutex_lock(&vb->balloon_lock);
+	seq_printf(f, "num_pages: %u\n", vb->num_pages);
+	seq_printf(f, "inflate_ms: %llu\n", div_u64(vb->inflate_ns, NSEC_PER_MSEC));
+	seq_printf(f, "deflate_ms: %llu\n", div_u64(vb->deflate_ns, NSEC_PER_MSEC));
+	seq_puts(f, "order inflated deflated alloc_failed\n");
+	for (order = 0; order <= vb->huge_order; order++) {
+		struct virtio_balloon_order_stat *s = &vb->order_stats[order];
+
+		if (order && order != vb->huge_order)
+			continue;
+		seq_printf(f, "%5u %8llu %8llu %12llu\n", order, s->inflated,
+			   s->deflated, s->alloc_failed);
+	}
+	mutex_unlock(&vb->balloon_lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(virtio_balloon_debug);
+
+/* virtio-balloon/<device>/stats, there may be more than one balloon */
+static struct dentry *virtio_balloon_debugfs_root;
+
 static inline void update_stat(struct virtio_balloon *vb, int idx,
 			       u16 tag, u64 val)
 {
@@ -788,7 +940,7 @@ static int virtballoon_migratepage(struct balloon_dev_info *vb_dev_info,
 	__count_vm_event(BALLOON_MIGRATE);
 	spin_unlock_irqrestore(&vb_dev_info->pages_lock, flags);
 	vb->num_pfns = VIRTIO_BALLOON_PAGES_PER_PAGE;
-	set_page_pfns(vb, vb->pfns, newpage);
+	set_page_pfns(vb, vb->pfns, newpage, 0);
 	tell_host(vb, vb->inflate_vq);
 
 	/* balloon's page migration 2nd step -- deflate "page" */
@@ -796,7 +948,7 @@ static int virtballoon_migratepage(struct balloon_dev_info *vb_dev_info,
 	balloon_page_delete(page);
 	spin_unlock_irqrestore(&vb_dev_info->pages_lock, flags);
 	vb->num_pfns = VIRTIO_BALLOON_PAGES_PER_PAGE;
-	set_page_pfns(vb, vb->pfns, page);
+	set_page_pfns(vb, vb->pfns, page, 0);
 	tell_host(vb, vb->deflate_vq);
 
 	mutex_unlock(&vb->balloon_lock);
@@ -903,6 +1055,12 @@ static int virtballoon_probe(struct virtio_device *vdev)
 	vb->vdev = vdev;
 
 	balloon_devinfo_init(&vb->vb_dev_info);
+	INIT_LIST_HEAD(&vb->huge_pages);
+	/* a block must fit in the pfn array */
+	vb->huge_order = min_t(unsigned int, huge_order,
+			       min(VIRTIO_BALLOON_HUGE_ORDER_MAX, MAX_ORDER - 1));
+	while (huge_block_pfns(vb) > VIRTIO_BALLOON_ARRAY_PFNS_MAX)
+		vb->huge_order--;
 
 	err = init_vqs(vb);
 	if (err)
@@ -1017,6 +1175,11 @@ static int virtballoon_probe(struct virtio_device *vdev)
 
 	virtio_device_ready(vdev);
 
+	vb->debugfs = debugfs_create_dir(dev_name(&vdev->dev),
+					 virtio_balloon_debugfs_root);
+	debugfs_create_file("stats", 0444, vb->debugfs, vb,
+			    &virtio_balloon_debug_fops);
+
 	if (towards_target(vb))
 		virtballoon_changed(vdev);
 	return 0;
@@ -1065,6 +1228,7 @@ static void virtballoon_remove(struct virtio_device *vdev)
 {
 	struct virtio_balloon *vb = vdev->priv;
 
+	debugfs_remove_recursive(vb->debugfs);
 	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING))
 		page_reporting_unregister(&vb->pr_dev_info);
 	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_DEFLATE_ON_OOM))
@@ -1165,7 +1329,26 @@ static struct virtio_driver virtio_balloon_driver = {
 #endif
 };
 
-module_virtio_driver(virtio_balloon_driver);
+static int __init virtio_balloon_init(void)
+{
+	int err;
+
+	virtio_balloon_debugfs_root = debugfs_create_dir("virtio-balloon",
+							 NULL);
+	err = register_virtio_driver(&virtio_balloon_driver);
+	if (err)
+		debugfs_remove_recursive(virtio_balloon_debugfs_root);
+	return err;
+}
+
+static void __exit virtio_balloon_exit(void)
+{
+	unregister_virtio_driver(&virtio_balloon_driver);
+	debugfs_remove_recursive(virtio_balloon_debugfs_root);
+}
+
+module_init(virtio_balloon_init);
+module_exit(virtio_balloon_exit);
 MODULE_DEVICE_TABLE(virtio, id_table);
 MODULE_DESCRIPTION("Virtio balloon driver");
 MODULE_LICENSE("GPL");
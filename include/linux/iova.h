@@ -26,12 +26,15 @@ struct iova_magazine;
 struct iova_cpu_rcache;
 
 #define IOVA_RANGE_CACHE_MAX_SIZE 6	/* log of max cached IOVA range size (in pages) */
+#define IOVA_RANGE_CACHE_MAX_LIMIT 12	/* upper bound for the above, per domain */
 #define MAX_GLOBAL_MAGS 32	/* magazines per bin */
+#define MAX_GLOBAL_MAGS_LIMIT (MAX_GLOBAL_MAGS << 4) /* ... once grown */
 
 struct iova_rcache {
 	spinlock_t lock;
 	unsigned long depot_size;
-	struct iova_magazine *depot[MAX_GLOBAL_MAGS];
+	unsigned long depot_max;	/* grows when the depot overflows */
+	struct iova_magazine *depot;	/* list of full magazines */
 	struct iova_cpu_rcache __percpu *cpu_rcaches;
 };
 
@@ -83,7 +86,8 @@ struct iova_domain {
 						   have been finished */
 
 	struct iova	anchor;		/* rbtree lookup anchor */
-	struct iova_rcache rcaches[IOVA_RANGE_CACHE_MAX_SIZE];	/* IOVA range caches */
+	struct iova_rcache *rcaches;	/* IOVA range caches */
+	unsigned int	rcache_max_size; /* log of max cached range size + 1 */
 
 	iova_flush_cb	flush_cb;	/* Call-Back function to flush IOMMU
 					   TLBs */
@@ -133,6 +137,15 @@ static inline unsigned long iova_pfn(struct iova_domain *iovad, dma_addr_t iova)
 	return iova >> iova_shift(iovad);
 }
 
+/*
+ * Allocations smaller than this must be rounded up to a power of two so
+ * that they can go back into the range caches when freed.
+ */
+static inline unsigned long iova_rcache_range_max(struct iova_domain *iovad)
+{
+	return iovad->rcache_max_size ? 1UL << (iovad->rcache_max_size - 1) : 0;
+}
+
 #if IS_ENABLED(CONFIG_IOMMU_IOVA)
 int iova_cache_get(void);
 void iova_cache_put(void);
@@ -153,6 +166,8 @@ struct iova *reserve_iova(struct iova_domain *iovad, unsigned long pfn_lo,
 	unsigned long pfn_hi);
 void init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 	unsigned long start_pfn);
+int iova_domain_set_rcache_max(struct iova_domain *iovad,
+			       unsigned int max_size);
 int init_iova_flush_queue(struct iova_domain *iovad,
 			  iova_flush_cb flush_cb, iova_entry_dtor entry_dtor);
 struct iova *find_iova(struct iova_domain *iovad, unsigned long pfn);
@@ -216,6 +231,12 @@ static inline void init_iova_domain(struct iova_domain *iovad,
 {
 }
 
+static inline int iova_domain_set_rcache_max(struct iova_domain *iovad,
+					     unsigned int max_size)
+{
+	return -ENODEV;
+}
+
 static inline int init_iova_flush_queue(struct iova_domain *iovad,
 					iova_flush_cb flush_cb,
 					iova_entry_dtor entry_dtor)
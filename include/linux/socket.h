@@ -364,10 +364,15 @@ struct ucred {
 #define SOL_KCM		281
 #define SOL_TLS		282
 #define SOL_XDP		283
+#define SOL_MPTCP	284
+#define SOL_VSOCK	287
 
 /* IPX options */
 #define IPX_TYPE	1
 
+/* AF_VSOCK error queue control message type (SOL_VSOCK level) */
+#define VSOCK_RECVERR	1
+
 extern int move_addr_to_kernel(void __user *uaddr, int ulen, struct sockaddr_storage *kaddr);
 extern int put_cmsg(struct msghdr*, int level, int type, int len, void *data);
 
@@ -43,6 +43,7 @@ struct tty_bufhead {
 	struct llist_head free;		/* Free queue head */
 	atomic_t	   mem_used;    /* In-use buffers excluding free list */
 	int		   mem_limit;
+	int		   alloc_size;	/* Size of new buffers, adaptive */
 	struct tty_buffer *tail;	/* Active buffer */
 };
 
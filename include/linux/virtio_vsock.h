@@ -11,6 +11,10 @@
 #define VIRTIO_VSOCK_MAX_BUF_SIZE		0xFFFFFFFFUL
 #define VIRTIO_VSOCK_MAX_PKT_BUF_SIZE		(1024 * 64)
 
+/* Upper bound of user pages a MSG_ZEROCOPY packet can reference */
+#define VIRTIO_VSOCK_MAX_ZC_PAGES \
+	(VIRTIO_VSOCK_MAX_PKT_BUF_SIZE / PAGE_SIZE + 1)
+
 enum {
 	VSOCK_VQ_RX     = 0, /* for host to guest data */
 	VSOCK_VQ_TX     = 1, /* for guest to host data */
@@ -50,6 +54,14 @@ struct virtio_vsock_pkt {
 	u32 off;
 	bool reply;
 	bool tap_delivered;
+
+	/* MSG_ZEROCOPY: payload lives in pinned user pages instead of buf.
+	 * The completion is reported when the packet is freed.
+	 */
+	struct ubuf_info *uarg;
+	struct page **zc_pages;
+	unsigned int zc_nr_pages;
+	unsigned int zc_off;
 };
 
 struct virtio_vsock_pkt_info {
@@ -61,6 +73,7 @@ struct virtio_vsock_pkt_info {
 	u16 op;
 	u32 flags;
 	bool reply;
+	bool zcopy;
 };
 
 struct virtio_transport {
@@ -69,6 +82,12 @@ struct virtio_transport {
 
 	/* Takes ownership of the packet */
 	int (*send_pkt)(struct virtio_vsock_pkt *pkt);
+
+	/* Optional: can a packet referencing 'bufs_num' user pages be
+	 * queued without copying?  Transports that leave this unset only
+	 * ever see packets with a linear buf.
+	 */
+	bool (*can_msgzerocopy)(int bufs_num);
 };
 
 ssize_t
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef __UAPI_PSAMPLE_RING_H
+#define __UAPI_PSAMPLE_RING_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Ring buffer delivery of psample samples.
+ *
+ * A collector opens /dev/psample, attaches the file to a sample group of
+ * its network namespace with PSAMPLE_RING_ATTACH, then mmap()s one page
+ * plus nr_records * record_size bytes at offset 0.  The first page holds
+ * struct psample_ring_ctrl, the records follow it, each of them
+ * record_size bytes long.
+ *
+ * The kernel fills the record at index (producer & (nr_records - 1)) and
+ * then advances producer.  The collector reads the records up to producer
+ * (load-acquire) and then stores the new consumer index (store-release).
+ * Samples for which there is no room are counted in dropped.  producer,
+ * written and dropped are only copies of the kernel's own counters:
+ * writing to them has no effect on the kernel.
+ * poll() reports the file readable when there are records to consume.
+ */
+
+struct psample_ring_req {
+	__u32	group;		/* psample group number */
+	__u32	record_size;	/* bytes per record, multiple of 8 */
+	__u32	nr_records;	/* power of 2 */
+	__u32	flags;		/* must be 0 */
+};
+
+struct psample_ring_ctrl {
+	__u32	producer;	/* written by the kernel */
+	__u32	pad1;
+	__u32	consumer;	/* written by the collector */
+	__u32	pad2;
+	__u64	written;	/* samples stored in the ring */
+	__u64	dropped;	/* samples lost because the ring was full */
+};
+
+#define PSAMPLE_RING_F_IIFINDEX		(1 << 0)
+#define PSAMPLE_RING_F_OIFINDEX		(1 << 1)
+#define PSAMPLE_RING_F_OUT_TC		(1 << 2)
+#define PSAMPLE_RING_F_OUT_TC_OCC	(1 << 3)
+#define PSAMPLE_RING_F_LATENCY		(1 << 4)
+
+struct psample_ring_record {
+	__u64	timestamp;	/* ns, CLOCK_REALTIME */
+	__u64	out_tc_occ;
+	__u64	latency;
+	__u32	group_seq;
+	__u32	sample_rate;
+	__u32	orig_size;	/* length of the sampled packet */
+	__u32	data_len;	/* packet bytes following this header */
+	__u32	in_ifindex;
+	__u32	out_ifindex;
+	__u16	proto;		/* skb->protocol, host order */
+	__u16	out_tc;
+	__u32	flags;		/* PSAMPLE_RING_F_* valid fields */
+	__u8	data[];
+};
+
+#define PSAMPLE_RING_ATTACH	_IOW('p', 0xE0, struct psample_ring_req)
+
+#endif /* __UAPI_PSAMPLE_RING_H */
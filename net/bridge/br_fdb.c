@@ -56,12 +56,25 @@ void br_fdb_fini(void)
 
 int br_fdb_hash_init(struct net_bridge *br)
 {
-	return rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	int err, cpu;
+
+	br->fdb_learn = alloc_percpu(struct br_fdb_learn_batch);
+	if (!br->fdb_learn)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(br->fdb_learn, cpu)->lock);
+
+	err = rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	if (err)
+		free_percpu(br->fdb_learn);
+	return err;
 }
 
 void br_fdb_hash_fini(struct net_bridge *br)
 {
 	rhashtable_destroy(&br->fdb_hash_tbl);
+	free_percpu(br->fdb_learn);
 }
 
 /* if topology_changing then use forward_delay (default 15 sec)
@@ -201,6 +214,13 @@ static void fdb_delete(struct net_bridge *br, struct net_bridge_fdb_entry *f,
 	if (test_bit(BR_FDB_STATIC, &f->flags))
 		fdb_del_hw_addr(br, f->key.addr.addr);
 
+	/* keep the ageing work position valid */
+	if (unlikely(br->fdb_gc_cursor == f))
+		br->fdb_gc_cursor = hlist_entry_safe(
+			rcu_dereference_protected(hlist_next_rcu(&f->fdb_node),
+						  lockdep_is_held(&br->hash_lock)),
+			struct net_bridge_fdb_entry, fdb_node);
+
 	hlist_del_init_rcu(&f->fdb_node);
 	rhashtable_remove_fast(&br->fdb_hash_tbl, &f->rhnode,
 			       br_fdb_rht_params);
@@ -334,38 +354,62 @@ void br_fdb_change_mac_address(struct net_bridge *br, const u8 *newaddr)
 	spin_unlock_bh(&br->hash_lock);
 }
 
+/* Ageing goes through the fdb list in slices of BR_FDB_GC_SLICE entries,
+ * so that a large table neither keeps the work busy for long nor is
+ * entirely rescanned every time the next entry expires. Entries are added
+ * at the head of the list, a pass therefore covers every entry which
+ * existed when it started; newer ones are not due for a while anyway.
+ */
 void br_fdb_cleanup(struct work_struct *work)
 {
 	struct net_bridge *br = container_of(work, struct net_bridge,
 					     gc_work.work);
-	struct net_bridge_fdb_entry *f = NULL;
+	unsigned int budget = BR_FDB_GC_SLICE;
 	unsigned long delay = hold_time(br);
-	unsigned long work_delay = delay;
+	struct net_bridge_fdb_entry *f;
 	unsigned long now = jiffies;
+	unsigned long work_delay;
 
 	/* this part is tricky, in order to avoid blocking learning and
 	 * consequently forwarding, we rely on rcu to delete objects with
 	 * delayed freeing allowing us to continue traversing
 	 */
 	rcu_read_lock();
-	hlist_for_each_entry_rcu(f, &br->fdb_list, fdb_node) {
+	spin_lock_bh(&br->hash_lock);
+	f = br->fdb_gc_cursor;
+	if (!f) {
+		/* start a new pass */
+		f = hlist_entry_safe(
+			rcu_dereference_protected(hlist_first_rcu(&br->fdb_list),
+						  lockdep_is_held(&br->hash_lock)),
+			struct net_bridge_fdb_entry, fdb_node);
+		br->fdb_gc_next = now + delay;
+	}
+	spin_unlock_bh(&br->hash_lock);
+
+	for (; f && budget; budget--,
+	     f = hlist_entry_safe(rcu_dereference(hlist_next_rcu(&f->fdb_node)),
+				  struct net_bridge_fdb_entry, fdb_node)) {
 		unsigned long this_timer = f->updated + delay;
 
 		if (test_bit(BR_FDB_STATIC, &f->flags) ||
 		    test_bit(BR_FDB_ADDED_BY_EXT_LEARN, &f->flags)) {
 			if (test_bit(BR_FDB_NOTIFY, &f->flags)) {
-				if (time_after(this_timer, now))
-					work_delay = min(work_delay,
-							 this_timer - now);
-				else if (!test_and_set_bit(BR_FDB_NOTIFY_INACTIVE,
-							   &f->flags))
+				if (time_after(this_timer, now)) {
+					if (time_before(this_timer,
+							br->fdb_gc_next))
+						br->fdb_gc_next = this_timer;
+				} else if (!test_and_set_bit(BR_FDB_NOTIFY_INACTIVE,
+							     &f->flags)) {
 					fdb_notify(br, f, RTM_NEWNEIGH, false);
+				}
 			}
 			continue;
 		}
 
 		if (time_after(this_timer, now)) {
-			work_delay = min(work_delay, this_timer - now);
+			if (time_before(this_timer, br->fdb_gc_next))
+				br->fdb_gc_next = this_timer;
 		} else {
 			spin_lock_bh(&br->hash_lock);
 			if (!hlist_unhashed(&f->fdb_node))
@@ -373,10 +417,25 @@ void br_fdb_cleanup(struct work_struct *work)
 			spin_unlock_bh(&br->hash_lock);
 		}
 	}
+
+	/* resume from @f in the next slice; should it have been deleted in
+	 * the meantime, just restart the pass from the head
+	 */
+	spin_lock_bh(&br->hash_lock);
+	br->fdb_gc_cursor = f && !hlist_unhashed(&f->fdb_node) ? f : NULL;
+	spin_unlock_bh(&br->hash_lock);
 	rcu_read_unlock();
 
-	/* Cleanup minimum 10 milliseconds apart */
-	work_delay = max_t(unsigned long, work_delay, msecs_to_jiffies(10));
+	if (f) {
+		/* more to go, let other work run in between */
+		work_delay = 1;
+	} else {
+		work_delay = time_after(br->fdb_gc_next, now) ?
+			     br->fdb_gc_next - now : 0;
+		/* Cleanup minimum 10 milliseconds apart */
+		work_delay = max_t(unsigned long, work_delay,
+				   msecs_to_jiffies(10));
+	}
 	mod_delayed_work(system_long_wq, &br->gc_work, work_delay);
 }
 
@@ -579,6 +638,42 @@ static bool __fdb_mark_active(struct net_bridge_fdb_entry *fdb)
 		  test_and_clear_bit(BR_FDB_NOTIFY_INACTIVE, &fdb->flags));
 }
 
+/* called from the rx path, with bh disabled */
+static void br_fdb_learn_queue(struct net_bridge *br,
+			       const struct net_bridge_port *source,
+			       const unsigned char *addr, u16 vid)
+{
+	struct br_fdb_learn_batch *b = this_cpu_ptr(br->fdb_learn);
+	struct br_fdb_learn_entry *e;
+	bool kick = false;
+	unsigned int i;
+
+	spin_lock(&b->lock);
+	for (i = 0; i < b->count; i++) {
+		e = &b->entries[i];
+		/* first port seen wins, as with direct insertion */
+		if (e->vid == vid && ether_addr_equal(e->addr, addr))
+			goto out;
+	}
+
+	/* rate limit: until the work catches up, the address is unknown
+	 * and its traffic keeps being flooded
+	 */
+	if (b->count == BR_FDB_LEARN_BATCH)
+		goto out;
+
+	e = &b->entries[b->count];
+	ether_addr_copy(e->addr, addr);
+	e->vid = vid;
+	e->port_no = source->port_no;
+	kick = !b->count++;
+out:
+	spin_unlock(&b->lock);
+
+	if (kick)
+		queue_work(system_highpri_wq, &br->fdb_learn_work);
+}
+
 void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		   const unsigned char *addr, u16 vid, unsigned long flags)
 {
@@ -624,6 +719,9 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 				fdb_notify(br, fdb, RTM_NEWNEIGH, true);
 			}
 		}
+	} else if (!flags) {
+		/* learned from the data path, leave it to the batch work */
+		br_fdb_learn_queue(br, source, addr, vid);
 	} else {
 		spin_lock(&br->hash_lock);
 		fdb = fdb_create(br, source, addr, vid, flags);
@@ -638,6 +736,53 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 	}
 }
 
+/* Insert the addresses queued on every cpu, taking hash_lock once per
+ * batch rather than once per address.
+ */
+void br_fdb_learn_work(struct work_struct *work)
+{
+	struct net_bridge *br = container_of(work, struct net_bridge,
+					     fdb_learn_work);
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct br_fdb_learn_batch *b = per_cpu_ptr(br->fdb_learn, cpu);
+		unsigned int i;
+
+		if (!READ_ONCE(b->count))
+			continue;
+
+		rcu_read_lock();
+		spin_lock_bh(&br->hash_lock);
+		spin_lock(&b->lock);
+		for (i = 0; i < b->count; i++) {
+			struct br_fdb_learn_entry *e = &b->entries[i];
+			struct net_bridge_fdb_entry *fdb;
+			struct net_bridge_port *p;
+
+			/* looked up under hash_lock, so that a port being
+			 * removed is either gone already or will have its
+			 * entries flushed after ours have been added
+			 */
+			p = br_get_port(br, e->port_no);
+			if (!p || !(p->flags & BR_LEARNING))
+				continue;
+
+			fdb = fdb_create(br, p, e->addr, e->vid, 0);
+			if (fdb) {
+				trace_br_fdb_update(br, p, e->addr, e->vid, 0);
+				fdb_notify(br, fdb, RTM_NEWNEIGH, true);
+			}
+		}
+		b->count = 0;
+		spin_unlock(&b->lock);
+		spin_unlock_bh(&br->hash_lock);
+		rcu_read_unlock();
+
+		cond_resched();
+	}
+}
+
 static int fdb_to_nud(const struct net_bridge *br,
 		      const struct net_bridge_fdb_entry *fdb)
 {
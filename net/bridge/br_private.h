@@ -269,6 +269,28 @@ struct net_bridge_fdb_entry {
 	struct rcu_head			rcu;
 };
 
+/* Addresses learned from the data path are queued on the receiving cpu and
+ * inserted in batches by br_fdb_learn_work(), so that the rx path never
+ * contends on hash_lock. A full batch drops further new addresses, which are
+ * simply learned again from a later packet.
+ */
+#define BR_FDB_LEARN_BATCH	64
+
+struct br_fdb_learn_entry {
+	unsigned char			addr[ETH_ALEN];
+	u16				vid;
+	u16				port_no;
+};
+
+struct br_fdb_learn_batch {
+	spinlock_t			lock;
+	unsigned int			count;
+	struct br_fdb_learn_entry	entries[BR_FDB_LEARN_BATCH];
+};
+
+/* number of fdb entries looked at by each run of the ageing work */
+#define BR_FDB_GC_SLICE		1024
+
 #define MDB_PG_FLAGS_PERMANENT	BIT(0)
 #define MDB_PG_FLAGS_OFFLOAD	BIT(1)
 #define MDB_PG_FLAGS_FAST_LEAVE	BIT(2)
@@ -514,6 +536,11 @@ struct net_bridge {
 	struct timer_list		tcn_timer;
 	struct timer_list		topology_change_timer;
 	struct delayed_work		gc_work;
+	/* ageing position, protected by hash_lock */
+	struct net_bridge_fdb_entry	*fdb_gc_cursor;
+	unsigned long			fdb_gc_next;
+	struct br_fdb_learn_batch	__percpu *fdb_learn;
+	struct work_struct		fdb_learn_work;
 	struct kobject			*ifobj;
 	u32				auto_cnt;
 
@@ -759,6 +786,7 @@ void br_fdb_find_delete_local(struct net_bridge *br,
 void br_fdb_changeaddr(struct net_bridge_port *p, const unsigned char *newaddr);
 void br_fdb_change_mac_address(struct net_bridge *br, const u8 *newaddr);
 void br_fdb_cleanup(struct work_struct *work);
+void br_fdb_learn_work(struct work_struct *work);
 void br_fdb_delete_by_port(struct net_bridge *br,
 			   const struct net_bridge_port *p, u16 vid, int do_all);
 struct net_bridge_fdb_entry *br_fdb_find_rcu(struct net_bridge *br,
@@ -1733,6 +1733,116 @@ static int prepare_read_control_remainder(struct ceph_connection *con)
 	return 0;
 }
 
+/*
+ * Move on to the next piece of data once the current one is full,
+ * unless it is the last one: that is left to prepare_read_data_cont().
+ */
+static bool next_in_data_bvec(struct ceph_connection *con)
+{
+	struct bio_vec bv;
+
+	if (con->v2.in_cursor.total_resid <= con->v2.in_bvec.bv_len)
+		return false;
+
+	ceph_msg_data_advance(&con->v2.in_cursor, con->v2.in_bvec.bv_len);
+	get_bvec_at(&con->v2.in_cursor, &bv);
+	set_in_bvec(con, &bv);
+	return true;
+}
+
+/*
+ * Copy what is at @offset in @skb straight to the message data pages,
+ * updating the data crc while the bytes are still hot in the cache.
+ */
+static int recv_data_actor(read_descriptor_t *desc, struct sk_buff *skb,
+			   unsigned int offset, size_t len)
+{
+	struct ceph_connection *con = desc->arg.data;
+	struct bio_vec *bv = &con->v2.in_bvec;
+	size_t copied = 0;
+
+	while (copied < len) {
+		size_t resid = iov_iter_count(&con->v2.in_iter);
+		size_t n;
+		void *p;
+
+		if (!resid) {
+			if (!next_in_data_bvec(con)) {
+				desc->count = 0;
+				break;
+			}
+			continue;
+		}
+
+		n = min(len - copied, resid);
+		p = kmap_local_page(bv->bv_page);
+		p += bv->bv_offset + bv->bv_len - resid;
+		if (skb_copy_bits(skb, offset + copied, p, n)) {
+			kunmap_local(p);
+			desc->count = 0;
+			return copied ?: -EFAULT;
+		}
+		if (!con_secure(con))
+			con->in_data_crc = crc32c(con->in_data_crc, p, n);
+		kunmap_local(p);
+
+		iov_iter_advance(&con->v2.in_iter, n);
+		copied += n;
+	}
+
+	if (!iov_iter_count(&con->v2.in_iter) &&
+	    con->v2.in_cursor.total_resid <= bv->bv_len)
+		desc->count = 0;
+	return copied;
+}
+
+/*
+ * Read message data.  Unlike ceph_tcp_recv(), pages are filled straight
+ * from the skbs for as long as there is something queued on the socket
+ * rather than one recvmsg() call per page, and in plain mode the crc is
+ * computed as the data is copied instead of in a second pass over the
+ * pages.  In secure mode the ciphertext lands in the pages as well and
+ * gets decrypted in place by decrypt_message().
+ *
+ * Return values are the same as for ceph_tcp_recv().
+ */
+static int ceph_tcp_recv_data(struct ceph_connection *con)
+{
+	struct socket *sock = con->sock;
+	read_descriptor_t desc = {
+		.arg.data = con,
+		.count = 1,
+	};
+	int ret;
+
+	if (unlikely(!sock->ops->read_sock)) {
+		struct bio_vec *bv = &con->v2.in_bvec;
+		size_t resid = iov_iter_count(&con->v2.in_iter);
+
+		ret = ceph_tcp_recv(con);
+		if (ret >= 0 && !con_secure(con)) {
+			size_t off = bv->bv_len - resid;
+
+			con->in_data_crc = ceph_crc32c_page(con->in_data_crc,
+				bv->bv_page, bv->bv_offset + off,
+				resid - iov_iter_count(&con->v2.in_iter));
+		}
+		return ret;
+	}
+
+	dout("%s con %p resid %zu need %zu\n", __func__, con,
+	     con->v2.in_cursor.total_resid, iov_iter_count(&con->v2.in_iter));
+	lock_sock(sock->sk);
+	ret = sock->ops->read_sock(sock->sk, &desc, recv_data_actor);
+	release_sock(sock->sk);
+	dout("%s con %p ret %d left %zu\n", __func__, con, ret,
+	     iov_iter_count(&con->v2.in_iter));
+	if (ret < 0)
+		return ret;
+
+	return !iov_iter_count(&con->v2.in_iter);
+}
+
 static void prepare_read_data(struct ceph_connection *con)
 {
 	struct bio_vec bv;
@@ -1751,12 +1861,7 @@ static void prepare_read_data_cont(struct ceph_connection *con)
 {
 	struct bio_vec bv;
 
-	if (!con_secure(con))
-		con->in_data_crc = ceph_crc32c_page(con->in_data_crc,
-						    con->v2.in_bvec.bv_page,
-						    con->v2.in_bvec.bv_offset,
-						    con->v2.in_bvec.bv_len);
-
+	/* the data crc is updated by ceph_tcp_recv_data() */
 	ceph_msg_data_advance(&con->v2.in_cursor, con->v2.in_bvec.bv_len);
 	if (con->v2.in_cursor.total_resid) {
 		get_bvec_at(&con->v2.in_cursor, &bv);
@@ -2838,7 +2943,11 @@ int ceph_con_v2_try_read(struct ceph_connection *con)
 		return -ENODATA;
 
 	for (;;) {
-		ret = ceph_tcp_recv(con);
+		if (con->state == CEPH_CON_S_OPEN &&
+		    con->v2.in_state == IN_S_PREPARE_READ_DATA_CONT)
+			ret = ceph_tcp_recv_data(con);
+		else
+			ret = ceph_tcp_recv(con);
 		if (ret <= 0)
 			return ret;
 
@@ -1427,11 +1427,11 @@ bool mptcp_subflow_active(struct mptcp_subflow_context *subflow)
 	return __mptcp_subflow_active(subflow);
 }
 
-/* implement the mptcp packet scheduler;
+/* the default mptcp packet scheduler;
  * returns the subflow that will transmit the next DSS
  * additionally updates the rtx timeout
  */
-static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
+struct sock *mptcp_default_get_send(struct mptcp_sock *msk)
 {
 	struct subflow_send_info send_info[2];
 	struct mptcp_subflow_context *subflow;
@@ -1442,14 +1442,6 @@ static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 	u64 ratio;
 	u32 pace;
 
-	sock_owned_by_me(sk);
-
-	if (__mptcp_check_fallback(msk)) {
-		if (!msk->first)
-			return NULL;
-		return sk_stream_memory_free(msk->first) ? msk->first : NULL;
-	}
-
 	/* re-use last subflow, if the burst allow that */
 	if (msk->last_snd && msk->snd_burst > 0 &&
 	    sk_stream_memory_free(msk->last_snd) &&
@@ -1501,6 +1493,30 @@ static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
 	return NULL;
 }
 
+/* returns the subflow that will transmit the next DSS, as chosen by the
+ * msk packet scheduler; additionally updates the rtx timeout
+ */
+static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct sock *ssk;
+
+	sock_owned_by_me(sk);
+
+	if (__mptcp_check_fallback(msk)) {
+		if (!msk->first)
+			return NULL;
+		return sk_stream_memory_free(msk->first) ? msk->first : NULL;
+	}
+
+	ssk = msk->sched->get_send(msk);
+
+	/* the default policy updates the timeout while scanning the subflows */
+	if (msk->sched->get_send != mptcp_default_get_send)
+		mptcp_set_timeout(sk);
+	return ssk;
+}
+
 static void mptcp_push_release(struct sock *sk, struct sock *ssk,
 			       struct mptcp_sendmsg_info *info)
 {
@@ -1508,6 +1524,53 @@ static void mptcp_push_release(struct sock *sk, struct sock *ssk,
 	release_sock(ssk);
 }
 
+/* duplicate the data in the [start, msk->snd_nxt) range on the subflows
+ * selected by the scheduler; the peer discards the copies arriving late
+ * the same way it does for MPTCP-level retransmissions
+ */
+static void __mptcp_push_redundant(struct sock *sk, u64 start,
+				   unsigned int flags)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+	u64 end = msk->snd_nxt;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		struct mptcp_sendmsg_info info = {
+			.flags = flags,
+		};
+		struct mptcp_data_frag *dfrag;
+		int ret;
+
+		if (!mptcp_subflow_active(subflow) ||
+		    !msk->sched->send_copy(msk, ssk))
+			continue;
+
+		lock_sock(ssk);
+		list_for_each_entry(dfrag, &msk->rtx_queue, list) {
+			u64 dfrag_end = dfrag->data_seq + dfrag->already_sent;
+
+			if (!after64(dfrag_end, start))
+				continue;
+			if (!before64(dfrag->data_seq, end))
+				break;
+
+			info.sent = max(start, dfrag->data_seq) - dfrag->data_seq;
+			info.limit = min(end, dfrag_end) - dfrag->data_seq;
+			while (info.sent < info.limit) {
+				ret = mptcp_sendmsg_frag(sk, ssk, dfrag, &info);
+				if (ret <= 0)
+					goto release;
+
+				info.sent += ret;
+			}
+		}
+release:
+		mptcp_push_release(sk, ssk, &info);
+	}
+}
+
 void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 {
 	struct sock *prev_ssk = NULL, *ssk = NULL;
@@ -1515,6 +1578,7 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 	struct mptcp_sendmsg_info info = {
 				.flags = flags,
 	};
+	u64 snd_nxt = msk->snd_nxt;
 	struct mptcp_data_frag *dfrag;
 	int len, copied = 0;
 
@@ -1566,6 +1630,9 @@ void __mptcp_push_pending(struct sock *sk, unsigned int flags)
 		mptcp_push_release(sk, ssk, &info);
 
 out:
+	if (copied && msk->sched->send_copy && !__mptcp_check_fallback(msk))
+		__mptcp_push_redundant(sk, snd_nxt, flags);
+
 	/* ensure the rtx timer is running */
 	if (!mptcp_timer_pending(sk))
 		mptcp_reset_timer(sk);
@@ -1580,6 +1647,7 @@ static void __mptcp_subflow_push_pending(struct sock *sk, struct sock *ssk)
 		.data_lock_held = true,
 	};
 	struct mptcp_data_frag *dfrag;
+	u64 snd_nxt = msk->snd_nxt;
 	struct sock *xmit_ssk;
 	int len, copied = 0;
 	bool first = true;
@@ -1634,6 +1702,16 @@ static void __mptcp_subflow_push_pending(struct sock *sk, struct sock *ssk)
 		if (msk->snd_data_fin_enable &&
 		    msk->snd_nxt + 1 == msk->write_seq)
 			mptcp_schedule_work(sk);
+
+		/* the other subflows can't be locked from here, leave the
+		 * copies to the worker, starting from the oldest data not
+		 * duplicated yet
+		 */
+		if (msk->sched->send_copy && !__mptcp_check_fallback(msk)) {
+			if (!test_and_set_bit(MPTCP_WORK_REDUNDANT, &msk->flags))
+				msk->redundant_seq = snd_nxt;
+			mptcp_schedule_work(sk);
+		}
 	}
 }
 
@@ -2141,17 +2219,12 @@ static void mptcp_timeout_timer(struct timer_list *t)
  *
  * A backup subflow is returned only if that is the only kind available.
  */
-static struct sock *mptcp_subflow_get_retrans(struct mptcp_sock *msk)
+static struct sock *mptcp_default_get_retrans(struct mptcp_sock *msk)
 {
 	struct sock *backup = NULL, *pick = NULL;
 	struct mptcp_subflow_context *subflow;
 	int min_stale_count = INT_MAX;
 
-	sock_owned_by_me((const struct sock *)msk);
-
-	if (__mptcp_check_fallback(msk))
-		return NULL;
-
 	mptcp_for_each_subflow(msk, subflow) {
 		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
 
@@ -2182,6 +2255,25 @@ static struct sock *mptcp_subflow_get_retrans(struct mptcp_sock *msk)
 	return min_stale_count > 1 ? backup : NULL;
 }
 
+static struct sock *mptcp_subflow_get_retrans(struct mptcp_sock *msk)
+{
+	sock_owned_by_me((const struct sock *)msk);
+
+	if (__mptcp_check_fallback(msk))
+		return NULL;
+
+	if (msk->sched->get_retrans)
+		return msk->sched->get_retrans(msk);
+	return mptcp_default_get_retrans(msk);
+}
+
+struct mptcp_sched_ops mptcp_sched_default = {
+	.get_send	= mptcp_default_get_send,
+	.get_retrans	= mptcp_default_get_retrans,
+	.name		= "default",
+	.owner		= THIS_MODULE,
+};
+
 static void mptcp_dispose_initial_subflow(struct mptcp_sock *msk)
 {
 	if (msk->subflow) {
@@ -2472,6 +2564,13 @@ static void mptcp_worker(struct work_struct *work)
 	if (test_and_clear_bit(MPTCP_WORK_RTX, &msk->flags))
 		__mptcp_retrans(sk);
 
+	/* the subflow push path sets redundant_seq under the data lock, and
+	 * only while the msk is not owned, so it is stable here
+	 */
+	if (test_and_clear_bit(MPTCP_WORK_REDUNDANT, &msk->flags) &&
+	    msk->sched && msk->sched->send_copy && !__mptcp_check_fallback(msk))
+		__mptcp_push_redundant(sk, msk->redundant_seq, 0);
+
 unlock:
 	release_sock(sk);
 	sock_put(sk);
@@ -2539,6 +2638,10 @@ static int mptcp_init_sock(struct sock *sk)
 	tcp_cleanup_congestion_control(sk);
 	icsk->icsk_ca_ops = NULL;
 
+	rcu_read_lock();
+	mptcp_init_sched(mptcp_sk(sk), mptcp_sched_find(mptcp_get_scheduler(net)));
+	rcu_read_unlock();
+
 	sk_sockets_allocated_inc(sk);
 	sk->sk_rcvbuf = sock_net(sk)->ipv4.sysctl_tcp_rmem[1];
 	sk->sk_sndbuf = sock_net(sk)->ipv4.sysctl_tcp_wmem[1];
@@ -2841,6 +2944,7 @@ struct sock *mptcp_sk_clone(const struct sock *sk,
 	msk->snd_una = msk->write_seq;
 	msk->wnd_end = msk->snd_nxt + req->rsk_rcv_wnd;
 	msk->setsockopt_seq = mptcp_sk(sk)->setsockopt_seq;
+	mptcp_init_sched(msk, mptcp_sk(sk)->sched);
 
 	if (mp_opt->suboptions & OPTIONS_MPTCP_MPC) {
 		msk->can_ack = true;
@@ -2939,6 +3043,7 @@ void mptcp_destroy_common(struct mptcp_sock *msk)
 	skb_rbtree_purge(&msk->out_of_order_queue);
 	mptcp_token_destroy(msk);
 	mptcp_pm_free_anno_list(msk);
+	mptcp_release_sched(msk);
 }
 
 static void mptcp_destroy(struct sock *sk)
@@ -123,6 +123,7 @@
 #define MPTCP_RETRANSMIT	9
 #define MPTCP_WORK_SYNC_SETSOCKOPT 10
 #define MPTCP_CONNECTED		11
+#define MPTCP_WORK_REDUNDANT	12
 
 static inline bool before64(__u64 seq1, __u64 seq2)
 {
@@ -217,6 +218,36 @@ struct mptcp_data_frag {
 };
 
 /* MPTCP connection sock */
+#define MPTCP_SCHED_NAME_MAX	16
+
+/* SOL_MPTCP socket options */
+#define MPTCP_SCHEDULER		1
+
+struct mptcp_sock;
+
+/* MPTCP packet scheduler
+ *
+ * get_send() picks the subflow for the next chunk of new data and is
+ * mandatory; get_retrans() picks the subflow for MPTCP-level retransmissions
+ * and defaults to the built-in policy when not provided.  When send_copy()
+ * is provided, the data just pushed is duplicated on every other active
+ * subflow it returns true for; the peer drops the duplicated DSN ranges.
+ *
+ * All hooks are invoked with the msk socket lock or the msk data lock held
+ * and must not sleep.  Fallback sockets never reach the scheduler.
+ */
+struct mptcp_sched_ops {
+	struct sock	*(*get_send)(struct mptcp_sock *msk);
+	struct sock	*(*get_retrans)(struct mptcp_sock *msk);
+	bool		(*send_copy)(struct mptcp_sock *msk, struct sock *ssk);
+	void		(*init)(struct mptcp_sock *msk);
+	void		(*release)(struct mptcp_sock *msk);
+
+	char			name[MPTCP_SCHED_NAME_MAX];
+	struct module		*owner;
+	struct list_head	list;
+};
+
 struct mptcp_sock {
 	/* inet_connection_sock must be the first member */
 	struct inet_connection_sock sk;
@@ -231,6 +262,9 @@ struct mptcp_sock {
 	struct sock	*last_snd;
 	int		snd_burst;
 	int		old_wspace;
+	u64		redundant_seq;	/* duplicate from here in the worker,
+					 * valid with MPTCP_WORK_REDUNDANT set
+					 */
 	u64		recovery_snd_nxt;	/* in recovery mode accept up to this seq;
 						 * recovery related fields are under data_lock
 						 * protection
@@ -271,6 +305,7 @@ struct mptcp_sock {
 
 	u32 setsockopt_seq;
 	char		ca_name[TCP_CA_NAME_MAX];
+	struct mptcp_sched_ops	*sched;	/* protected by msk socket and data lock */
 };
 
 #define mptcp_lock_sock(___sk, cb) do {					\
@@ -564,6 +599,7 @@ unsigned int mptcp_get_add_addr_timeout(const struct net *net);
 int mptcp_is_checksum_enabled(const struct net *net);
 int mptcp_allow_join_id0(const struct net *net);
 unsigned int mptcp_stale_loss_cnt(const struct net *net);
+const char *mptcp_get_scheduler(const struct net *net);
 void mptcp_subflow_fully_established(struct mptcp_subflow_context *subflow,
 				     struct mptcp_options_received *mp_opt);
 bool __mptcp_retransmit_pending_data(struct sock *sk);
@@ -602,6 +638,19 @@ void mptcp_subflow_set_active(struct mptcp_subflow_context *subflow);
 
 bool mptcp_subflow_active(struct mptcp_subflow_context *subflow);
 
+extern struct mptcp_sched_ops mptcp_sched_default;
+struct sock *mptcp_default_get_send(struct mptcp_sock *msk);
+void __init mptcp_sched_init(void);
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched);
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched);
+struct mptcp_sched_ops *mptcp_sched_find(const char *name);
+struct mptcp_sched_ops *mptcp_sched_find_autoload(struct net *net,
+						  const char *name);
+void mptcp_get_available_schedulers(char *buf, size_t maxlen);
+void mptcp_init_sched(struct mptcp_sock *msk, struct mptcp_sched_ops *sched);
+void mptcp_release_sched(struct mptcp_sock *msk);
+int mptcp_set_scheduler(struct mptcp_sock *msk, const char *name);
+
 static inline void mptcp_subflow_tcp_fallback(struct sock *sk,
 					      struct mptcp_subflow_context *ctx)
 {
@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP
+ *
+ * Pluggable packet schedulers.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <net/tcp.h>
+#include <net/mptcp.h>
+#include "protocol.h"
+
+static DEFINE_SPINLOCK(mptcp_sched_list_lock);
+static LIST_HEAD(mptcp_sched_list);
+
+/* Must be called with rcu lock held */
+struct mptcp_sched_ops *mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list) {
+		if (!strcmp(sched->name, name))
+			return sched;
+	}
+
+	return NULL;
+}
+
+/* Must be called with rcu lock held; may drop it to load the module */
+struct mptcp_sched_ops *mptcp_sched_find_autoload(struct net *net,
+						  const char *name)
+{
+	struct mptcp_sched_ops *sched = mptcp_sched_find(name);
+
+#ifdef CONFIG_MODULES
+	if (!sched && ns_capable(net->user_ns, CAP_NET_ADMIN)) {
+		rcu_read_unlock();
+		request_module("mptcp_sched_%s", name);
+		rcu_read_lock();
+		sched = mptcp_sched_find(name);
+	}
+#endif
+	return sched;
+}
+
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	int ret = 0;
+
+	if (!sched->get_send) {
+		pr_err("%s does not implement required ops\n", sched->name);
+		return -EINVAL;
+	}
+
+	spin_lock(&mptcp_sched_list_lock);
+	if (mptcp_sched_find(sched->name)) {
+		pr_notice("%s already registered\n", sched->name);
+		ret = -EEXIST;
+	} else {
+		list_add_tail_rcu(&sched->list, &mptcp_sched_list);
+		pr_debug("%s registered\n", sched->name);
+	}
+	spin_unlock(&mptcp_sched_list_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_scheduler);
+
+/* Sockets using @sched hold a reference to its owner, so no msk can still
+ * be bound to it once the module is going away.
+ */
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
+{
+	if (sched == &mptcp_sched_default)
+		return;
+
+	spin_lock(&mptcp_sched_list_lock);
+	list_del_rcu(&sched->list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	/* Wait for outstanding readers to complete before the
+	 * module gets removed entirely.
+	 */
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_scheduler);
+
+void mptcp_get_available_schedulers(char *buf, size_t maxlen)
+{
+	struct mptcp_sched_ops *sched;
+	size_t offs = 0;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list) {
+		offs += snprintf(buf + offs, maxlen - offs, "%s%s",
+				 offs == 0 ? "" : " ", sched->name);
+
+		if (WARN_ON_ONCE(offs >= maxlen))
+			break;
+	}
+	rcu_read_unlock();
+}
+
+/* @sched must be pinned by the caller, either via rcu or by a socket
+ * already bound to it
+ */
+void mptcp_init_sched(struct mptcp_sock *msk, struct mptcp_sched_ops *sched)
+{
+	if (!sched || !try_module_get(sched->owner))
+		sched = &mptcp_sched_default;
+
+	msk->sched = sched;
+	if (sched->init)
+		sched->init(msk);
+}
+
+void mptcp_release_sched(struct mptcp_sock *msk)
+{
+	struct mptcp_sched_ops *sched = msk->sched;
+
+	if (!sched)
+		return;
+
+	msk->sched = NULL;
+	if (sched->release)
+		sched->release(msk);
+	module_put(sched->owner);
+}
+
+int mptcp_set_scheduler(struct mptcp_sock *msk, const char *name)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct mptcp_sched_ops *sched;
+
+	rcu_read_lock();
+	sched = mptcp_sched_find_autoload(sock_net(sk), name);
+	if (sched && !try_module_get(sched->owner))
+		sched = NULL;
+	rcu_read_unlock();
+	if (!sched)
+		return -ENOENT;
+
+	lock_sock(sk);
+	/* the tx path may invoke the scheduler under the data lock only */
+	mptcp_data_lock(sk);
+	if (sched != msk->sched) {
+		mptcp_release_sched(msk);
+		msk->last_snd = NULL;
+		msk->snd_burst = 0;
+		mptcp_init_sched(msk, sched);
+	}
+	mptcp_data_unlock(sk);
+	release_sock(sk);
+
+	/* drop the lookup reference, the msk holds its own */
+	module_put(sched->owner);
+	return 0;
+}
+
+static bool mptcp_sched_usable(struct mptcp_subflow_context *subflow)
+{
+	struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+	return mptcp_subflow_active(subflow) && sk_stream_memory_free(ssk) &&
+	       tcp_sk(ssk)->snd_wnd;
+}
+
+/* lowest-RTT-first: fill the fastest subflow until its send buffer is full,
+ * then spill over to the next one; backups are used only when no other
+ * subflow is active
+ */
+static struct sock *mptcp_minrtt_get_send(struct mptcp_sock *msk)
+{
+	u32 min_rtt[2] = { U32_MAX, U32_MAX };
+	struct mptcp_subflow_context *subflow;
+	struct sock *pick[2] = { NULL, NULL };
+	int nr_active = 0;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		u32 srtt;
+
+		if (!mptcp_subflow_active(subflow))
+			continue;
+
+		nr_active += !subflow->backup;
+		if (!mptcp_sched_usable(subflow))
+			continue;
+
+		/* subflows without an RTT sample go last */
+		srtt = READ_ONCE(tcp_sk(ssk)->srtt_us) ? : U32_MAX - 1;
+		if (srtt < min_rtt[subflow->backup]) {
+			min_rtt[subflow->backup] = srtt;
+			pick[subflow->backup] = ssk;
+		}
+	}
+
+	return nr_active ? pick[0] : pick[1];
+}
+
+static struct mptcp_sched_ops mptcp_sched_minrtt = {
+	.get_send	= mptcp_minrtt_get_send,
+	.name		= "minrtt",
+	.owner		= THIS_MODULE,
+};
+
+/* redundant: the default scheduler picks the primary subflow, every other
+ * active non-backup subflow with room in its send buffer carries a copy
+ */
+static bool mptcp_red_send_copy(struct mptcp_sock *msk, struct sock *ssk)
+{
+	return ssk != msk->last_snd && !mptcp_subflow_ctx(ssk)->backup &&
+	       sk_stream_memory_free(ssk);
+}
+
+static struct mptcp_sched_ops mptcp_sched_red = {
+	.get_send	= mptcp_default_get_send,
+	.send_copy	= mptcp_red_send_copy,
+	.name		= "redundant",
+	.owner		= THIS_MODULE,
+};
+
+/* weighted round robin: active non-backup subflows take turns, each turn
+ * lasting for a burst as large as the subflow congestion window, so that
+ * subflows get a share of the traffic proportional to their cwnd
+ */
+static struct sock *mptcp_wrr_get_send(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+	struct sock *first = NULL, *pick = NULL;
+	struct sock *last = msk->last_snd;
+	bool after_last = false;
+	struct tcp_sock *tp;
+
+	if (last && msk->snd_burst > 0 &&
+	    mptcp_sched_usable(mptcp_subflow_ctx(last)))
+		return last;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+
+		if (ssk == last) {
+			after_last = true;
+			continue;
+		}
+
+		if (subflow->backup || !mptcp_sched_usable(subflow))
+			continue;
+
+		if (after_last) {
+			pick = ssk;
+			break;
+		}
+		if (!first)
+			first = ssk;
+	}
+
+	if (!pick)
+		pick = first;
+	if (!pick && last && !mptcp_subflow_ctx(last)->backup &&
+	    mptcp_sched_usable(mptcp_subflow_ctx(last)))
+		pick = last;
+
+	/* nothing usable in the rotation, let the default policy pick a backup */
+	if (!pick)
+		return mptcp_default_get_send(msk);
+
+	tp = tcp_sk(pick);
+	msk->last_snd = pick;
+	msk->snd_burst = min_t(u32, tp->snd_cwnd * tp->mss_cache, tp->snd_wnd);
+	return pick;
+}
+
+static struct mptcp_sched_ops mptcp_sched_wrr = {
+	.get_send	= mptcp_wrr_get_send,
+	.name		= "wrr",
+	.owner		= THIS_MODULE,
+};
+
+void __init mptcp_sched_init(void)
+{
+	mptcp_register_scheduler(&mptcp_sched_default);
+	mptcp_register_scheduler(&mptcp_sched_minrtt);
+	mptcp_register_scheduler(&mptcp_sched_red);
+	mptcp_register_scheduler(&mptcp_sched_wrr);
+}
@@ -609,6 +609,36 @@ static int mptcp_setsockopt_sol_tcp(struct mptcp_sock *msk, int optname,
 	return -EOPNOTSUPP;
 }
 
+static int mptcp_setsockopt_sol_mptcp_scheduler(struct mptcp_sock *msk, sockptr_t optval,
+						 unsigned int optlen)
+{
+	char name[MPTCP_SCHED_NAME_MAX];
+	int ret;
+
+	if (optlen < 1)
+		return -EINVAL;
+
+	ret = strncpy_from_sockptr(name, optval,
+				   min_t(long, MPTCP_SCHED_NAME_MAX - 1, optlen));
+	if (ret < 0)
+		return -EFAULT;
+
+	name[ret] = 0;
+
+	return mptcp_set_scheduler(msk, name);
+}
+
+static int mptcp_setsockopt_sol_mptcp(struct mptcp_sock *msk, int optname,
+				      sockptr_t optval, unsigned int optlen)
+{
+	switch (optname) {
+	case MPTCP_SCHEDULER:
+		return mptcp_setsockopt_sol_mptcp_scheduler(msk, optval, optlen);
+	}
+
+	return -EOPNOTSUPP;
+}
+
 int mptcp_setsockopt(struct sock *sk, int level, int optname,
 		     sockptr_t optval, unsigned int optlen)
 {
@@ -620,6 +650,9 @@ int mptcp_setsockopt(struct sock *sk, int level, int optname,
 	if (level == SOL_SOCKET)
 		return mptcp_setsockopt_sol_socket(msk, optname, optval, optlen);
 
+	if (level == SOL_MPTCP)
+		return mptcp_setsockopt_sol_mptcp(msk, optname, optval, optlen);
+
 	if (!mptcp_supported_sockopt(level, optname))
 		return -ENOPROTOOPT;
 
@@ -684,6 +717,40 @@ static int mptcp_getsockopt_sol_tcp(struct mptcp_sock *msk, int optname,
 	return -EOPNOTSUPP;
 }
 
+static int mptcp_getsockopt_sol_mptcp_scheduler(struct mptcp_sock *msk,
+						 char __user *optval, int __user *optlen)
+{
+	char name[MPTCP_SCHED_NAME_MAX];
+	struct sock *sk = (struct sock *)msk;
+	int len;
+
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < 0)
+		return -EINVAL;
+
+	lock_sock(sk);
+	strscpy(name, msk->sched->name, sizeof(name));
+	release_sock(sk);
+
+	len = min_t(unsigned int, len, MPTCP_SCHED_NAME_MAX);
+	if (put_user(len, optlen))
+		return -EFAULT;
+	if (copy_to_user(optval, name, len))
+		return -EFAULT;
+	return 0;
+}
+
+static int mptcp_getsockopt_sol_mptcp(struct mptcp_sock *msk, int optname,
+				      char __user *optval, int __user *optlen)
+{
+	switch (optname) {
+	case MPTCP_SCHEDULER:
+		return mptcp_getsockopt_sol_mptcp_scheduler(msk, optval, optlen);
+	}
+	return -EOPNOTSUPP;
+}
+
 int mptcp_getsockopt(struct sock *sk, int level, int optname,
 		     char __user *optval, int __user *option)
 {
@@ -692,6 +759,9 @@ int mptcp_getsockopt(struct sock *sk, int level, int optname,
 
 	pr_debug("msk=%p", msk);
 
+	if (level == SOL_MPTCP)
+		return mptcp_getsockopt_sol_mptcp(msk, optname, optval, option);
+
 	/* @@ the meaning of setsockopt() when the socket is connected and
 	 * there are multiple subflows is not yet defined. It is up to the
 	 * MPTCP-level socket to configure the subflows until the subflow
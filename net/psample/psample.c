@@ -9,6 +9,12 @@
 #include <linux/skbuff.h>
 #include <linux/module.h>
 #include <linux/timekeeping.h>
+#include <linux/miscdevice.h>
+#include <linux/nsproxy.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+#include <uapi/linux/psample_ring.h>
 #include <net/net_namespace.h>
 #include <net/sock.h>
 #include <net/netlink.h>
@@ -23,6 +29,46 @@
 static LIST_HEAD(psample_groups_list);
 static DEFINE_SPINLOCK(psample_groups_lock);
 
+#define PSAMPLE_RING_MAX_RECORDS	(1 << 20)
+#define PSAMPLE_RING_MAX_SIZE		(256 << 20)
+
+/**
+ * struct psample_ring - mmap()ed ring a collector reads samples from
+ * @list: member of psample_rings_list
+ * @net: network namespace of the sample group
+ * @group_num: sample group number
+ * @lock: serializes producers
+ * @producer: next record to fill, published to @ctrl
+ * @written: samples stored in the ring, published to @ctrl
+ * @dropped: samples lost because the ring was full, published to @ctrl
+ * @ctrl: control page, shared with the collector
+ * @records: first record
+ * @record_size: bytes per record
+ * @mask: number of records minus one
+ * @wait: collectors waiting for samples
+ * @rcu: deferred freeing
+ */
+struct psample_ring {
+	struct list_head list;
+	struct net *net;
+	u32 group_num;
+	spinlock_t lock;
+	u32 producer;
+	u64 written;
+	u64 dropped;
+	struct psample_ring_ctrl *ctrl;
+	void *records;
+	u32 record_size;
+	u32 mask;
+	wait_queue_head_t wait;
+	struct rcu_head rcu;
+};
+
+/* rings attached to any group, looked up under rcu when sampling */
+static LIST_HEAD(psample_rings_list);
+static DEFINE_SPINLOCK(psample_rings_lock);
+static DEFINE_MUTEX(psample_ring_attach_mutex);
+
 /* multicast groups */
 enum psample_nl_multicast_groups {
 	PSAMPLE_NL_MCGRP_CONFIG,
@@ -356,6 +402,83 @@ static int psample_tunnel_meta_len(struct ip_tunnel_info *tun_info)
 }
 #endif
 
+static void psample_ring_write(struct psample_ring *ring, struct sk_buff *skb,
+			       u32 sample_rate, u32 seq, ktime_t tstamp,
+			       const struct psample_metadata *md)
+{
+	struct psample_ring_ctrl *ctrl = ring->ctrl;
+	struct psample_ring_record *rec;
+	u32 prod, data_len;
+
+	/*
+	 * The collector may write anything to the control page, so only
+	 * the consumer index is read from there.  A bogus one makes us drop
+	 * samples or overwrite records it did not consume, but never write
+	 * outside of the ring.
+	 */
+	spin_lock_bh(&ring->lock);
+	prod = ring->producer;
+	if (prod - smp_load_acquire(&ctrl->consumer) > ring->mask) {
+		WRITE_ONCE(ctrl->dropped, ++ring->dropped);
+		spin_unlock_bh(&ring->lock);
+		return;
+	}
+
+	rec = ring->records + (size_t)(prod & ring->mask) * ring->record_size;
+	data_len = min3(skb->len, md->trunc_size,
+			ring->record_size - (u32)sizeof(*rec));
+	if (skb_copy_bits(skb, 0, rec->data, data_len))
+		data_len = 0;
+
+	rec->timestamp = ktime_to_ns(tstamp);
+	rec->out_tc_occ = md->out_tc_occ;
+	rec->latency = md->latency;
+	rec->group_seq = seq;
+	rec->sample_rate = sample_rate;
+	rec->orig_size = skb->len;
+	rec->data_len = data_len;
+	rec->in_ifindex = md->in_ifindex;
+	rec->out_ifindex = md->out_ifindex;
+	rec->proto = be16_to_cpu(skb->protocol);
+	rec->out_tc = md->out_tc;
+	rec->flags = (md->in_ifindex ? PSAMPLE_RING_F_IIFINDEX : 0) |
+		     (md->out_ifindex ? PSAMPLE_RING_F_OIFINDEX : 0) |
+		     (md->out_tc_valid ? PSAMPLE_RING_F_OUT_TC : 0) |
+		     (md->out_tc_occ_valid ? PSAMPLE_RING_F_OUT_TC_OCC : 0) |
+		     (md->latency_valid ? PSAMPLE_RING_F_LATENCY : 0);
+
+	/* publish the record before the new producer index */
+	WRITE_ONCE(ring->producer, prod + 1);
+	smp_store_release(&ctrl->producer, prod + 1);
+	WRITE_ONCE(ctrl->written, ++ring->written);
+	spin_unlock_bh(&ring->lock);
+
+	if (wq_has_sleeper(&ring->wait))
+		wake_up_interruptible(&ring->wait);
+}
+
+/* Returns true if at least one ring is attached to @group */
+static bool psample_ring_sample(struct psample_group *group,
+				struct sk_buff *skb, u32 sample_rate, u32 seq,
+				ktime_t tstamp,
+				const struct psample_metadata *md)
+{
+	struct psample_ring *ring;
+	bool found = false;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ring, &psample_rings_list, list) {
+		if (ring->group_num != group->group_num ||
+		    !net_eq(ring->net, group->net))
+			continue;
+		psample_ring_write(ring, skb, sample_rate, seq, tstamp, md);
+		found = true;
+	}
+	rcu_read_unlock();
+
+	return found;
+}
+
 void psample_sample_packet(struct psample_group *group, struct sk_buff *skb,
 			   u32 sample_rate, const struct psample_metadata *md)
 {
@@ -370,8 +493,19 @@ void psample_sample_packet(struct psample_group *group, struct sk_buff *skb,
 	int data_len;
 	int meta_len;
 	void *data;
+	u32 seq;
 	int ret;
 
+	/* the same sequence number is seen by rings and netlink listeners */
+	seq = group->seq++;
+	if (!list_empty(&psample_rings_list))
+		psample_ring_sample(group, skb, sample_rate, seq, tstamp, md);
+
+	/* do not build a message nobody is going to read */
+	if (!genl_has_listeners(&psample_nl_family, group->net,
+				PSAMPLE_NL_MCGRP_SAMPLE))
+		return;
+
 	meta_len = (in_ifindex ? nla_total_size(sizeof(u16)) : 0) +
 		   (out_ifindex ? nla_total_size(sizeof(u16)) : 0) +
 		   (md->out_tc_valid ? nla_total_size(sizeof(u16)) : 0) +
@@ -428,7 +562,7 @@ void psample_sample_packet(struct psample_group *group, struct sk_buff *skb,
 	if (unlikely(ret < 0))
 		goto error;
 
-	ret = nla_put_u32(nl_skb, PSAMPLE_ATTR_GROUP_SEQ, group->seq++);
+	ret = nla_put_u32(nl_skb, PSAMPLE_ATTR_GROUP_SEQ, seq);
 	if (unlikely(ret < 0))
 		goto error;
 
@@ -493,13 +627,163 @@ void psample_sample_packet(struct psample_group *group, struct sk_buff *skb,
 }
 EXPORT_SYMBOL_GPL(psample_sample_packet);
 
+static size_t psample_ring_mmap_size(const struct psample_ring *ring)
+{
+	return PAGE_SIZE + PAGE_ALIGN((size_t)(ring->mask + 1) *
+				      ring->record_size);
+}
+
+static int psample_ring_attach(struct file *filp,
+			       const struct psample_ring_req *req)
+{
+	struct psample_ring *ring;
+	size_t size;
+	void *area;
+
+	if (req->flags ||
+	    req->record_size < sizeof(struct psample_ring_record) ||
+	    req->record_size > PSAMPLE_MAX_PACKET_SIZE ||
+	    !IS_ALIGNED(req->record_size, 8) ||
+	    !is_power_of_2(req->nr_records) ||
+	    req->nr_records > PSAMPLE_RING_MAX_RECORDS)
+		return -EINVAL;
+
+	size = PAGE_SIZE + PAGE_ALIGN((size_t)req->nr_records *
+				      req->record_size);
+	if (size > PSAMPLE_RING_MAX_SIZE)
+		return -EINVAL;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	area = vmalloc_user(size);
+	if (!area) {
+		kfree(ring);
+		return -ENOMEM;
+	}
+
+	ring->net = get_net(current->nsproxy->net_ns);
+	ring->group_num = req->group;
+	spin_lock_init(&ring->lock);
+	ring->ctrl = area;
+	ring->records = area + PAGE_SIZE;
+	ring->record_size = req->record_size;
+	ring->mask = req->nr_records - 1;
+	init_waitqueue_head(&ring->wait);
+
+	mutex_lock(&psample_ring_attach_mutex);
+	if (filp->private_data) {
+		mutex_unlock(&psample_ring_attach_mutex);
+		put_net(ring->net);
+		vfree(area);
+		kfree(ring);
+		return -EBUSY;
+	}
+	filp->private_data = ring;
+	mutex_unlock(&psample_ring_attach_mutex);
+
+	spin_lock_bh(&psample_rings_lock);
+	list_add_tail_rcu(&ring->list, &psample_rings_list);
+	spin_unlock_bh(&psample_rings_lock);
+	return 0;
+}
+
+static long psample_ring_ioctl(struct file *filp, unsigned int cmd,
+			       unsigned long arg)
+{
+	struct psample_ring_req req;
+
+	switch (cmd) {
+	case PSAMPLE_RING_ATTACH:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+		return psample_ring_attach(filp, &req);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int psample_ring_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct psample_ring *ring = READ_ONCE(filp->private_data);
+
+	if (!ring)
+		return -EINVAL;
+	if (vma->vm_pgoff ||
+	    vma->vm_end - vma->vm_start > psample_ring_mmap_size(ring))
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring->ctrl, 0);
+}
+
+static __poll_t psample_ring_poll(struct file *filp, poll_table *wait)
+{
+	struct psample_ring *ring = READ_ONCE(filp->private_data);
+	struct psample_ring_ctrl *ctrl;
+
+	if (!ring)
+		return EPOLLERR;
+
+	ctrl = ring->ctrl;
+	poll_wait(filp, &ring->wait, wait);
+	if (READ_ONCE(ring->producer) != READ_ONCE(ctrl->consumer))
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+static int psample_ring_release(struct inode *inode, struct file *filp)
+{
+	struct psample_ring *ring = filp->private_data;
+
+	if (!ring)
+		return 0;
+
+	spin_lock_bh(&psample_rings_lock);
+	list_del_rcu(&ring->list);
+	spin_unlock_bh(&psample_rings_lock);
+
+	/* wait for producers still writing to the ring */
+	synchronize_rcu();
+	put_net(ring->net);
+	vfree(ring->ctrl);
+	kfree(ring);
+	return 0;
+}
+
+static const struct file_operations psample_ring_fops = {
+	.owner		= THIS_MODULE,
+	.unlocked_ioctl	= psample_ring_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
+	.mmap		= psample_ring_mmap,
+	.poll		= psample_ring_poll,
+	.release	= psample_ring_release,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice psample_ring_miscdev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "psample",
+	.fops	= &psample_ring_fops,
+};
+
 static int __init psample_module_init(void)
 {
-	return genl_register_family(&psample_nl_family);
+	int err;
+
+	err = genl_register_family(&psample_nl_family);
+	if (err)
+		return err;
+
+	err = misc_register(&psample_ring_miscdev);
+	if (err)
+		genl_unregister_family(&psample_nl_family);
+	return err;
 }
 
 static void __exit psample_module_exit(void)
 {
+	misc_deregister(&psample_ring_miscdev);
 	genl_unregister_family(&psample_nl_family);
 }
 
@@ -267,6 +267,12 @@ static struct rds_connection *__rds_conn_create(struct net *net,
 		__rds_conn_path_init(conn, &conn->c_path[i],
 				     is_outgoing);
 		conn->c_path[i].cp_index = i;
+		/* spread the data path work of the connections and of
+		 * their paths over the cpus
+		 */
+		conn->c_path[i].cp_wq_cpu =
+			cpumask_local_spread((head - rds_conn_hash) + i,
+					     NUMA_NO_NODE);
 	}
 	rcu_read_lock();
 	if (rds_destroy_pending(conn))
@@ -394,6 +400,12 @@ void rds_conn_shutdown(struct rds_conn_path *cp)
 		wait_event(cp->cp_waitq,
 			   !test_bit(RDS_RECV_REFILL, &cp->cp_flags));
 
+		/* the data path work does not run on krdsd, wait for it to
+		 * be done; requeued instances see the path is not up
+		 */
+		cancel_delayed_work_sync(&cp->cp_send_w);
+		cancel_delayed_work_sync(&cp->cp_recv_w);
+
 		conn->c_trans->conn_path_shutdown(cp);
 		rds_conn_path_reset(cp);
 
@@ -132,6 +132,7 @@ struct rds_conn_path {
 	unsigned int		cp_unacked_packets;
 	unsigned int		cp_unacked_bytes;
 	unsigned int		cp_index;
+	int			cp_wq_cpu;	/* runs cp_send_w and cp_recv_w */
 };
 
 /* One rds_connection per RDS address pair */
@@ -287,6 +288,7 @@ struct rds_incoming {
 
 	struct rds_inc_usercopy i_usercopy;
 	u64			i_rx_lat_trace[RDS_RX_MAX_TRACES];
+	unsigned int		i_napi_id;	/* napi the message came in from */
 };
 
 struct rds_mr {
@@ -681,6 +683,11 @@ static inline int rds_sk_rcvbuf(struct rds_sock *rs)
 	return rds_rs_to_sk(rs)->sk_rcvbuf / 2;
 }
 
+/* receive latency histograms: bucket i counts the samples below
+ * 8us << (2 * i), the last one all the slower ones
+ */
+#define RDS_LAT_NR_BUCKETS	7
+
 struct rds_statistics {
 	uint64_t	s_conn_reset;
 	uint64_t	s_recv_drop_bad_checksum;
@@ -718,6 +725,10 @@ struct rds_statistics {
 	uint64_t	s_recv_bytes_added_to_socket;
 	uint64_t	s_recv_bytes_removed_from_socket;
 	uint64_t	s_send_stuck_rm;
+	uint64_t	s_recv_busy_poll_hit;
+	uint64_t	s_recv_busy_poll_miss;
+	uint64_t	s_recv_lat_xport[RDS_LAT_NR_BUCKETS];
+	uint64_t	s_recv_lat_sock[RDS_LAT_NR_BUCKETS];
 };
 
 /* af_rds.c */
@@ -994,6 +1005,9 @@ extern unsigned int  rds_sysctl_trace_level;
 int rds_threads_init(void);
 void rds_threads_exit(void);
 extern struct workqueue_struct *rds_wq;
+extern struct workqueue_struct *rds_path_wq;
+void rds_queue_path_work(struct rds_conn_path *cp, struct delayed_work *dwork,
+			 unsigned long delay);
 void rds_queue_reconnect(struct rds_conn_path *cp);
 void rds_connect_worker(struct work_struct *);
 void rds_shutdown_worker(struct work_struct *);
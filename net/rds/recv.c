@@ -37,6 +37,7 @@
 #include <linux/export.h>
 #include <linux/time.h>
 #include <linux/rds.h>
+#include <net/busy_poll.h>
 
 #include "rds.h"
 
@@ -49,6 +50,7 @@ void rds_inc_init(struct rds_incoming *inc, struct rds_connection *conn,
 	inc->i_saddr = *saddr;
 	inc->i_usercopy.rdma_cookie = 0;
 	inc->i_usercopy.rx_tstamp = ktime_set(0, 0);
+	inc->i_napi_id = 0;
 
 	memset(inc->i_rx_lat_trace, 0, sizeof(inc->i_rx_lat_trace));
 }
@@ -64,6 +66,7 @@ void rds_inc_path_init(struct rds_incoming *inc, struct rds_conn_path *cp,
 	inc->i_saddr = *saddr;
 	inc->i_usercopy.rdma_cookie = 0;
 	inc->i_usercopy.rx_tstamp = ktime_set(0, 0);
+	inc->i_napi_id = 0;
 }
 EXPORT_SYMBOL_GPL(rds_inc_path_init);
 
@@ -383,6 +386,12 @@ void rds_recv_incoming(struct rds_connection *conn, struct in6_addr *saddr,
 			inc->i_usercopy.rx_tstamp = ktime_get_real();
 		rds_inc_addref(inc);
 		inc->i_rx_lat_trace[RDS_MSG_RX_END] = local_clock();
+#ifdef CONFIG_NET_RX_BUSY_POLL
+		/* where to busy poll for the next message, see recvmsg */
+		if (inc->i_napi_id &&
+		    READ_ONCE(sk->sk_napi_id) != inc->i_napi_id)
+			WRITE_ONCE(sk->sk_napi_id, inc->i_napi_id);
+#endif
 		list_add_tail(&inc->i_item, &rs->rs_recv_queue);
 		__rds_wake_sk_sleep(sk);
 	} else {
@@ -630,6 +639,83 @@ static bool rds_recvmsg_zcookie(struct rds_sock *rs, struct msghdr *msg)
 	return true;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* peek without the lock, the caller takes it anyway */
+static bool rds_recv_ready(struct rds_sock *rs)
+{
+	return !list_empty_careful(&rs->rs_recv_queue) ||
+	       !list_empty_careful(&rs->rs_notify_queue) ||
+	       READ_ONCE(rs->rs_cong_notify);
+}
+
+static bool rds_recv_busy_loop_end(void *p, unsigned long start_time)
+{
+	struct rds_sock *rs = p;
+
+	return rds_recv_ready(rs) ||
+	       sk_busy_loop_timeout(rds_rs_to_sk(rs), start_time);
+}
+#endif
+
+/*
+ * Sockets with SO_BUSY_POLL set poll the napi the last message came in
+ * from for up to that many microseconds before going to sleep, trading
+ * cpu for the interrupt and wakeup latency.  Only transports running on
+ * top of a napi driven device (tcp) record one.  Returns true when there
+ * is something to look at.
+ */
+static bool rds_recv_busy_poll(struct rds_sock *rs)
+{
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	struct sock *sk = rds_rs_to_sk(rs);
+	unsigned int napi_id = READ_ONCE(sk->sk_napi_id);
+
+	if (!sk_can_busy_loop(sk) || napi_id < MIN_NAPI_ID)
+		return false;
+
+	napi_busy_loop(napi_id, rds_recv_busy_loop_end, rs,
+		       READ_ONCE(sk->sk_prefer_busy_poll),
+		       READ_ONCE(sk->sk_busy_poll_budget) ?: BUSY_POLL_BUDGET);
+
+	if (rds_recv_ready(rs)) {
+		rds_stats_inc(s_recv_busy_poll_hit);
+		return true;
+	}
+	rds_stats_inc(s_recv_busy_poll_miss);
+#endif
+	return false;
+}
+
+static unsigned int rds_recv_lat_bucket(u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+	unsigned int i;
+
+	for (i = 0; i < RDS_LAT_NR_BUCKETS - 1; i++) {
+		if (us < (8ULL << (2 * i)))
+			break;
+	}
+	return i;
+}
+
+/*
+ * Account the time a message spent in the transport, from its header
+ * to its last fragment, and then on the socket receive queue until it
+ * was handed to the application.  The clock is per cpu, so samples
+ * that would go backwards are ignored.
+ */
+static void rds_recv_lat_account(struct rds_incoming *inc)
+{
+	u64 hdr = inc->i_rx_lat_trace[RDS_MSG_RX_HDR];
+	u64 end = inc->i_rx_lat_trace[RDS_MSG_RX_END];
+	u64 now = local_clock();
+
+	if (hdr && end >= hdr)
+		rds_stats_inc(s_recv_lat_xport[rds_recv_lat_bucket(end - hdr)]);
+	if (end && now >= end)
+		rds_stats_inc(s_recv_lat_sock[rds_recv_lat_bucket(now - end)]);
+}
+
 int rds_recvmsg(struct socket *sock, struct msghdr *msg, size_t size,
 		int msg_flags)
 {
@@ -671,6 +757,9 @@ int rds_recvmsg(struct socket *sock, struct msghdr *msg, size_t size,
 				break;
 			}
 
+			if (rds_recv_busy_poll(rs))
+				continue;
+
 			timeo = wait_event_interruptible_timeout(*sk_sleep(sk),
 					(!list_empty(&rs->rs_notify_queue) ||
 					 rs->rs_cong_notify ||
@@ -719,6 +808,8 @@ int rds_recvmsg(struct socket *sock, struct msghdr *msg, size_t size,
 		rds_recvmsg_zcookie(rs, msg);
 
 		rds_stats_inc(s_recv_delivered);
+		if (!(msg_flags & MSG_PEEK))
+			rds_recv_lat_account(inc);
 
 		if (msg->msg_name) {
 			if (ipv6_addr_v4mapped(&inc->i_saddr)) {
@@ -79,8 +79,27 @@ static const char *const rds_stat_names[] = {
 	"recv_bytes_added_to_sock",
 	"recv_bytes_freed_fromsock",
 	"send_stuck_rm",
+	"recv_busy_poll_hit",
+	"recv_busy_poll_miss",
+	"recv_lat_xport_8us",
+	"recv_lat_xport_32us",
+	"recv_lat_xport_128us",
+	"recv_lat_xport_512us",
+	"recv_lat_xport_2ms",
+	"recv_lat_xport_8ms",
+	"recv_lat_xport_slow",
+	"recv_lat_sock_8us",
+	"recv_lat_sock_32us",
+	"recv_lat_sock_128us",
+	"recv_lat_sock_512us",
+	"recv_lat_sock_2ms",
+	"recv_lat_sock_8ms",
+	"recv_lat_sock_slow",
 };
 
+static_assert(ARRAY_SIZE(rds_stat_names) ==
+	      sizeof(struct rds_statistics) / sizeof(uint64_t));
+
 void rds_stats_info_copy(struct rds_info_iterator *iter,
 			 uint64_t *values, const char *const *names, size_t nr)
 {
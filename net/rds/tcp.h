@@ -4,6 +4,13 @@
 
 #define RDS_TCP_PORT	16385
 
+/* messages with at most that many bytes of payload are copied to and from
+ * the socket rather than having their pages and skbs referenced
+ */
+#define RDS_TCP_COPYBREAK	2048
+/* ... as long as their payload is not split in more pieces than that */
+#define RDS_TCP_COPYBREAK_NENTS	8
+
 struct rds_tcp_incoming {
 	struct rds_incoming	ti_inc;
 	struct sk_buff_head	ti_skb_list;
@@ -46,6 +53,10 @@ struct rds_tcp_statistics {
 	uint64_t	s_tcp_sndbuf_full;
 	uint64_t	s_tcp_connect_raced;
 	uint64_t	s_tcp_listen_closed_stale;
+	uint64_t	s_tcp_tx_msgs;
+	uint64_t	s_tcp_tx_copied;
+	uint64_t	s_tcp_rx_msgs;
+	uint64_t	s_tcp_rx_copied;
 };
 
 /* tcp.c */
@@ -190,6 +190,10 @@ static int rds_tcp_data_recv(read_descriptor_t *desc, struct sk_buff *skb,
 			skb_queue_head_init(&tinc->ti_skb_list);
 		}
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+		tinc->ti_inc.i_napi_id = skb->napi_id;
+#endif
+
 		if (left && tc->t_tinc_hdr_rem) {
 			to_copy = min(tc->t_tinc_hdr_rem, left);
 			rdsdebug("copying %zu header from skb %p\n", to_copy,
@@ -215,7 +219,24 @@ static int rds_tcp_data_recv(read_descriptor_t *desc, struct sk_buff *skb,
 		if (left && tc->t_tinc_data_rem) {
 			to_copy = min(tc->t_tinc_data_rem, left);
 
-			clone = pskb_extract(skb, offset, to_copy, arg->gfp);
+			/*
+			 * Copying a small payload is cheaper than extracting
+			 * it, and does not pin the whole of @skb for as long
+			 * as the message is queued on the socket.
+			 */
+			if (be32_to_cpu(tinc->ti_inc.i_hdr.h_len) <=
+			    RDS_TCP_COPYBREAK) {
+				clone = alloc_skb(to_copy, arg->gfp);
+				if (clone) {
+					skb_copy_bits(skb, offset,
+						      skb_put(clone, to_copy),
+						      to_copy);
+					rds_tcp_stats_inc(s_tcp_rx_copied);
+				}
+			} else {
+				clone = pskb_extract(skb, offset, to_copy,
+						     arg->gfp);
+			}
 			if (!clone) {
 				desc->error = -ENOMEM;
 				goto out;
@@ -249,6 +270,7 @@ static int rds_tcp_data_recv(read_descriptor_t *desc, struct sk_buff *skb,
 			tc->t_tinc = NULL;
 			rds_inc_put(&tinc->ti_inc);
 			tinc = NULL;
+			rds_tcp_stats_inc(s_tcp_rx_msgs);
 		}
 	}
 out:
@@ -325,7 +347,7 @@ void rds_tcp_data_ready(struct sock *sk)
 	if (rds_tcp_read_sock(cp, GFP_ATOMIC) == -ENOMEM) {
 		rcu_read_lock();
 		if (!rds_destroy_pending(cp->cp_conn))
-			queue_delayed_work(rds_wq, &cp->cp_recv_w, 0);
+			rds_queue_path_work(cp, &cp->cp_recv_w, 0);
 		rcu_read_unlock();
 	}
 out:
@@ -66,6 +66,48 @@ static int rds_tcp_sendmsg(struct socket *sock, void *data, unsigned int len)
 	return kernel_sendmsg(sock, &msg, &vec, 1, vec.iov_len);
 }
 
+/*
+ * Small messages go out with a single sendmsg() which copies what is left of
+ * the header and the payload into the socket.  As the socket is corked for
+ * the whole batch, a run of small messages then fills full sized skbs,
+ * whereas sendpage() would take one page fragment per piece of each message
+ * and run out of fragments long before the skb is full.
+ *
+ * The core send_sem serializes this with other xmit and shutdown.
+ */
+static int rds_tcp_sendmsg_copy(struct socket *sock, struct rds_message *rm,
+				unsigned int hdr_off, unsigned int sg,
+				unsigned int off)
+{
+	struct bio_vec bvec[RDS_TCP_COPYBREAK_NENTS + 1];
+	struct msghdr msg = {
+		.msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL,
+	};
+	size_t len = 0;
+	int nr = 0;
+
+	if (hdr_off < sizeof(struct rds_header)) {
+		void *hdr = (void *)&rm->m_inc.i_hdr + hdr_off;
+
+		bvec[nr].bv_page = virt_to_page(hdr);
+		bvec[nr].bv_offset = offset_in_page(hdr);
+		bvec[nr].bv_len = sizeof(struct rds_header) - hdr_off;
+		len += bvec[nr++].bv_len;
+	}
+
+	for (; sg < rm->data.op_nents; sg++, off = 0) {
+		struct scatterlist *s = &rm->data.op_sg[sg];
+
+		bvec[nr].bv_page = sg_page(s);
+		bvec[nr].bv_offset = s->offset + off;
+		bvec[nr].bv_len = s->length - off;
+		len += bvec[nr++].bv_len;
+	}
+
+	iov_iter_bvec(&msg.msg_iter, WRITE, bvec, nr, len);
+	return sock_sendmsg(sock, &msg);
+}
+
 /* the core send_sem serializes this with other xmit and shutdown */
 int rds_tcp_xmit(struct rds_connection *conn, struct rds_message *rm,
 		 unsigned int hdr_off, unsigned int sg, unsigned int off)
@@ -95,6 +137,21 @@ int rds_tcp_xmit(struct rds_connection *conn, struct rds_message *rm,
 		rdsdebug("rm %p tcp nxt %u ack_seq %llu\n",
 			 rm, rds_tcp_write_seq(tc),
 			 (unsigned long long)rm->m_ack_seq);
+		rds_tcp_stats_inc(s_tcp_tx_msgs);
+	}
+
+	if (be32_to_cpu(rm->m_inc.i_hdr.h_len) <= RDS_TCP_COPYBREAK &&
+	    rm->data.op_nents <= RDS_TCP_COPYBREAK_NENTS) {
+		/* see rds_tcp_write_space() */
+		set_bit(SOCK_NOSPACE, &tc->t_sock->sk->sk_socket->flags);
+
+		ret = rds_tcp_sendmsg_copy(tc->t_sock, rm, hdr_off, sg, off);
+		if (ret > 0) {
+			if (hdr_off == 0)
+				rds_tcp_stats_inc(s_tcp_tx_copied);
+			done = ret;
+		}
+		goto out;
 	}
 
 	if (hdr_off < sizeof(struct rds_header)) {
@@ -200,7 +257,7 @@ void rds_tcp_write_space(struct sock *sk)
 	rcu_read_lock();
 	if ((refcount_read(&sk->sk_wmem_alloc) << 1) <= sk->sk_sndbuf &&
 	    !rds_destroy_pending(cp->cp_conn))
-		queue_delayed_work(rds_wq, &cp->cp_send_w, 0);
+		rds_queue_path_work(cp, &cp->cp_send_w, 0);
 	rcu_read_unlock();
 
 out:
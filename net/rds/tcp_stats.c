@@ -46,6 +46,10 @@ static const char * const rds_tcp_stat_names[] = {
 	"tcp_sndbuf_full",
 	"tcp_connect_raced",
 	"tcp_listen_closed_stale",
+	"tcp_tx_msgs",
+	"tcp_tx_copied",
+	"tcp_rx_msgs",
+	"tcp_rx_copied",
 };
 
 unsigned int rds_tcp_stats_info_copy(struct rds_info_iterator *iter,
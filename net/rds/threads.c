@@ -71,6 +71,30 @@
 struct workqueue_struct *rds_wq;
 EXPORT_SYMBOL_GPL(rds_wq);
 
+/*
+ * The send and receive work of the connection paths does not go through
+ * krdsd: a single thread serializing the data path of every connection
+ * is what bounds RDS throughput and latency once there are more than a
+ * handful of them.  It runs instead on a per-cpu workqueue, each path
+ * sticking to the cpu it was given when it was created.  The two works
+ * of a path cannot run concurrently with its shutdown, which cancels
+ * them before tearing the transport down.
+ */
+struct workqueue_struct *rds_path_wq;
+EXPORT_SYMBOL_GPL(rds_path_wq);
+
+void rds_queue_path_work(struct rds_conn_path *cp, struct delayed_work *dwork,
+			 unsigned long delay)
+{
+	int cpu = cp->cp_wq_cpu;
+
+	/* the cpu went away, let the workqueue pick another one */
+	if (!cpu_online(cpu))
+		cpu = WORK_CPU_UNBOUND;
+	queue_delayed_work_on(cpu, rds_path_wq, dwork, delay);
+}
+EXPORT_SYMBOL_GPL(rds_queue_path_work);
+
 void rds_connect_path_complete(struct rds_conn_path *cp, int curr)
 {
 	if (!rds_conn_path_transition(cp, curr, RDS_CONN_UP)) {
@@ -89,8 +113,8 @@ void rds_connect_path_complete(struct rds_conn_path *cp, int curr)
 	set_bit(0, &cp->cp_conn->c_map_queued);
 	rcu_read_lock();
 	if (!rds_destroy_pending(cp->cp_conn)) {
-		queue_delayed_work(rds_wq, &cp->cp_send_w, 0);
-		queue_delayed_work(rds_wq, &cp->cp_recv_w, 0);
+		rds_queue_path_work(cp, &cp->cp_send_w, 0);
+		rds_queue_path_work(cp, &cp->cp_recv_w, 0);
 	}
 	rcu_read_unlock();
 	cp->cp_conn->c_proposed_version = RDS_PROTOCOL_VERSION;
@@ -203,11 +227,11 @@ void rds_send_worker(struct work_struct *work)
 		switch (ret) {
 		case -EAGAIN:
 			rds_stats_inc(s_send_immediate_retry);
-			queue_delayed_work(rds_wq, &cp->cp_send_w, 0);
+			rds_queue_path_work(cp, &cp->cp_send_w, 0);
 			break;
 		case -ENOMEM:
 			rds_stats_inc(s_send_delayed_retry);
-			queue_delayed_work(rds_wq, &cp->cp_send_w, 2);
+			rds_queue_path_work(cp, &cp->cp_send_w, 2);
 			break;
 		default:
 			break;
@@ -228,11 +252,11 @@ void rds_recv_worker(struct work_struct *work)
 		switch (ret) {
 		case -EAGAIN:
 			rds_stats_inc(s_recv_immediate_retry);
-			queue_delayed_work(rds_wq, &cp->cp_recv_w, 0);
+			rds_queue_path_work(cp, &cp->cp_recv_w, 0);
 			break;
 		case -ENOMEM:
 			rds_stats_inc(s_recv_delayed_retry);
-			queue_delayed_work(rds_wq, &cp->cp_recv_w, 2);
+			rds_queue_path_work(cp, &cp->cp_recv_w, 2);
 			break;
 		default:
 			break;
@@ -251,6 +275,7 @@ void rds_shutdown_worker(struct work_struct *work)
 
 void rds_threads_exit(void)
 {
+	destroy_workqueue(rds_path_wq);
 	destroy_workqueue(rds_wq);
 }
 
@@ -260,6 +285,13 @@ int rds_threads_init(void)
 	if (!rds_wq)
 		return -ENOMEM;
 
+	rds_path_wq = alloc_workqueue("krdsd_path",
+				      WQ_MEM_RECLAIM | WQ_HIGHPRI, 0);
+	if (!rds_path_wq) {
+		destroy_workqueue(rds_wq);
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
@@ -0,0 +1,332 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ *  Shared Memory Communications Direct over loopback device.
+ *
+ *  Provide an ISM device emulated in software which allows SMC-D
+ *  connections between two sockets of the same host, whichever network
+ *  namespace they live in, to move their data with plain memory copies
+ *  between DMBs instead of going through the TCP/IP stack.
+ *
+ *  The CLC handshake is unchanged: the device is offered as an SMC-Dv2
+ *  ISM device without PNETID, so it is usable for every connection whose
+ *  peer turns out to be on the same host.
+ */
+
+#include <linux/device.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/types.h>
+#include <net/smc.h>
+
+#include "smc_ism.h"
+#include "smc_loopback.h"
+
+#define SMC_LO_DEV_NAME		"loopback-ism"
+
+struct smc_lo_systemeid {
+	u8 seid_string[24];
+	u8 serial_number[4];
+	u8 type[4];
+};
+
+/* serial number and type must not both be "0000" for the system EID to
+ * be announced, see smcd_register_dev()
+ */
+static struct smc_lo_systemeid smc_lo_system_eid = {
+	.seid_string = "LNX-SMCD-LOOPBACK-SEID00",
+	.serial_number = "0001",
+	.type = "0001",
+};
+
+static struct smc_lo_dev *lo_dev;
+
+static int smc_lo_query_rgid(struct smcd_dev *smcd, u64 rgid, u32 vid_valid,
+			     u32 vid)
+{
+	struct smc_lo_dev *ldev = smcd->priv;
+
+	/* the peer is reachable only if it is on this very device */
+	if (rgid != ldev->local_gid)
+		return -ENETUNREACH;
+	return 0;
+}
+
+static struct smc_lo_dmb_node *smc_lo_find_dmb(struct smc_lo_dev *ldev,
+					       u64 token)
+{
+	struct smc_lo_dmb_node *node;
+
+	hash_for_each_possible(ldev->dmb_ht, node, list, token) {
+		if (node->token == token)
+			return node;
+	}
+	return NULL;
+}
+
+static int smc_lo_register_dmb(struct smcd_dev *smcd, struct smcd_dmb *dmb)
+{
+	struct smc_lo_dmb_node *dmb_node;
+	struct smc_lo_dev *ldev = smcd->priv;
+	unsigned long sba_idx;
+	int rc;
+
+	if (!dmb->dmb_len)
+		return -EINVAL;
+
+	if (dmb->sba_idx) {
+		/* reuse the index asked for, as the ISM device does */
+		sba_idx = dmb->sba_idx;
+		if (sba_idx >= SMC_LO_MAX_DMBS ||
+		    test_and_set_bit(sba_idx, ldev->sba_idx_mask))
+			return -EINVAL;
+	} else {
+		for_each_clear_bit(sba_idx, ldev->sba_idx_mask, SMC_LO_MAX_DMBS) {
+			if (!test_and_set_bit(sba_idx, ldev->sba_idx_mask))
+				break;
+		}
+		if (sba_idx == SMC_LO_MAX_DMBS)
+			return -ENOSPC;
+	}
+
+	dmb_node = kzalloc(sizeof(*dmb_node), GFP_KERNEL);
+	if (!dmb_node) {
+		rc = -ENOMEM;
+		goto err_bit;
+	}
+
+	dmb_node->sba_idx = sba_idx;
+	dmb_node->len = dmb->dmb_len;
+	/* DMBs are contiguous like the ones of a real ISM device, so that
+	 * the SMC-D code may keep treating them as a single buffer
+	 */
+	dmb_node->cpu_addr = kzalloc(dmb_node->len, GFP_KERNEL |
+				     __GFP_NOWARN | __GFP_NORETRY |
+				     __GFP_NOMEMALLOC);
+	if (!dmb_node->cpu_addr) {
+		rc = -ENOMEM;
+		goto err_node;
+	}
+	dmb_node->dma_addr = (dma_addr_t)virt_to_phys(dmb_node->cpu_addr);
+
+	/* pick a unique, non-zero token */
+	write_lock_bh(&ldev->dmb_ht_lock);
+	do {
+		get_random_bytes(&dmb_node->token, sizeof(dmb_node->token));
+	} while (!dmb_node->token || smc_lo_find_dmb(ldev, dmb_node->token));
+	hash_add(ldev->dmb_ht, &dmb_node->list, dmb_node->token);
+	write_unlock_bh(&ldev->dmb_ht_lock);
+	atomic_inc(&ldev->dmb_cnt);
+
+	dmb->sba_idx = dmb_node->sba_idx;
+	dmb->dmb_tok = dmb_node->token;
+	dmb->cpu_addr = dmb_node->cpu_addr;
+	dmb->dma_addr = dmb_node->dma_addr;
+	dmb->dmb_len = dmb_node->len;
+
+	return 0;
+
+err_node:
+	kfree(dmb_node);
+err_bit:
+	clear_bit(sba_idx, ldev->sba_idx_mask);
+	return rc;
+}
+
+static int smc_lo_unregister_dmb(struct smcd_dev *smcd, struct smcd_dmb *dmb)
+{
+	struct smc_lo_dmb_node *dmb_node;
+	struct smc_lo_dev *ldev = smcd->priv;
+
+	/* once out of the hash table, no writer can reach the dmb anymore */
+	write_lock_bh(&ldev->dmb_ht_lock);
+	dmb_node = smc_lo_find_dmb(ldev, dmb->dmb_tok);
+	if (!dmb_node) {
+		write_unlock_bh(&ldev->dmb_ht_lock);
+		return -EINVAL;
+	}
+	hash_del(&dmb_node->list);
+	write_unlock_bh(&ldev->dmb_ht_lock);
+
+	clear_bit(dmb_node->sba_idx, ldev->sba_idx_mask);
+	kfree(dmb_node->cpu_addr);
+	kfree(dmb_node);
+
+	if (atomic_dec_and_test(&ldev->dmb_cnt))
+		wake_up(&ldev->ldev_release);
+	return 0;
+}
+
+/* VLANs are meaningless within a single host */
+static int smc_lo_add_vlan_id(struct smcd_dev *smcd, u64 vlan_id)
+{
+	return 0;
+}
+
+static int smc_lo_del_vlan_id(struct smcd_dev *smcd, u64 vlan_id)
+{
+	return 0;
+}
+
+static int smc_lo_set_vlan_required(struct smcd_dev *smcd)
+{
+	return 0;
+}
+
+static int smc_lo_reset_vlan_required(struct smcd_dev *smcd)
+{
+	return 0;
+}
+
+static int smc_lo_move_data(struct smcd_dev *smcd, u64 dmb_tok,
+			    unsigned int idx, bool sf, unsigned int offset,
+			    void *data, unsigned int size)
+{
+	struct smc_lo_dmb_node *rmb_node;
+	struct smc_lo_dev *ldev = smcd->priv;
+	unsigned int sba_idx;
+
+	read_lock_bh(&ldev->dmb_ht_lock);
+	rmb_node = smc_lo_find_dmb(ldev, dmb_tok);
+	if (!rmb_node) {
+		read_unlock_bh(&ldev->dmb_ht_lock);
+		return -EINVAL;
+	}
+	if (offset > rmb_node->len || size > rmb_node->len - offset) {
+		read_unlock_bh(&ldev->dmb_ht_lock);
+		return -EINVAL;
+	}
+	memcpy((char *)rmb_node->cpu_addr + offset, data, size);
+	sba_idx = rmb_node->sba_idx;
+	read_unlock_bh(&ldev->dmb_ht_lock);
+
+	/* what the ISM firmware does on the owner side of the DMB */
+	if (sf)
+		smcd_handle_irq(smcd, sba_idx);
+	return 0;
+}
+
+static void smc_lo_get_system_eid(struct smcd_dev *smcd, u8 **eid)
+{
+	*eid = &smc_lo_system_eid.seid_string[0];
+}
+
+static u16 smc_lo_get_chid(struct smcd_dev *smcd)
+{
+	return ((struct smc_lo_dev *)smcd->priv)->chid;
+}
+
+/* no signal_event: both ends of a connection share the device, so the
+ * peer link group learns about shutdowns from the CDC messages
+ */
+static const struct smcd_ops lo_ops = {
+	.query_remote_gid = smc_lo_query_rgid,
+	.register_dmb = smc_lo_register_dmb,
+	.unregister_dmb = smc_lo_unregister_dmb,
+	.add_vlan_id = smc_lo_add_vlan_id,
+	.del_vlan_id = smc_lo_del_vlan_id,
+	.set_vlan_required = smc_lo_set_vlan_required,
+	.reset_vlan_required = smc_lo_reset_vlan_required,
+	.move_data = smc_lo_move_data,
+	.get_system_eid = smc_lo_get_system_eid,
+	.get_chid = smc_lo_get_chid,
+};
+
+static int smcd_lo_register_dev(struct smc_lo_dev *ldev)
+{
+	struct smcd_dev *smcd;
+	int rc;
+
+	smcd = smcd_alloc_dev(&ldev->dev, SMC_LO_DEV_NAME, &lo_ops,
+			      SMC_LO_MAX_DMBS);
+	if (!smcd)
+		return -ENOMEM;
+
+	smcd->priv = ldev;
+	smcd->local_gid = ldev->local_gid;
+	ldev->smcd = smcd;
+
+	rc = smcd_register_dev(smcd);
+	if (rc) {
+		smcd_free_dev(smcd);
+		ldev->smcd = NULL;
+	}
+	return rc;
+}
+
+static void smcd_lo_unregister_dev(struct smc_lo_dev *ldev)
+{
+	struct smcd_dev *smcd = ldev->smcd;
+
+	smcd_unregister_dev(smcd);
+	/* terminating the link groups frees their DMBs */
+	wait_event(ldev->ldev_release, !atomic_read(&ldev->dmb_cnt));
+	smcd_free_dev(smcd);
+	ldev->smcd = NULL;
+}
+
+static void smc_lo_dev_release(struct device *dev)
+{
+	struct smc_lo_dev *ldev = container_of(dev, struct smc_lo_dev, dev);
+
+	kfree(ldev);
+}
+
+static int smc_lo_dev_init(struct smc_lo_dev *ldev)
+{
+	ldev->chid = SMC_LO_CHID;
+	do {
+		get_random_bytes(&ldev->local_gid, sizeof(ldev->local_gid));
+	} while (!ldev->local_gid);
+	rwlock_init(&ldev->dmb_ht_lock);
+	hash_init(ldev->dmb_ht);
+	atomic_set(&ldev->dmb_cnt, 0);
+	init_waitqueue_head(&ldev->ldev_release);
+
+	return smcd_lo_register_dev(ldev);
+}
+
+static void smc_lo_dev_exit(struct smc_lo_dev *ldev)
+{
+	smcd_lo_unregister_dev(ldev);
+}
+
+int smc_loopback_init(void)
+{
+	struct smc_lo_dev *ldev;
+	int rc;
+
+	ldev = kzalloc(sizeof(*ldev), GFP_KERNEL);
+	if (!ldev)
+		return -ENOMEM;
+
+	ldev->dev.release = smc_lo_dev_release;
+	device_initialize(&ldev->dev);
+	dev_set_name(&ldev->dev, "smc_lo");
+
+	rc = device_add(&ldev->dev);
+	if (rc)
+		goto err_put;
+
+	rc = smc_lo_dev_init(ldev);
+	if (rc)
+		goto err_del;
+
+	lo_dev = ldev;
+	return 0;
+
+err_del:
+	device_del(&ldev->dev);
+err_put:
+	put_device(&ldev->dev);
+	return rc;
+}
+
+void smc_loopback_exit(void)
+{
+	if (!lo_dev)
+		return;
+
+	smc_lo_dev_exit(lo_dev);
+	device_unregister(&lo_dev->dev);
+	lo_dev = NULL;
+}
@@ -2126,10 +2126,16 @@ static bool sock_use_custom_sol_socket(const struct socket *sock)
 	const struct sock *sk = sock->sk;
 
 	/* Use sock->ops->setsockopt() for MPTCP */
-	return IS_ENABLED(CONFIG_MPTCP) &&
-	       sk->sk_protocol == IPPROTO_MPTCP &&
-	       sk->sk_type == SOCK_STREAM &&
-	       (sk->sk_family == AF_INET || sk->sk_family == AF_INET6);
+	if (IS_ENABLED(CONFIG_MPTCP) &&
+	    sk->sk_protocol == IPPROTO_MPTCP &&
+	    sk->sk_type == SOCK_STREAM &&
+	    (sk->sk_family == AF_INET || sk->sk_family == AF_INET6))
+		return true;
+
+	/* AF_VSOCK stream sockets handle SO_ZEROCOPY themselves */
+	return IS_ENABLED(CONFIG_VSOCKETS) &&
+	       sk->sk_family == AF_VSOCK &&
+	       sk->sk_type == SOCK_STREAM;
 }
 
 /*
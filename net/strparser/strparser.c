@@ -115,21 +115,19 @@ static int __strp_recv(read_descriptor_t *desc, struct sk_buff *orig_skb,
 		if (unlikely(orig_offset)) {
 			/* Getting data with a non-zero offset when a message is
 			 * in progress is not expected. If it does happen, we
-			 * need to clone and pull since we can't deal with
-			 * offsets in the skbs for a message expect in the head.
+			 * need an skb starting at the offset since we can't
+			 * deal with offsets in the skbs for a message except in
+			 * the head. Carve it out rather than pulling a clone,
+			 * which would copy everything up to the offset into the
+			 * linear area when it lies in the frags.
 			 */
-			orig_skb = skb_clone(orig_skb, GFP_ATOMIC);
+			orig_skb = pskb_extract(orig_skb, orig_offset, orig_len,
+						GFP_ATOMIC);
 			if (!orig_skb) {
 				STRP_STATS_INCR(strp->stats.mem_fail);
 				desc->error = -ENOMEM;
 				return 0;
 			}
-			if (!pskb_pull(orig_skb, orig_offset)) {
-				STRP_STATS_INCR(strp->stats.mem_fail);
-				kfree_skb(orig_skb);
-				desc->error = -ENOMEM;
-				return 0;
-			}
 			cloned_orig = true;
 			orig_offset = 0;
 		}
@@ -38,6 +38,7 @@
 #include <net/sock.h>
 #include <linux/list_sort.h>
 #include <linux/rbtree_augmented.h>
+#include <linux/interval_tree_generic.h>
 #include "core.h"
 #include "netlink.h"
 #include "name_table.h"
@@ -74,7 +75,7 @@ struct service_range {
  * @publ_cnt: increasing counter for publications in this service
  * @ranges: rb tree containing all service ranges for this service
  * @service_list: links to adjacent name ranges in hash chain
- * @subscriptions: list of subscriptions for this service type
+ * @subscriptions: interval tree of subscriptions for this service type
  * @lock: spinlock controlling access to pertaining service ranges/publications
  * @rcu: RCU callback head used for deferred freeing
  */
@@ -83,7 +84,7 @@ struct tipc_service {
 	u32 publ_cnt;
 	struct rb_root ranges;
 	struct hlist_node service_list;
-	struct list_head subscriptions;
+	struct rb_root_cached subscriptions;
 	spinlock_t lock; /* Covers service range list */
 	struct rcu_head rcu;
 };
@@ -93,6 +94,35 @@ RB_DECLARE_CALLBACKS_MAX(static, sr_callbacks,
 			 struct service_range, tree_node, u32, max,
 			 service_range_upper)
 
+/* Subscriptions are kept in an interval tree as well, so that a publication
+ * only has to look at the subscriptions overlapping with its range.
+ */
+#define tipc_sub_lower(sub) ((sub)->s.seq.lower)
+#define tipc_sub_upper(sub) ((sub)->s.seq.upper)
+INTERVAL_TREE_DEFINE(struct tipc_subscription, service_node, u32, service_max,
+		     tipc_sub_lower, tipc_sub_upper, static, tipc_service_sub)
+
+/**
+ * service_sub_foreach_match - iterate over the subscriptions of a service
+ *                             overlapping with a range
+ * @sub: the subscription pointer as a loop cursor
+ * @sc: the pointer to tipc service which holds the subscription tree
+ * @start: beginning of the search range (end >= start) for matching
+ * @end: end of the search range (end >= start) for matching
+ */
+#define service_sub_foreach_match(sub, sc, start, end)			\
+	for (sub = tipc_service_sub_iter_first(&(sc)->subscriptions,	\
+					       start, end);		\
+	     sub;							\
+	     sub = tipc_service_sub_iter_next(sub, start, end))
+
+/* A service may go once it has neither publications nor subscriptions */
+static bool tipc_service_empty(struct tipc_service *sc)
+{
+	return RB_EMPTY_ROOT(&sc->ranges) &&
+	       RB_EMPTY_ROOT(&sc->subscriptions.rb_root);
+}
+
 #define service_range_entry(rbtree_node)				\
 	(container_of(rbtree_node, struct service_range, tree_node))
 
@@ -271,7 +301,7 @@ static struct tipc_service *tipc_service_create(struct net *net,
 	service->type = ua->sr.type;
 	service->ranges = RB_ROOT;
 	INIT_HLIST_NODE(&service->service_list);
-	INIT_LIST_HEAD(&service->subscriptions);
+	service->subscriptions = RB_ROOT_CACHED;
 	hd = &nt->services[hash(ua->sr.type)];
 	hlist_add_head_rcu(&service->service_list, hd);
 	return service;
@@ -331,7 +361,7 @@ static bool tipc_service_insert_publ(struct net *net,
 				     struct tipc_service *sc,
 				     struct publication *p)
 {
-	struct tipc_subscription *sub, *tmp;
+	struct tipc_subscription *sub;
 	struct service_range *sr;
 	struct publication *_p;
 	u32 node = p->sk.node;
@@ -362,9 +392,8 @@ static bool tipc_service_insert_publ(struct net *net,
 	p->id = sc->publ_cnt++;
 
 	/* Any subscriptions waiting for notification?  */
-	list_for_each_entry_safe(sub, tmp, &sc->subscriptions, service_list) {
+	service_sub_foreach_match(sub, sc, p->sr.lower, p->sr.upper)
 		tipc_sub_report_overlap(sub, p, TIPC_PUBLISHED, first);
-	}
 	res = true;
 exit:
 	if (!res)
@@ -431,7 +460,7 @@ static void tipc_service_subscribe(struct tipc_service *service,
 	upper = sub->s.seq.upper;
 
 	tipc_sub_get(sub);
-	list_add(&sub->service_list, &service->subscriptions);
+	tipc_service_sub_insert(sub, &service->subscriptions);
 
 	if (filter & TIPC_SUB_NO_STATUS)
 		return;
@@ -499,7 +528,7 @@ struct publication *tipc_nametbl_remove_publ(struct net *net,
 					     struct tipc_socket_addr *sk,
 					     u32 key)
 {
-	struct tipc_subscription *sub, *tmp;
+	struct tipc_subscription *sub;
 	struct publication *p = NULL;
 	struct service_range *sr;
 	struct tipc_service *sc;
@@ -519,9 +548,8 @@ struct publication *tipc_nametbl_remove_publ(struct net *net,
 
 	/* Notify any waiting subscriptions */
 	last = list_empty(&sr->all_publ);
-	list_for_each_entry_safe(sub, tmp, &sc->subscriptions, service_list) {
+	service_sub_foreach_match(sub, sc, p->sr.lower, p->sr.upper)
 		tipc_sub_report_overlap(sub, p, TIPC_WITHDRAWN, last);
-	}
 
 	/* Remove service range item if this was its last publication */
 	if (list_empty(&sr->all_publ)) {
@@ -530,7 +558,7 @@ struct publication *tipc_nametbl_remove_publ(struct net *net,
 	}
 
 	/* Delete service item if no more publications and subscriptions */
-	if (RB_EMPTY_ROOT(&sc->ranges) && list_empty(&sc->subscriptions)) {
+	if (tipc_service_empty(sc)) {
 		hlist_del_init_rcu(&sc->service_list);
 		kfree_rcu(sc, rcu);
 	}
@@ -823,6 +851,10 @@ void tipc_nametbl_withdraw(struct net *net, struct tipc_uaddr *ua,
 /**
  * tipc_nametbl_subscribe - add a subscription object to the name table
  * @sub: subscription to add
+ *
+ * Subscribing to an existing service only takes the service lock, the name
+ * table lock is needed to create the service if there is none yet, or if it
+ * has just been deleted under our feet.
  */
 bool tipc_nametbl_subscribe(struct tipc_subscription *sub)
 {
@@ -834,6 +866,21 @@ bool tipc_nametbl_subscribe(struct tipc_subscription *sub)
 
 	tipc_uaddr(&ua, TIPC_SERVICE_RANGE, TIPC_NODE_SCOPE, type,
 		   sub->s.seq.lower, sub->s.seq.upper);
+
+	rcu_read_lock();
+	sc = tipc_service_find(sub->net, &ua);
+	if (sc) {
+		spin_lock_bh(&sc->lock);
+		if (!hlist_unhashed(&sc->service_list)) {
+			tipc_service_subscribe(sc, sub);
+			spin_unlock_bh(&sc->lock);
+			rcu_read_unlock();
+			return true;
+		}
+		spin_unlock_bh(&sc->lock);
+	}
+	rcu_read_unlock();
+
 	spin_lock_bh(&tn->nametbl_lock);
 	sc = tipc_service_find(sub->net, &ua);
 	if (!sc)
@@ -854,31 +901,51 @@ bool tipc_nametbl_subscribe(struct tipc_subscription *sub)
 /**
  * tipc_nametbl_unsubscribe - remove a subscription object from name table
  * @sub: subscription to remove
+ *
+ * As for subscribing, the name table lock is only taken when the service
+ * has to be deleted.
  */
 void tipc_nametbl_unsubscribe(struct tipc_subscription *sub)
 {
 	struct tipc_net *tn = tipc_net(sub->net);
 	struct tipc_service *sc;
 	struct tipc_uaddr ua;
+	bool empty = false;
 
 	tipc_uaddr(&ua, TIPC_SERVICE_RANGE, TIPC_NODE_SCOPE,
 		   sub->s.seq.type, sub->s.seq.lower, sub->s.seq.upper);
-	spin_lock_bh(&tn->nametbl_lock);
+
+	rcu_read_lock();
 	sc = tipc_service_find(sub->net, &ua);
-	if (!sc)
-		goto exit;
+	if (!sc) {
+		rcu_read_unlock();
+		return;
+	}
 
 	spin_lock_bh(&sc->lock);
-	list_del_init(&sub->service_list);
-	tipc_sub_put(sub);
+	if (!RB_EMPTY_NODE(&sub->service_node)) {
+		tipc_service_sub_remove(sub, &sc->subscriptions);
+		RB_CLEAR_NODE(&sub->service_node);
+		tipc_sub_put(sub);
+	}
+	empty = tipc_service_empty(sc);
+	spin_unlock_bh(&sc->lock);
+	rcu_read_unlock();
+
+	if (!empty)
+		return;
 
 	/* Delete service item if no more publications and subscriptions */
-	if (RB_EMPTY_ROOT(&sc->ranges) && list_empty(&sc->subscriptions)) {
-		hlist_del_init_rcu(&sc->service_list);
-		kfree_rcu(sc, rcu);
+	spin_lock_bh(&tn->nametbl_lock);
+	sc = tipc_service_find(sub->net, &ua);
+	if (sc) {
+		spin_lock_bh(&sc->lock);
+		if (tipc_service_empty(sc)) {
+			hlist_del_init_rcu(&sc->service_list);
+			kfree_rcu(sc, rcu);
+		}
+		spin_unlock_bh(&sc->lock);
 	}
-	spin_unlock_bh(&sc->lock);
-exit:
 	spin_unlock_bh(&tn->nametbl_lock);
 }
 
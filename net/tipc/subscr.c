@@ -148,7 +148,7 @@ struct tipc_subscription *tipc_sub_subscribe(struct net *net,
 		pr_warn("Subscription rejected, no memory\n");
 		return NULL;
 	}
-	INIT_LIST_HEAD(&sub->service_list);
+	RB_CLEAR_NODE(&sub->service_node);
 	INIT_LIST_HEAD(&sub->sub_list);
 	sub->net = net;
 	sub->conid = conid;
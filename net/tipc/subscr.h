@@ -54,7 +54,8 @@ struct tipc_conn;
  * @kref: reference count for this subscription
  * @net: network namespace associated with subscription
  * @timer: timer governing subscription duration (optional)
- * @service_list: adjacent subscriptions in name sequence's subscription list
+ * @service_node: member of the service's subscription interval tree
+ * @service_max: largest upper bound in this node subtree
  * @sub_list: adjacent subscriptions in subscriber's subscription list
  * @conid: connection identifier of topology server
  * @inactive: true if this subscription is inactive
@@ -66,7 +67,8 @@ struct tipc_subscription {
 	struct kref kref;
 	struct net *net;
 	struct timer_list timer;
-	struct list_head service_list;
+	struct rb_node service_node;
+	u32 service_max;
 	struct list_head sub_list;
 	int conid;
 	bool inactive;
@@ -809,6 +809,7 @@ static void __vsock_release(struct sock *sk, int level)
 		sk->sk_shutdown = SHUTDOWN_MASK;
 
 		skb_queue_purge(&sk->sk_receive_queue);
+		skb_queue_purge(&sk->sk_error_queue);
 
 		/* Clean up any sockets that never were accepted. */
 		while ((pending = vsock_dequeue_accept(sk)) != NULL) {
@@ -1011,8 +1012,10 @@ static __poll_t vsock_poll(struct file *file, struct socket *sock,
 	poll_wait(file, sk_sleep(sk), wait);
 	mask = 0;
 
-	if (sk->sk_err)
-		/* Signify that there has been an error on this socket. */
+	if (sk->sk_err || !skb_queue_empty_lockless(&sk->sk_error_queue))
+		/* Signify that there has been an error on this socket, or
+		 * that MSG_ZEROCOPY completions are waiting to be read.
+		 */
 		mask |= EPOLLERR;
 
 	/* INET sockets treat local write shutdown and peer write shutdown as a
@@ -1561,6 +1564,30 @@ static void vsock_update_buffer_size(struct vsock_sock *vsk,
 	vsk->buffer_size = val;
 }
 
+static int vsock_set_zerocopy(struct sock *sk, sockptr_t optval,
+			      unsigned int optlen)
+{
+	int val;
+
+	if (sk->sk_type != SOCK_STREAM)
+		return -EOPNOTSUPP;
+
+	if (optlen < sizeof(val))
+		return -EINVAL;
+
+	if (copy_from_sockptr(&val, optval, sizeof(val)))
+		return -EFAULT;
+
+	if (val < 0 || val > 1)
+		return -EINVAL;
+
+	lock_sock(sk);
+	sock_valbool_flag(sk, SOCK_ZEROCOPY, val);
+	release_sock(sk);
+
+	return 0;
+}
+
 static int vsock_connectible_setsockopt(struct socket *sock,
 					int level,
 					int optname,
@@ -1573,6 +1600,17 @@ static int vsock_connectible_setsockopt(struct socket *sock,
 	const struct vsock_transport *transport;
 	u64 val;
 
+	/* Stream sockets get SOL_SOCKET options too (see
+	 * sock_use_custom_sol_socket()), so that SO_ZEROCOPY, which the core
+	 * only accepts for TCP, UDP and RDS, can be enabled here.
+	 */
+	if (level == SOL_SOCKET) {
+		if (optname == SO_ZEROCOPY)
+			return vsock_set_zerocopy(sock->sk, optval, optlen);
+
+		return sock_setsockopt(sock, level, optname, optval, optlen);
+	}
+
 	if (level != AF_VSOCK)
 		return -ENOPROTOOPT;
 
@@ -2074,6 +2112,10 @@ vsock_connectible_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 	vsk = vsock_sk(sk);
 	err = 0;
 
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sk, msg, len, SOL_VSOCK,
+					  VSOCK_RECVERR);
+
 	lock_sock(sk);
 
 	transport = vsk->transport;
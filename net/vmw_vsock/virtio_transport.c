@@ -39,6 +39,8 @@ struct virtio_vsock {
 	 */
 	struct mutex tx_lock;
 	bool tx_run;
+	/* Payload descriptors of the packet being added to the TX vq */
+	struct scatterlist out_sgs[VIRTIO_VSOCK_MAX_ZC_PAGES];
 
 	struct work_struct send_pkt_work;
 	spinlock_t send_pkt_list_lock;
@@ -83,6 +85,24 @@ static u32 virtio_transport_get_local_cid(void)
 	return ret;
 }
 
+/* Describe the pinned user pages of a MSG_ZEROCOPY packet in 'sg' */
+static void virtio_transport_zcopy_sg(struct virtio_vsock_pkt *pkt,
+				      struct scatterlist *sg)
+{
+	u32 off = pkt->zc_off;
+	u32 len = pkt->len;
+	unsigned int i;
+
+	sg_init_table(sg, pkt->zc_nr_pages);
+	for (i = 0; i < pkt->zc_nr_pages; i++) {
+		u32 bytes = min_t(u32, len, PAGE_SIZE - off);
+
+		sg_set_page(&sg[i], pkt->zc_pages[i], bytes, off);
+		len -= bytes;
+		off = 0;
+	}
+}
+
 static void
 virtio_transport_send_pkt_work(struct work_struct *work)
 {
@@ -100,8 +120,9 @@ virtio_transport_send_pkt_work(struct work_struct *work)
 	vq = vsock->vqs[VSOCK_VQ_TX];
 
 	for (;;) {
+		struct scatterlist *bufs = vsock->out_sgs;
 		struct virtio_vsock_pkt *pkt;
-		struct scatterlist hdr, buf, *sgs[2];
+		struct scatterlist hdr, *sgs[2];
 		int ret, in_sg = 0, out_sg = 0;
 		bool reply;
 
@@ -122,9 +143,12 @@ virtio_transport_send_pkt_work(struct work_struct *work)
 
 		sg_init_one(&hdr, &pkt->hdr, sizeof(pkt->hdr));
 		sgs[out_sg++] = &hdr;
-		if (pkt->buf) {
-			sg_init_one(&buf, pkt->buf, pkt->len);
-			sgs[out_sg++] = &buf;
+		if (pkt->zc_pages) {
+			virtio_transport_zcopy_sg(pkt, bufs);
+			sgs[out_sg++] = bufs;
+		} else if (pkt->buf) {
+			sg_init_one(bufs, pkt->buf, pkt->len);
+			sgs[out_sg++] = bufs;
 		}
 
 		ret = virtqueue_add_sgs(vq, sgs, out_sg, in_sg, pkt, GFP_KERNEL);
@@ -448,6 +472,7 @@ static void virtio_vsock_rx_done(struct virtqueue *vq)
 }
 
 static bool virtio_transport_seqpacket_allow(u32 remote_cid);
+static bool virtio_transport_can_msgzerocopy(int bufs_num);
 
 static struct virtio_transport virtio_transport = {
 	.transport = {
@@ -494,8 +519,34 @@ static struct virtio_transport virtio_transport = {
 	},
 
 	.send_pkt = virtio_transport_send_pkt,
+	.can_msgzerocopy = virtio_transport_can_msgzerocopy,
 };
 
+static bool virtio_transport_can_msgzerocopy(int bufs_num)
+{
+	struct virtio_vsock *vsock;
+	bool res = false;
+
+	if (bufs_num > VIRTIO_VSOCK_MAX_ZC_PAGES)
+		return false;
+
+	rcu_read_lock();
+	vsock = rcu_dereference(the_virtio_vsock);
+	if (vsock) {
+		struct virtqueue *vq = vsock->vqs[VSOCK_VQ_TX];
+
+		/* Every pinned page takes a descriptor next to the header.
+		 * A packet that can never fit in the TX virtqueue would be
+		 * requeued forever by virtio_transport_send_pkt_work(), so
+		 * copy it instead.
+		 */
+		res = bufs_num + 1 <= virtqueue_get_vring_size(vq);
+	}
+	rcu_read_unlock();
+
+	return res;
+}
+
 static bool virtio_transport_seqpacket_allow(u32 remote_cid)
 {
 	struct virtio_vsock *vsock;
@@ -11,6 +11,9 @@
 #include <linux/sched/signal.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
+#include <linux/highmem.h>
+#include <linux/log2.h>
+#include <linux/uio.h>
 #include <linux/virtio_vsock.h>
 #include <uapi/linux/vsockmon.h>
 
@@ -26,6 +29,12 @@
 /* Threshold for detecting small packets to copy */
 #define GOOD_COPY_LEN  128
 
+/* Small packets are coalesced on receive into a buffer of at most this
+ * size, so that a stream of tiny writes does not queue (and later copy
+ * out) one packet per write.
+ */
+#define VIRTIO_VSOCK_RX_COALESCE_SIZE	VIRTIO_VSOCK_DEFAULT_RX_BUF_SIZE
+
 static const struct virtio_transport *
 virtio_transport_get_ops(struct vsock_sock *vsk)
 {
@@ -37,6 +46,75 @@ virtio_transport_get_ops(struct vsock_sock *vsk)
 	return container_of(t, struct virtio_transport, transport);
 }
 
+/* Pin the user pages backing the next 'len' bytes of 'msg' and attach them
+ * to 'pkt' instead of copying the payload.  Only the current iovec segment
+ * is pinned, so fewer than 'len' bytes may be consumed.
+ *
+ * Returns the number of bytes attached or a negative errno.
+ */
+static int virtio_transport_zcopy_from_msg(struct virtio_vsock_pkt *pkt,
+					   struct msghdr *msg,
+					   size_t len)
+{
+	struct page **pages;
+	size_t start;
+	ssize_t pinned;
+
+	pinned = iov_iter_get_pages_alloc(&msg->msg_iter, &pages, len, &start);
+	if (pinned <= 0)
+		return pinned ? pinned : -EFAULT;
+
+	iov_iter_advance(&msg->msg_iter, pinned);
+
+	pkt->zc_pages = pages;
+	pkt->zc_nr_pages = DIV_ROUND_UP(start + pinned, PAGE_SIZE);
+	pkt->zc_off = start;
+
+	return pinned;
+}
+
+static void virtio_transport_zcopy_release(struct virtio_vsock_pkt *pkt)
+{
+	unsigned int i;
+
+	for (i = 0; i < pkt->zc_nr_pages; i++)
+		put_page(pkt->zc_pages[i]);
+
+	kvfree(pkt->zc_pages);
+	pkt->zc_pages = NULL;
+	pkt->zc_nr_pages = 0;
+}
+
+/* Copy 'len' bytes of a zerocopy packet payload, starting at 'off' */
+static void virtio_transport_zcopy_copy(struct virtio_vsock_pkt *pkt,
+					void *to, u32 off, u32 len)
+{
+	u32 pos = pkt->zc_off + off;
+
+	while (len) {
+		struct page *page = pkt->zc_pages[pos / PAGE_SIZE];
+		u32 page_off = offset_in_page(pos);
+		u32 bytes = min_t(u32, len, PAGE_SIZE - page_off);
+
+		memcpy_from_page(to, page, page_off, bytes);
+		to += bytes;
+		pos += bytes;
+		len -= bytes;
+	}
+}
+
+/* MSG_ZEROCOPY is only supported for SOCK_STREAM sockets */
+static bool virtio_transport_msgzerocopy(struct vsock_sock *vsk,
+					 struct virtio_vsock_pkt_info *info)
+{
+	struct sock *sk = sk_vsock(vsk);
+
+	return info->msg && info->op == VIRTIO_VSOCK_OP_RW &&
+	       (info->msg->msg_flags & MSG_ZEROCOPY) &&
+	       sock_flag(sk, SOCK_ZEROCOPY) &&
+	       sk->sk_type == SOCK_STREAM;
+}
+
 static struct virtio_vsock_pkt *
 virtio_transport_alloc_pkt(struct virtio_vsock_pkt_info *info,
 			   size_t len,
@@ -64,7 +142,16 @@ virtio_transport_alloc_pkt(struct virtio_vsock_pkt_info *info,
 	pkt->reply		= info->reply;
 	pkt->vsk		= info->vsk;
 
-	if (info->msg && len > 0) {
+	if (info->msg && len > 0 && info->zcopy) {
+		err = virtio_transport_zcopy_from_msg(pkt, info->msg, len);
+		if (err < 0)
+			goto out_pkt;
+
+		/* The pinned range may be shorter than the credit we got */
+		len = err;
+		pkt->len = len;
+		pkt->hdr.len = cpu_to_le32(len);
+	} else if (info->msg && len > 0) {
 		pkt->buf = kmalloc(len, GFP_KERNEL);
 		if (!pkt->buf)
 			goto out_pkt;
@@ -74,7 +161,9 @@ virtio_transport_alloc_pkt(struct virtio_vsock_pkt_info *info,
 		err = memcpy_from_msg(pkt->buf, info->msg, len);
 		if (err)
 			goto out;
+	}
 
+	if (info->msg && len > 0) {
 		if (msg_data_left(info->msg) == 0 &&
 		    info->type == VIRTIO_VSOCK_TYPE_SEQPACKET) {
 			pkt->hdr.flags |= cpu_to_le32(VIRTIO_VSOCK_SEQ_EOM);
@@ -157,7 +246,12 @@ static struct sk_buff *virtio_transport_build_skb(void *opaque)
 	skb_put_data(skb, &pkt->hdr, sizeof(pkt->hdr));
 
 	if (payload_len) {
-		skb_put_data(skb, payload_buf, payload_len);
+		if (pkt->zc_pages)
+			virtio_transport_zcopy_copy(pkt,
+						    skb_put(skb, payload_len),
+						    pkt->off, payload_len);
+		else
+			skb_put_data(skb, payload_buf, payload_len);
 	}
 
 	return skb;
@@ -191,6 +285,7 @@ static int virtio_transport_send_pkt_info(struct vsock_sock *vsk,
 {
 	u32 src_cid, src_port, dst_cid, dst_port;
 	const struct virtio_transport *t_ops;
+	struct ubuf_info *uarg = NULL;
 	struct virtio_vsock_sock *vvs;
 	struct virtio_vsock_pkt *pkt;
 	u32 pkt_len = info->pkt_len;
@@ -224,14 +319,48 @@ static int virtio_transport_send_pkt_info(struct vsock_sock *vsk,
 	if (pkt_len == 0 && info->op == VIRTIO_VSOCK_OP_RW)
 		return pkt_len;
 
+	if (virtio_transport_msgzerocopy(vsk, info)) {
+		int bufs_num = DIV_ROUND_UP(pkt_len, PAGE_SIZE) + 1;
+
+		uarg = msg_zerocopy_alloc(sk_vsock(vsk), pkt_len);
+		if (!uarg) {
+			virtio_transport_put_credit(vvs, pkt_len);
+			return -ENOBUFS;
+		}
+
+		/* Fall back to copying if the transport can't reference user
+		 * pages; the completion then reports SO_EE_CODE_ZEROCOPY_COPIED.
+		 */
+		info->zcopy = t_ops->can_msgzerocopy &&
+			      t_ops->can_msgzerocopy(bufs_num);
+		if (!info->zcopy)
+			uarg->zerocopy = 0;
+	}
+
 	pkt = virtio_transport_alloc_pkt(info, pkt_len,
 					 src_cid, src_port,
 					 dst_cid, dst_port);
 	if (!pkt) {
+		net_zcopy_put_abort(uarg, true);
 		virtio_transport_put_credit(vvs, pkt_len);
 		return -ENOMEM;
 	}
 
+	/* A zerocopy packet may carry less than the credit it was given */
+	if (pkt->len < pkt_len)
+		virtio_transport_put_credit(vvs, pkt_len - pkt->len);
+
+	if (uarg) {
+		/* Pinned pages are released, and the completion queued, when
+		 * the transport frees the packet.  Copied data needs no such
+		 * wait.
+		 */
+		if (info->zcopy)
+			pkt->uarg = uarg;
+		else
+			net_zcopy_put(uarg);
+	}
+
 	virtio_transport_inc_tx_pkt(vvs, pkt);
 
 	return t_ops->send_pkt(pkt);
@@ -1018,6 +1147,30 @@ virtio_transport_recv_connecting(struct sock *sk,
 	return err;
 }
 
+/* Give a small packet about to be queued for receive some tail room.
+ * Transports that size buffers to the payload (vhost, loopback) never leave
+ * any, so without this a burst of small packets queues a packet each.
+ *
+ * Only 'pkt' is grown, while nobody else can see it: readers drop rx_lock
+ * while copying out of queued packets, so the buffer of a queued packet
+ * must never be reallocated.
+ */
+static void virtio_transport_rx_grow(struct virtio_vsock_pkt *pkt)
+{
+	void *buf;
+
+	if (!pkt->buf || pkt->buf_len >= VIRTIO_VSOCK_RX_COALESCE_SIZE)
+		return;
+
+	buf = krealloc(pkt->buf, VIRTIO_VSOCK_RX_COALESCE_SIZE,
+		       GFP_ATOMIC | __GFP_NOWARN);
+	if (!buf)
+		return;
+
+	pkt->buf = buf;
+	pkt->buf_len = VIRTIO_VSOCK_RX_COALESCE_SIZE;
+}
+
 static void
 virtio_transport_recv_enqueue(struct vsock_sock *vsk,
 			      struct virtio_vsock_pkt *pkt)
@@ -1043,7 +1196,8 @@ virtio_transport_recv_enqueue(struct vsock_sock *vsk,
 	 * to avoid wasting memory queueing the entire buffer with a small
 	 * payload.
 	 */
-	if (pkt->len <= GOOD_COPY_LEN && !list_empty(&vvs->rx_queue)) {
+	if (pkt->len <= GOOD_COPY_LEN && pkt->buf &&
+	    !list_empty(&vvs->rx_queue)) {
 		struct virtio_vsock_pkt *last_pkt;
 
 		last_pkt = list_last_entry(&vvs->rx_queue,
@@ -1055,8 +1209,8 @@ virtio_transport_recv_enqueue(struct vsock_sock *vsk,
 		 * delimiter of SEQPACKET message, so 'pkt' is the first packet
 		 * of a new message.
 		 */
-		if ((pkt->len <= last_pkt->buf_len - last_pkt->len) &&
-		    !(le32_to_cpu(last_pkt->hdr.flags) & VIRTIO_VSOCK_SEQ_EOM)) {
+		if (!(le32_to_cpu(last_pkt->hdr.flags) & VIRTIO_VSOCK_SEQ_EOM) &&
+		    pkt->len <= last_pkt->buf_len - last_pkt->len) {
 			memcpy(last_pkt->buf + last_pkt->len, pkt->buf,
 			       pkt->len);
 			last_pkt->len += pkt->len;
@@ -1066,6 +1220,11 @@ virtio_transport_recv_enqueue(struct vsock_sock *vsk,
 		}
 	}
 
+	/* let the small packets that follow be copied into this one */
+	if (pkt->len <= GOOD_COPY_LEN &&
+	    !(le32_to_cpu(pkt->hdr.flags) & VIRTIO_VSOCK_SEQ_EOM))
+		virtio_transport_rx_grow(pkt);
+
 	list_add_tail(&pkt->list, &vvs->rx_queue);
 
 out:
@@ -1341,6 +1500,9 @@ EXPORT_SYMBOL_GPL(virtio_transport_recv_pkt);
 
 void virtio_transport_free_pkt(struct virtio_vsock_pkt *pkt)
 {
+	if (pkt->zc_pages)
+		virtio_transport_zcopy_release(pkt);
+	net_zcopy_put(pkt->uarg);
 	kfree(pkt->buf);
 	kfree(pkt);
 }
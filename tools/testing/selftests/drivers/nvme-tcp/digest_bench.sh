@@ -0,0 +1,200 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Measure the cost of the NVMe/TCP header and data digests on the host
+# receive path: export a null_blk device through an nvmet-tcp target on
+# the loopback interface, connect to it once without and once with
+# hdr_digest/data_digest, and run 4k random reads with fio against each
+# connection.  For every run, the IOPS and the cpu time of the whole
+# system are reported; target and host share the cpus, so the cpu time
+# per IO includes both ends.
+#
+# Run it on the kernels to compare, e.g. before and after a change to
+# drivers/nvme/host/tcp.c.
+#
+# Usage: digest_bench.sh [-t seconds] [-j jobs] [-q iodepth] [-d device]
+#
+#   -d  back the namespace with this block device or file instead of a
+#       null_blk device
+
+ksft_skip=4
+runtime=30
+jobs=4
+iodepth=32
+backing=
+nqn="nqn.2021-10.org.kernel:digest-bench-$$"
+port_id=
+nullb=
+nvme_ctrl=
+
+usage()
+{
+	echo "Usage: $0 [-t seconds] [-j jobs] [-q iodepth] [-d device]"
+	exit 1
+}
+
+while getopts "t:j:q:d:h" option; do
+	case "$option" in
+	t) runtime=$OPTARG ;;
+	j) jobs=$OPTARG ;;
+	q) iodepth=$OPTARG ;;
+	d) backing=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+cfs=/sys/kernel/config
+nvmet=$cfs/nvmet
+
+cleanup()
+{
+	disconnect
+	if [ -n "$port_id" ]; then
+		rm -f "$nvmet/ports/$port_id/subsystems/$nqn"
+		rmdir "$nvmet/ports/$port_id" 2>/dev/null
+	fi
+	if [ -d "$nvmet/subsystems/$nqn" ]; then
+		echo 0 > "$nvmet/subsystems/$nqn/namespaces/1/enable" 2>/dev/null
+		rmdir "$nvmet/subsystems/$nqn/namespaces/1" 2>/dev/null
+		rmdir "$nvmet/subsystems/$nqn" 2>/dev/null
+	fi
+	if [ -n "$nullb" ]; then
+		echo 0 > "$cfs/nullb/$nullb/power" 2>/dev/null
+		rmdir "$cfs/nullb/$nullb" 2>/dev/null
+	fi
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: must be run as root"
+	exit $ksft_skip
+fi
+
+if ! command -v fio > /dev/null; then
+	echo "SKIP: fio is not installed"
+	exit $ksft_skip
+fi
+
+for mod in nvmet nvmet-tcp nvme-tcp; do
+	if ! modprobe -q $mod; then
+		echo "SKIP: cannot load $mod"
+		exit $ksft_skip
+	fi
+done
+[ -z "$backing" ] && modprobe -q null_blk nr_devices=0
+
+if [ ! -d "$nvmet" ] || [ ! -c /dev/nvme-fabrics ]; then
+	echo "SKIP: nvmet configfs or /dev/nvme-fabrics not available"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+# a memoryless null_blk device, so that only the transport is measured
+if [ -z "$backing" ]; then
+	if [ ! -d "$cfs/nullb" ]; then
+		echo "SKIP: null_blk configfs not available"
+		exit $ksft_skip
+	fi
+	nullb="digest-bench-$$"
+	mkdir "$cfs/nullb/$nullb"
+	echo 4096 > "$cfs/nullb/$nullb/size"
+	echo 4096 > "$cfs/nullb/$nullb/blocksize"
+	echo 2 > "$cfs/nullb/$nullb/queue_mode"
+	echo 0 > "$cfs/nullb/$nullb/irqmode"
+	echo 1 > "$cfs/nullb/$nullb/power"
+	backing=/dev/nullb$(cat "$cfs/nullb/$nullb/index")
+fi
+
+mkdir "$nvmet/subsystems/$nqn"
+echo 1 > "$nvmet/subsystems/$nqn/attr_allow_any_host"
+mkdir "$nvmet/subsystems/$nqn/namespaces/1"
+echo -n "$backing" > "$nvmet/subsystems/$nqn/namespaces/1/device_path"
+echo 1 > "$nvmet/subsystems/$nqn/namespaces/1/enable" || exit 1
+
+for port_id in $(seq 1 1000); do
+	mkdir "$nvmet/ports/$port_id" 2>/dev/null && break
+done
+trsvcid=$((4420 + port_id))
+echo tcp > "$nvmet/ports/$port_id/addr_trtype"
+echo ipv4 > "$nvmet/ports/$port_id/addr_adrfam"
+echo 127.0.0.1 > "$nvmet/ports/$port_id/addr_traddr"
+echo $trsvcid > "$nvmet/ports/$port_id/addr_trsvcid"
+ln -s "$nvmet/subsystems/$nqn" "$nvmet/ports/$port_id/subsystems/$nqn"
+
+# $1: extra connect options; sets nvme_ctrl and nvme_ns
+connect()
+{
+	local opts="transport=tcp,traddr=127.0.0.1,trsvcid=$trsvcid,nqn=$nqn$1"
+	local reply ns i
+
+	exec 3<>/dev/nvme-fabrics
+	echo "$opts" >&3 || return 1
+	read -r reply <&3
+	exec 3>&-
+	nvme_ctrl=$(echo "$reply" | sed -n 's/.*instance=\([0-9]*\).*/nvme\1/p')
+	[ -n "$nvme_ctrl" ] || return 1
+
+	# with native multipath the disk hangs off the subsystem, not
+	# off the controller, both of which have the nqn
+	for i in $(seq 50); do
+		for ns in /sys/block/nvme*n*; do
+			[ "$(cat "$ns/device/subsysnqn" 2>/dev/null)" = "$nqn" ] ||
+				continue
+			nvme_ns=/dev/$(basename "$ns")
+			[ -b "$nvme_ns" ] && return 0
+		done
+		sleep 0.1
+	done
+	return 1
+}
+
+disconnect()
+{
+	[ -n "$nvme_ctrl" ] || return
+	echo 1 > /sys/class/nvme/$nvme_ctrl/delete_controller 2>/dev/null
+	nvme_ctrl=
+}
+
+# busy and total jiffies of all the cpus
+cpu_jiffies()
+{
+	awk '/^cpu / { print $2 + $3 + $4 + $7 + $8 + $9, $2 + $3 + $4 + $5 + $6 + $7 + $8 + $9 }' /proc/stat
+}
+
+# $1: description, $2: extra connect options
+run()
+{
+	local busy0 total0 busy1 total1 iops out
+
+	if ! connect "$2"; then
+		echo "$1: connect failed"
+		return 1
+	fi
+
+	read -r busy0 total0 <<< "$(cpu_jiffies)"
+	out=$(fio --name=randread --filename="$nvme_ns" --rw=randread --bs=4k \
+		  --direct=1 --ioengine=libaio --iodepth=$iodepth \
+		  --numjobs=$jobs --runtime=$runtime --time_based \
+		  --group_reporting --output-format=terse --terse-version=3)
+	read -r busy1 total1 <<< "$(cpu_jiffies)"
+	disconnect
+
+	# terse v3: field 8 is the read IOPS
+	iops=$(echo "$out" | awk -F';' '{ print $8 }')
+	if [ -z "$iops" ] || [ "$iops" -eq 0 ]; then
+		echo "$1: fio failed"
+		return 1
+	fi
+
+	awk -v d="$1" -v iops=$iops -v rt=$runtime -v hz=$(getconf CLK_TCK) \
+	    -v busy=$((busy1 - busy0)) -v total=$((total1 - total0)) 'BEGIN {
+		printf "%-12s %9d IOPS  cpu %5.1f%%  %6.2f us cpu/IO\n", d,
+		       iops, 100 * busy / total, busy * 1e6 / hz / (iops * rt)
+	}'
+}
+
+echo "4k randread, $jobs jobs, iodepth $iodepth, ${runtime}s, backing $backing"
+ret=0
+run "no digest" "" || ret=1
+run "digest" ",hdr_digest,data_digest" || ret=1
+exit $ret
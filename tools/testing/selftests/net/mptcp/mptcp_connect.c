@@ -36,6 +36,12 @@ extern int optind;
 #ifndef TCP_ULP
 #define TCP_ULP 31
 #endif
+#ifndef SOL_MPTCP
+#define SOL_MPTCP 284
+#endif
+#ifndef MPTCP_SCHEDULER
+#define MPTCP_SCHEDULER 1
+#endif
 
 static int  poll_timeout = 10 * 1000;
 static bool listen_mode;
@@ -67,6 +73,8 @@ static bool cfg_remove;
 static unsigned int cfg_do_w;
 static int cfg_wait;
 static uint32_t cfg_mark;
+static const char *cfg_sched;
+static const char *cfg_expect_sched;
 
 struct cfg_cmsg_types {
 	unsigned int cmsg_enabled:1;
@@ -87,6 +95,8 @@ static void die_usage(void)
 	fprintf(stderr, "\t-s [MPTCP|TCP] -- use mptcp(default) or tcp sockets\n");
 	fprintf(stderr, "\t-m [poll|mmap|sendfile] -- use poll(default)/mmap+write/sendfile\n");
 	fprintf(stderr, "\t-M mark -- set socket packet mark\n");
+	fprintf(stderr, "\t-e sched -- set the MPTCP packet scheduler\n");
+	fprintf(stderr, "\t-E sched -- check the connection uses scheduler sched\n");
 	fprintf(stderr, "\t-u -- check mptcp ulp\n");
 	fprintf(stderr, "\t-w num -- wait num sec before closing the socket\n");
 	fprintf(stderr, "\t-c cmsg -- test cmsg type <cmsg>\n");
@@ -182,6 +192,31 @@ static void set_mark(int fd, uint32_t mark)
 	}
 }
 
+static void set_sched(int fd, const char *sched)
+{
+	int err;
+
+	err = setsockopt(fd, SOL_MPTCP, MPTCP_SCHEDULER, sched, strlen(sched));
+	if (err) {
+		perror("set MPTCP_SCHEDULER");
+		exit(1);
+	}
+}
+
+static void check_sched(int fd, const char *expect)
+{
+	char sched[16] = { 0 };
+	socklen_t len = sizeof(sched) - 1;
+
+	if (getsockopt(fd, SOL_MPTCP, MPTCP_SCHEDULER, sched, &len) < 0) {
+		perror("get MPTCP_SCHEDULER");
+		exit(1);
+	}
+
+	if (strcmp(sched, expect))
+		xerror("scheduler is '%s', expected '%s'\n", sched, expect);
+}
+
 static int sock_listen_mptcp(const char * const listenaddr,
 			     const char * const port)
 {
@@ -209,6 +244,10 @@ static int sock_listen_mptcp(const char * const listenaddr,
 				     sizeof(one)))
 			perror("setsockopt");
 
+		/* accepted sockets inherit the listener scheduler */
+		if (cfg_sched)
+			set_sched(sock, cfg_sched);
+
 		if (bind(sock, a->ai_addr, a->ai_addrlen) == 0)
 			break; /* success */
 
@@ -293,6 +332,9 @@ static int sock_connect_mptcp(const char * const remoteaddr,
 		if (cfg_mark)
 			set_mark(sock, cfg_mark);
 
+		if (cfg_sched)
+			set_sched(sock, cfg_sched);
+
 		if (connect(sock, a->ai_addr, a->ai_addrlen) == 0)
 			break; /* success */
 
@@ -835,6 +877,8 @@ int main_loop_s(int listensock)
 		maybe_close(listensock);
 		check_sockaddr(pf, &ss, salen);
 		check_getpeername(remotesock, &ss, salen);
+		if (cfg_expect_sched)
+			check_sched(remotesock, cfg_expect_sched);
 
 		return copyfd_io(0, remotesock, 1);
 	}
@@ -912,6 +956,8 @@ int main_loop(void)
 		return 2;
 
 	check_getpeername_connect(fd);
+	if (cfg_expect_sched)
+		check_sched(fd, cfg_expect_sched);
 
 	if (cfg_rcvbuf)
 		set_rcvbuf(fd, cfg_rcvbuf);
@@ -1005,7 +1051,7 @@ static void parse_opts(int argc, char **argv)
 {
 	int c;
 
-	while ((c = getopt(argc, argv, "6jr:lp:s:hut:m:S:R:w:M:P:c:")) != -1) {
+	while ((c = getopt(argc, argv, "6jr:lp:s:hut:m:S:R:w:M:P:c:e:E:")) != -1) {
 		switch (c) {
 		case 'j':
 			cfg_join = true;
@@ -1064,6 +1110,12 @@ static void parse_opts(int argc, char **argv)
 		case 'c':
 			parse_cmsg_types(optarg);
 			break;
+		case 'e':
+			cfg_sched = optarg;
+			break;
+		case 'E':
+			cfg_expect_sched = optarg;
+			break;
 		}
 	}
 
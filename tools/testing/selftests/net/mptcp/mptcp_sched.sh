@@ -0,0 +1,217 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Check the MPTCP packet schedulers: that the one selected per socket
+# (MPTCP_SCHEDULER) or per namespace (net.mptcp.scheduler) is the one in
+# effect, and that it spreads the data over the two paths as it should,
+# looking at the bytes sent on each of them.
+#
+#   ns1eth1 10.0.1.1 <-- netem --> ns2eth1 10.0.1.2
+#   ns1eth2 10.0.2.1 <-- netem --> ns2eth2 10.0.2.2
+
+sec=$(date +%s)
+rndh=$(printf %x $sec)-$(mktemp -u XXXXXX)
+ns1="ns1-$rndh"
+ns2="ns2-$rndh"
+ksft_skip=4
+timeout_poll=30
+timeout_test=$((timeout_poll * 2 + 1))
+port=10000
+ret=0
+
+cleanup()
+{
+	rm -f "$cin" "$sin" "$cout" "$sout"
+	ip netns del "$ns1" 2>/dev/null
+	ip netns del "$ns2" 2>/dev/null
+}
+
+ip -Version > /dev/null 2>&1
+if [ $? -ne 0 ];then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+trap cleanup EXIT
+
+cin=$(mktemp)
+sin=$(mktemp)
+cout=$(mktemp)
+sout=$(mktemp)
+size=$((4 * 1024 * 1024))
+dd if=/dev/urandom of="$cin" bs=4096 count=$((size / 4096)) >/dev/null 2>&1
+dd if=/dev/urandom of="$sin" bs=4096 count=1 >/dev/null 2>&1
+
+for ns in "$ns1" "$ns2"; do
+	ip netns add "$ns" || exit $ksft_skip
+	ip -net "$ns" link set lo up
+	ip netns exec "$ns" sysctl -q net.ipv4.conf.all.rp_filter=0
+	ip netns exec "$ns" sysctl -q net.ipv4.conf.default.rp_filter=0
+done
+
+if ! ip netns exec "$ns1" sysctl -q net.mptcp.scheduler >/dev/null 2>&1; then
+	echo "SKIP: MPTCP schedulers are not supported"
+	exit $ksft_skip
+fi
+
+for i in 1 2; do
+	ip link add ns1eth$i netns "$ns1" type veth peer name ns2eth$i netns "$ns2"
+	ip -net "$ns1" addr add 10.0.$i.1/24 dev ns1eth$i
+	ip -net "$ns1" link set ns1eth$i up
+	ip -net "$ns2" addr add 10.0.$i.2/24 dev ns2eth$i
+	ip -net "$ns2" link set ns2eth$i up
+done
+
+# the client opens a second subflow over ns1eth2
+ip netns exec "$ns1" ./pm_nl_ctl limits 0 1
+ip netns exec "$ns1" ./pm_nl_ctl add 10.0.2.1 dev ns1eth2 flags subflow
+ip netns exec "$ns2" ./pm_nl_ctl limits 0 1
+
+# $1: delay on path 1 in ms, $2: delay on path 2 in ms
+set_links()
+{
+	local i delay
+
+	for i in 1 2; do
+		[ $i -eq 1 ] && delay=$1 || delay=$2
+		tc -n "$ns1" qdisc replace dev ns1eth$i root netem rate 20mbit \
+			delay ${delay}ms
+	done
+}
+
+# $1: ns, $2: scheduler
+set_sched_ns()
+{
+	ip netns exec "$1" sysctl -q net.mptcp.scheduler="$2"
+}
+
+tx_bytes()
+{
+	ip netns exec "$ns1" cat /sys/class/net/$1/statistics/tx_bytes
+}
+
+wait_local_port_listen()
+{
+	local port_hex i
+
+	port_hex="$(printf "%04X" "$1")"
+	for i in $(seq 10); do
+		ip netns exec "$ns2" cat /proc/net/tcp | \
+			awk "BEGIN {rc=1} {if (\$2 ~ /:${port_hex}\$/ && \$4 ~ /0A/) {rc=0; exit}} END {exit rc}" &&
+			break
+		sleep 0.1
+	done
+}
+
+# Send $cin from ns1 to ns2 and back $sin; path1 and path2 are set to
+# the bytes sent by the client on each path.
+# $1: mptcp_connect args for both ends
+do_transfer()
+{
+	local args=$1
+	local spid cpid retc rets p1 p2
+
+	port=$((port + 1))
+	p1=$(tx_bytes ns1eth1)
+	p2=$(tx_bytes ns1eth2)
+
+	timeout ${timeout_test} ip netns exec "$ns2" \
+		./mptcp_connect -jt ${timeout_poll} -l -p $port $args \
+			0.0.0.0 < "$sin" > "$sout" &
+	spid=$!
+	wait_local_port_listen $port
+
+	timeout ${timeout_test} ip netns exec "$ns1" \
+		./mptcp_connect -jt ${timeout_poll} -p $port $args \
+			10.0.1.2 < "$cin" > "$cout" &
+	cpid=$!
+
+	wait $cpid
+	retc=$?
+	wait $spid
+	rets=$?
+
+	path1=$(($(tx_bytes ns1eth1) - p1))
+	path2=$(($(tx_bytes ns1eth2) - p2))
+
+	if [ $retc -ne 0 ] || [ $rets -ne 0 ]; then
+		echo "[ fail ] client exit code $retc, server $rets"
+		return 1
+	fi
+	if ! cmp -s "$cin" "$sout" || ! cmp -s "$sin" "$cout"; then
+		echo "[ fail ] data mismatch"
+		return 1
+	fi
+	return 0
+}
+
+# $1: description, $2: mptcp_connect args, $3: condition on path1/path2
+run_test()
+{
+	printf "%-60s" "$1"
+	if ! do_transfer "$2"; then
+		ret=1
+		return
+	fi
+
+	if ! eval "$3"; then
+		echo "[ fail ] path1 $path1 path2 $path2 bytes, expected $3"
+		ret=1
+		return
+	fi
+	echo "[ OK ]"
+}
+
+printf "%-60s" "available schedulers"
+avail=$(ip netns exec "$ns1" sysctl -n net.mptcp.available_schedulers)
+for sched in default minrtt redundant wrr; do
+	if ! echo "$avail" | grep -qw $sched; then
+		echo "[ fail ] missing $sched in '$avail'"
+		exit 1
+	fi
+done
+echo "[ OK ]"
+
+printf "%-60s" "reject unknown scheduler"
+if ip netns exec "$ns1" sysctl -q net.mptcp.scheduler=nonexistent 2>/dev/null ||
+   [ "$(ip netns exec "$ns1" sysctl -n net.mptcp.scheduler)" != "default" ]; then
+	echo "[ fail ]"
+	ret=1
+else
+	echo "[ OK ]"
+fi
+
+set_links 1 1
+
+# without duplication, about one copy of the data crosses the links
+run_test "default per socket" "-e default -E default" \
+	'[ $((path1 + path2)) -lt $((size * 3 / 2)) ]'
+
+# the second path carries a copy of (nearly) the whole stream; copies
+# are skipped when its send buffer is full
+run_test "redundant per socket" "-e redundant -E redundant" \
+	'[ $((path1 + path2)) -gt $((size * 3 / 2)) ] && [ $path2 -gt $((size / 2)) ]'
+
+# both paths take turns
+run_test "wrr per socket" "-e wrr -E wrr" \
+	'[ $path1 -gt $((size / 4)) ] && [ $path2 -gt $((size / 4)) ]'
+
+# the low latency path is filled first
+set_links 1 50
+run_test "minrtt per socket, slow path 2" "-e minrtt -E minrtt" \
+	'[ $path1 -gt $path2 ]'
+set_links 50 1
+run_test "minrtt per socket, slow path 1" "-e minrtt -E minrtt" \
+	'[ $path2 -gt $path1 ]'
+
+# new sockets get the netns scheduler, the per socket one overrides it
+set_links 1 1
+for ns in "$ns1" "$ns2"; do
+	set_sched_ns "$ns" redundant
+done
+run_test "redundant per netns" "-E redundant" \
+	'[ $((path1 + path2)) -gt $((size * 3 / 2)) ] && [ $path2 -gt $((size / 2)) ]'
+run_test "default per socket over redundant per netns" "-e default -E default" \
+	'[ $((path1 + path2)) -lt $((size * 3 / 2)) ]'
+
+exit $ret
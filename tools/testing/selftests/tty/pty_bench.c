@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * pty_bench - measure the throughput of the tty receive path over a pty
+ *
+ * A child process writes blocks to the master side of a pty as fast as it
+ * can, the parent reads them back from the slave side, which goes through
+ * flush_to_ldisc() and the n_tty receive path, and reports the throughput.
+ *
+ * Usage: pty_bench [-b block_size] [-t seconds]
+ *                  [-m raw|rawflags|noecho|cooked]
+ *
+ *   raw       cfmakeraw() on the slave (default); ptys are real raw, so
+ *             this goes through n_tty_receive_buf_real_raw()
+ *   rawflags  cfmakeraw() but BRKINT and INPCK set, so that n_tty has to
+ *             look at the flags: n_tty_receive_buf_raw()
+ *   noecho    non-canonical, no echo, but ICRNL/ISIG/IXON left set:
+ *             n_tty_receive_buf_standard()
+ *   cooked    canonical mode with echo off; the data is made of lines
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+enum mode { MODE_RAW, MODE_RAWFLAGS, MODE_NOECHO, MODE_COOKED };
+
+static const char * const mode_names[] = {
+	[MODE_RAW]	= "raw",
+	[MODE_RAWFLAGS]	= "rawflags",
+	[MODE_NOECHO]	= "noecho",
+	[MODE_COOKED]	= "cooked",
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-b block_size] [-t seconds] [-m raw|rawflags|noecho|cooked]\n",
+		prog);
+	exit(EXIT_FAILURE);
+}
+
+static int setup_slave(int fd, enum mode mode)
+{
+	struct termios tio;
+
+	if (tcgetattr(fd, &tio))
+		return -1;
+
+	switch (mode) {
+	case MODE_RAW:
+		cfmakeraw(&tio);
+		break;
+	case MODE_RAWFLAGS:
+		cfmakeraw(&tio);
+		tio.c_iflag |= BRKINT | INPCK;
+		break;
+	case MODE_NOECHO:
+		tio.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHOK | ECHONL);
+		break;
+	case MODE_COOKED:
+		tio.c_lflag |= ICANON;
+		tio.c_lflag &= ~(ECHO | ECHOE | ECHOK | ECHONL);
+		break;
+	}
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+
+	return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static void writer(int master, size_t block, enum mode mode)
+{
+	char *buf = malloc(block);
+	size_t i;
+
+	if (!buf)
+		exit(EXIT_FAILURE);
+
+	/* printable data; lines of 80 chars in cooked mode */
+	for (i = 0; i < block; i++)
+		buf[i] = 'a' + i % 26;
+	if (mode == MODE_COOKED)
+		for (i = 79; i < block; i += 80)
+			buf[i] = '\n';
+
+	for (;;) {
+		ssize_t n = write(master, buf, block);
+
+		if (n < 0 && errno != EINTR)
+			exit(EXIT_SUCCESS);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	enum mode mode = MODE_RAW;
+	unsigned long long total = 0;
+	size_t block = 4096;
+	double seconds = 5;
+	double start, end;
+	char *slave_name;
+	int master, slave;
+	pid_t pid;
+	char *buf;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:t:m:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			block = strtoul(optarg, NULL, 0);
+			if (!block)
+				usage(argv[0]);
+			break;
+		case 't':
+			seconds = strtod(optarg, NULL);
+			if (seconds <= 0)
+				usage(argv[0]);
+			break;
+		case 'm':
+			for (mode = 0; mode <= MODE_COOKED; mode++)
+				if (!strcmp(optarg, mode_names[mode]))
+					break;
+			if (mode > MODE_COOKED)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) || unlockpt(master)) {
+		perror("posix_openpt");
+		return EXIT_FAILURE;
+	}
+
+	slave_name = ptsname(master);
+	slave = slave_name ? open(slave_name, O_RDWR | O_NOCTTY) : -1;
+	if (slave < 0) {
+		perror("open slave");
+		return EXIT_FAILURE;
+	}
+
+	if (setup_slave(slave, mode)) {
+		perror("tcsetattr");
+		return EXIT_FAILURE;
+	}
+
+	buf = malloc(block);
+	if (!buf)
+		return EXIT_FAILURE;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return EXIT_FAILURE;
+	}
+	if (!pid) {
+		close(slave);
+		writer(master, block, mode);
+	}
+
+	start = now();
+	end = start + seconds;
+	while (now() < end) {
+		ssize_t n = read(slave, buf, block);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("read");
+			break;
+		}
+		total += n;
+	}
+	end = now();
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	printf("%s: block %zu bytes, %llu bytes in %.2f s, %.1f MB/s\n",
+	       mode_names[mode],
+	       block, total, end - start, total / (end - start) / 1e6);
+
+	return EXIT_SUCCESS;
+}
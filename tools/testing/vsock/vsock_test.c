@@ -13,14 +13,25 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <poll.h>
 #include <linux/kernel.h>
+#include <linux/errqueue.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 
 #include "timeout.h"
 #include "control.h"
 #include "util.h"
 
+#ifndef SOL_VSOCK
+#define SOL_VSOCK 287
+#endif
+
+#ifndef VSOCK_RECVERR
+#define VSOCK_RECVERR 1
+#endif
+
 static void test_stream_connection_reset(const struct test_opts *opts)
 {
 	union {
@@ -391,6 +402,144 @@ static void test_seqpacket_msg_trunc_server(const struct test_opts *opts)
 	close(fd);
 }
 
+#define ZEROCOPY_SEND_CNT 4
+#define ZEROCOPY_BUF_SZ (64 * 1024)
+static void test_stream_msg_zerocopy_client(const struct test_opts *opts)
+{
+	char cbuf[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	struct sock_extended_err *serr;
+	unsigned int completed = 0;
+	struct msghdr msg = {0};
+	struct cmsghdr *cm;
+	int val = 1;
+	char *buf;
+	int fd;
+
+	fd = vsock_stream_connect(opts->peer_cid, 1234);
+	if (fd < 0) {
+		perror("connect");
+		exit(EXIT_FAILURE);
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val))) {
+		perror("setsockopt(SO_ZEROCOPY)");
+		exit(EXIT_FAILURE);
+	}
+
+	buf = mmap(NULL, ZEROCOPY_BUF_SZ, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < ZEROCOPY_SEND_CNT; i++) {
+		ssize_t sent = 0;
+
+		memset(buf, 'a' + i, ZEROCOPY_BUF_SZ);
+
+		while (sent < ZEROCOPY_BUF_SZ) {
+			ssize_t ret;
+
+			ret = send(fd, buf + sent, ZEROCOPY_BUF_SZ - sent,
+				   MSG_ZEROCOPY);
+			if (ret < 0) {
+				perror("send(MSG_ZEROCOPY)");
+				exit(EXIT_FAILURE);
+			}
+			sent += ret;
+		}
+
+		/* The buffer is rewritten on the next iteration, so wait
+		 * until the kernel has released it.
+		 */
+		while (completed <= i) {
+			struct pollfd fds = { .fd = fd };
+
+			if (poll(&fds, 1, TIMEOUT * 1000) != 1 ||
+			    !(fds.revents & POLLERR)) {
+				fprintf(stderr, "no zerocopy completion\n");
+				exit(EXIT_FAILURE);
+			}
+
+			msg.msg_control = cbuf;
+			msg.msg_controllen = sizeof(cbuf);
+			if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+				perror("recvmsg(MSG_ERRQUEUE)");
+				exit(EXIT_FAILURE);
+			}
+
+			cm = CMSG_FIRSTHDR(&msg);
+			if (!cm || cm->cmsg_level != SOL_VSOCK ||
+			    cm->cmsg_type != VSOCK_RECVERR) {
+				fprintf(stderr, "unexpected cmsg\n");
+				exit(EXIT_FAILURE);
+			}
+
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+			    serr->ee_errno != 0) {
+				fprintf(stderr, "unexpected completion origin %u errno %u\n",
+					serr->ee_origin, serr->ee_errno);
+				exit(EXIT_FAILURE);
+			}
+
+			/* ee_info..ee_data is the range of completed sends;
+			 * a single send() may have been split in several.
+			 */
+			if (serr->ee_info != completed) {
+				fprintf(stderr, "unexpected completion range %u..%u\n",
+					serr->ee_info, serr->ee_data);
+				exit(EXIT_FAILURE);
+			}
+			completed = serr->ee_data + 1;
+		}
+	}
+
+	control_writeln("SENDDONE");
+	munmap(buf, ZEROCOPY_BUF_SZ);
+	close(fd);
+}
+
+static void test_stream_msg_zerocopy_server(const struct test_opts *opts)
+{
+	char *buf;
+	int fd;
+
+	fd = vsock_stream_accept(VMADDR_CID_ANY, 1234, NULL);
+	if (fd < 0) {
+		perror("accept");
+		exit(EXIT_FAILURE);
+	}
+
+	buf = malloc(ZEROCOPY_BUF_SZ);
+	if (!buf) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < ZEROCOPY_SEND_CNT; i++) {
+		ssize_t ret;
+
+		ret = recv(fd, buf, ZEROCOPY_BUF_SZ, MSG_WAITALL);
+		if (ret != ZEROCOPY_BUF_SZ) {
+			fprintf(stderr, "recv returned %zd\n", ret);
+			exit(EXIT_FAILURE);
+		}
+
+		for (int j = 0; j < ZEROCOPY_BUF_SZ; j++) {
+			if (buf[j] != 'a' + i) {
+				fprintf(stderr, "data mismatch at %d:%d\n", i, j);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	control_expectln("SENDDONE");
+	free(buf);
+	close(fd);
+}
+
 static struct test_case test_cases[] = {
 	{
 		.name = "SOCK_STREAM connection reset",
@@ -431,6 +580,11 @@ static struct test_case test_cases[] = {
 		.run_client = test_seqpacket_msg_trunc_client,
 		.run_server = test_seqpacket_msg_trunc_server,
 	},
+	{
+		.name = "SOCK_STREAM MSG_ZEROCOPY",
+		.run_client = test_stream_msg_zerocopy_client,
+		.run_server = test_stream_msg_zerocopy_server,
+	},
 	{},
 };
 